@@ -20,6 +20,8 @@
 
 #include "base/location.hh"
 
+#include <stdio.h>
+
 namespace tracked_objects {
 
 Location::Location(const char *function_name,
@@ -29,7 +31,7 @@ Location::Location(const char *function_name,
         : function_name_(function_name),
           file_name_(file_name),
           line_number_(line_number),
-          program_counter_(program_countre)
+          program_counter_(program_counter)
 {
 }
 
@@ -41,10 +43,11 @@ Location::Location()
 {
 }
 
-std::string Location::ToString const
+std::string Location::ToString() const
 {
-    return std::string(function_name_) + "@" + file_name_ + ":" +
-            base::IntToString(line_number_);
+    char line[16];
+    snprintf(line, sizeof(line), "%d", line_number_);
+    return std::string(function_name_) + "@" + file_name_ + ":" + line;
 }
 
 void Location::Write(bool display_filename,
@@ -23,15 +23,15 @@
 
 #include <string>
 
-#include "base/basictypes.h"
+#include "base/basictypes.hh"
 
-namespace tacked_objects {
+namespace tracked_objects {
 
 class Location {
 public:
     Location(const char *function_name,
              const char *file_name,
-             ine line_number,
+             int line_number,
              const void *program_counter);
 
     Location();
@@ -62,7 +62,7 @@ public:
         return line_number_;
     }
 
-    const void *program_conunter() const {
+    const void *program_counter() const {
         return program_counter_;
     }
 
@@ -0,0 +1,449 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/logging/async_log.hh"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <new>
+#include <vector>
+
+#include "base/threading/thread.hh"
+
+DEFINE_int32(logringkb, 1024,
+             "Size in kilobytes of each thread's asynchronous log ring");
+
+namespace base_logging {
+
+static size_t RoundUpToPowerOfTwo(size_t n)
+{
+    size_t result = 1;
+    while (result < n) {
+        result <<= 1;
+    }
+    return result;
+}
+
+static size_t AlignRecordSize(size_t size)
+{
+    return (size + LogRing::kRecordAlign - 1) & ~(LogRing::kRecordAlign - 1);
+}
+
+// LogRing
+const size_t LogRing::kMaxRecordSize =
+        AlignRecordSize(sizeof(LogRing::Record) +
+                        LogMessage::kMaxLogMessageLen + 1);
+
+LogRing::LogRing(size_t capacity) :
+        capacity_(RoundUpToPowerOfTwo(capacity)),
+        mask_(capacity_ - 1),
+        head_(0), tail_(0), busy_(false), orphaned_(false)
+{
+    buffer_ = static_cast<char*>(malloc(capacity_));
+}
+
+LogRing::~LogRing()
+{
+    free(buffer_);
+}
+
+bool LogRing::TryPush(const LogModule *module, LogSeverity severity,
+                      time_t timestamp, const char *message, size_t len)
+{
+    const size_t size = AlignRecordSize(sizeof(Record) + len);
+    if (len == 0 || size > capacity_) {
+        return len == 0;
+    }
+    const uint64 head = head_.load(std::memory_order_relaxed);
+    const uint64 tail = tail_.load(std::memory_order_acquire);
+    const size_t offset = head & mask_;
+    const size_t padding = (offset + size > capacity_) ? capacity_ - offset : 0;
+    if (head + padding + size - tail > capacity_) {
+        return false;
+    }
+    // Pop() may still be reading a header that a DROP_OLDEST push
+    // overwrites, so size and len are stored atomically.
+    if (padding != 0) {
+        Record *pad = reinterpret_cast<Record*>(buffer_ + offset);
+        __atomic_store_n(&pad->size, padding, __ATOMIC_RELAXED);
+        __atomic_store_n(&pad->len, 0, __ATOMIC_RELAXED);
+    }
+    Record *record =
+            reinterpret_cast<Record*>(buffer_ + ((head + padding) & mask_));
+    __atomic_store_n(&record->size, size, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->len, len, __ATOMIC_RELAXED);
+    record->module = module;
+    record->timestamp = timestamp;
+    record->severity = severity;
+    memcpy(record + 1, message, len);
+    head_.store(head + padding + size, std::memory_order_release);
+    return true;
+}
+
+bool LogRing::DiscardOldest(const LogModule **module)
+{
+    uint64 tail = tail_.load(std::memory_order_acquire);
+    if (tail == head_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    // Only this thread writes records, so the header can not change under
+    // us; the consumer may still win the race for it, which is fine.
+    const Record *record =
+            reinterpret_cast<const Record*>(buffer_ + (tail & mask_));
+    const uint32 size = record->size;
+    *module = record->len ? record->module : NULL;
+    if (!tail_.compare_exchange_strong(tail, tail + size,
+                                       std::memory_order_acq_rel)) {
+        *module = NULL;
+    }
+    return true;
+}
+
+bool LogRing::Pop(Record *out)
+{
+    for (;;) {
+        uint64 tail = tail_.load(std::memory_order_acquire);
+        const uint64 head = head_.load(std::memory_order_acquire);
+        if (tail == head) {
+            return false;
+        }
+        // A producer applying kLOG_OVERFLOW_DROP_OLDEST may advance the
+        // tail and overwrite the record while we copy it, so copy first,
+        // validate, and only trust the copy if our CAS on the tail wins.
+        // A torn header can claim any size, so also keep the copy inside
+        // the buffer: no real record straddles its end.
+        const size_t offset = tail & mask_;
+        const Record *record =
+                reinterpret_cast<const Record*>(buffer_ + offset);
+        const uint32 size = __atomic_load_n(&record->size, __ATOMIC_RELAXED);
+        const uint32 len = __atomic_load_n(&record->len, __ATOMIC_RELAXED);
+        if (size < kRecordAlign || size > head - tail ||
+            size > kMaxRecordSize || offset + size > capacity_ ||
+            (len != 0 && size < sizeof(Record) + len)) {
+            continue;
+        }
+        if (len != 0) {
+            memcpy(out, record, sizeof(Record) + len);
+        }
+        if (!tail_.compare_exchange_strong(tail, tail + size,
+                                           std::memory_order_acq_rel)) {
+            continue;
+        }
+        if (len == 0) {
+            continue;
+        }
+        out->size = size;
+        out->len = len;
+        return true;
+    }
+}
+
+// Ring registry
+// Every thread that logs asynchronously owns one ring. The registry only
+// changes when a thread logs for the first time or exits, so the writer
+// works from a snapshot and never holds the lock while writing.
+static Mutex ring_registry_lock;
+static std::vector<LogRing*> ring_registry;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static __thread LogRing *current_ring = NULL;
+// Set once the thread is exiting and its ring is left to the writer, which
+// frees it when empty; whatever the thread logs after that, e.g. from a
+// later TLS destructor, is written synchronously.
+static __thread bool ring_orphaned = false;
+// The writer must never wait on its own ring, e.g. when a destination
+// reports an error through LOG_WARN().
+static __thread bool is_log_writer = false;
+
+static void OrphanRing(void *ring)
+{
+    current_ring = NULL;
+    ring_orphaned = true;
+    static_cast<LogRing*>(ring)->set_orphaned();
+}
+
+static void CreateRingKey()
+{
+    pthread_key_create(&ring_key, OrphanRing);
+}
+
+// Plain new does not honour LogRing's alignas(64) before C++17.
+static LogRing *NewLogRing(size_t capacity)
+{
+    void *memory = NULL;
+    if (posix_memalign(&memory, 64, sizeof(LogRing)) != 0) {
+        return NULL;
+    }
+    return new (memory) LogRing(capacity);
+}
+
+static void DeleteLogRing(LogRing *ring)
+{
+    ring->~LogRing();
+    free(ring);
+}
+
+// NULL once the thread has orphaned its ring on the way out, or if there
+// is no memory for one.
+static LogRing *CurrentThreadRing()
+{
+    if (PREDICT_TRUE(current_ring != NULL)) {
+        return current_ring;
+    }
+    if (ring_orphaned) {
+        return NULL;
+    }
+    pthread_once(&ring_key_once, CreateRingKey);
+    const size_t min_capacity = 2 * LogRing::kMaxRecordSize;
+    size_t capacity = static_cast<size_t>(FLAGS_logringkb) * 1024;
+    LogRing *ring = NewLogRing(capacity < min_capacity ?
+                               min_capacity : capacity);
+    if (ring == NULL) {
+        return NULL;
+    }
+    {
+        MutexLock l(ring_registry_lock);
+        ring_registry.push_back(ring);
+    }
+    pthread_setspecific(ring_key, ring);
+    current_ring = ring;
+    return ring;
+}
+
+// LogWriterThread
+class LogWriterThread : public base::Thread {
+public:
+    LogWriterThread() : base::Thread("log_writer") {
+    }
+    virtual ~LogWriterThread() {
+        Stop();
+    }
+
+protected:
+    virtual void Init();
+    virtual void Run();
+
+private:
+    size_t DrainRings();
+
+    static const size_t kMaxBatch = 256;
+    // How long the writer sleeps while idle if nobody wakes it; it is only
+    // left to run out when a push races with the writer going idle.
+    static const int kIdleWaitMs = 50;
+    std::vector<char> scratch_;
+    std::vector<LogRing*> rings_;
+    DISALLOW_COPY_AND_ASSIGN(LogWriterThread);
+};
+
+void LogWriterThread::Init()
+{
+    is_log_writer = true;
+    scratch_.resize(LogRing::kMaxRecordSize);
+}
+
+// Drains at most kMaxBatch records from each ring per pass, so one chatty
+// thread can not starve the others, and frees rings of exited threads.
+size_t LogWriterThread::DrainRings()
+{
+    {
+        MutexLock l(ring_registry_lock);
+        rings_.assign(ring_registry.begin(), ring_registry.end());
+    }
+    LogRing::Record *record =
+            reinterpret_cast<LogRing::Record*>(&scratch_[0]);
+    size_t drained = 0;
+    for (size_t i = 0; i < rings_.size(); ++i) {
+        LogRing *ring = rings_[i];
+        const bool orphaned = ring->orphaned();
+        size_t batch = 0;
+        while (batch < kMaxBatch && ring->Pop(record)) {
+            record->module->Log(static_cast<LogSeverity>(record->severity),
+                                static_cast<time_t>(record->timestamp),
+                                record->message(), record->len);
+            ++batch;
+        }
+        drained += batch;
+        if (orphaned && ring->empty()) {
+            MutexLock l(ring_registry_lock);
+            for (size_t j = 0; j < ring_registry.size(); ++j) {
+                if (ring_registry[j] == ring) {
+                    ring_registry.erase(ring_registry.begin() + j);
+                    break;
+                }
+            }
+            DeleteLogRing(ring);
+        }
+    }
+    return drained;
+}
+
+// Set while the writer is about to sleep; the first producer to see it
+// clears it and wakes the writer.
+static std::atomic<bool> log_writer_idle(false);
+
+// Batches writes: destinations are only flushed once the rings run dry,
+// instead of once per record.
+void LogWriterThread::Run()
+{
+    bool dirty = false;
+    while (!stopping()) {
+        if (DrainRings() > 0) {
+            dirty = true;
+            continue;
+        }
+        if (dirty) {
+            LogDestination::FlushAll();
+            dirty = false;
+        }
+        // Look once more after going idle, for records pushed by producers
+        // that checked the flag just before we set it.
+        log_writer_idle.store(true);
+        if (DrainRings() > 0) {
+            dirty = true;
+        } else {
+            WaitForWork(base::TimeDelta::FromMilliseconds(kIdleWaitMs));
+        }
+        log_writer_idle.store(false, std::memory_order_relaxed);
+    }
+    while (DrainRings() > 0) {
+    }
+    LogDestination::FlushAll();
+}
+
+static Mutex async_control_lock;
+static LogWriterThread *log_writer = NULL;
+static std::atomic<bool> async_running(false);
+
+bool AsyncLogEnqueue(const LogModule *module, LogSeverity severity,
+                     time_t timestamp, const char *message, size_t len)
+{
+    if (!async_running.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    LogRing *ring = CurrentThreadRing();
+    if (PREDICT_FALSE(ring == NULL)) {
+        return false;
+    }
+    // Pairs with StopAsyncLogging(): either it sees us busy and waits, or
+    // we see that it has stopped and write synchronously.
+    ring->set_busy(true);
+    if (!async_running.load(std::memory_order_seq_cst)) {
+        ring->set_busy(false);
+        return false;
+    }
+    const LogOverflowPolicy policy = is_log_writer ?
+            kLOG_OVERFLOW_DROP_NEWEST :
+            module->overflow_policy.load(std::memory_order_relaxed);
+    while (!ring->TryPush(module, severity, timestamp, message, len)) {
+        const LogModule *victim = NULL;
+        switch (policy) {
+        case kLOG_OVERFLOW_DROP_NEWEST:
+            module->n_dropped.fetch_add(1, std::memory_order_relaxed);
+            ring->set_busy(false);
+            return true;
+        case kLOG_OVERFLOW_DROP_OLDEST:
+            if (ring->DiscardOldest(&victim) && victim != NULL) {
+                victim->n_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            break;
+        case kLOG_OVERFLOW_BLOCK:
+        default:
+            sched_yield();
+            break;
+        }
+    }
+    // Still busy, so StopAsyncLogging() has not deleted the writer yet.
+    if (PREDICT_FALSE(log_writer_idle.load(std::memory_order_relaxed)) &&
+        log_writer_idle.exchange(false)) {
+        log_writer->Wake();
+    }
+    ring->set_busy(false);
+    return true;
+}
+
+// Records are popped into a static buffer: a signal handler can not
+// allocate one.
+static LogRing::Record *crash_record = reinterpret_cast<LogRing::Record*>(
+        new char[LogRing::kMaxRecordSize]);
+
+void CrashDrainRings()
+{
+    // The registry is read without its lock, which another thread may be
+    // holding for good. This is best effort: a ring registered or freed at
+    // this very moment may be missed.
+    for (size_t i = 0; i < ring_registry.size(); ++i) {
+        LogRing *ring = ring_registry[i];
+        while (ring->Pop(crash_record)) {
+            crash_record->module->CrashLog(
+                    static_cast<LogSeverity>(crash_record->severity),
+                    static_cast<time_t>(crash_record->timestamp),
+                    crash_record->message(), crash_record->len);
+        }
+    }
+}
+
+}  // namespace base_logging
+
+void StartAsyncLogging()
+{
+    MutexLock l(base_logging::async_control_lock);
+    if (base_logging::log_writer != NULL) {
+        return;
+    }
+    base_logging::log_writer = new base_logging::LogWriterThread();
+    if (!base_logging::log_writer->Start()) {
+        delete base_logging::log_writer;
+        base_logging::log_writer = NULL;
+        return;
+    }
+    base_logging::async_running.store(true, std::memory_order_seq_cst);
+}
+
+void StopAsyncLogging()
+{
+    // The writer can not join itself; what it logs goes straight out.
+    if (base_logging::is_log_writer) {
+        return;
+    }
+    MutexLock l(base_logging::async_control_lock);
+    if (base_logging::log_writer == NULL) {
+        return;
+    }
+    base_logging::async_running.store(false, std::memory_order_seq_cst);
+    {
+        MutexLock registry(base_logging::ring_registry_lock);
+        for (size_t i = 0; i < base_logging::ring_registry.size(); ++i) {
+            while (base_logging::ring_registry[i]->busy()) {
+                sched_yield();
+            }
+        }
+    }
+    // Stop() lets the writer drain whatever is left before it exits.
+    delete base_logging::log_writer;
+    base_logging::log_writer = NULL;
+}
+
+bool IsAsyncLogging()
+{
+    return base_logging::async_running.load(std::memory_order_relaxed);
+}
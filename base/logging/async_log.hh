@@ -0,0 +1,127 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_LOGGING_ASYNC_LOG_HH_
+#define BASE_LOGGING_ASYNC_LOG_HH_
+
+#include <time.h>
+
+#include <atomic>
+
+#include "base/basictypes.hh"
+#include "base/logging/logging.hh"
+
+namespace base_logging {
+
+// LogRing is a lock-free ring of variable-length log records with a single
+// producer (the thread that owns it) and a single consumer (the log writer
+// thread). Positions are free-running 64-bit byte offsets, so they never
+// wrap and compare-and-swap on them can not suffer from ABA.
+//
+// Every record starts with a Record header and is padded to kRecordAlign
+// bytes. A record never straddles the end of the buffer: when it does not
+// fit the producer first emits a padding record (len == 0) that the
+// consumer silently skips.
+class LogRing {
+public:
+    struct Record {
+        uint32 size;       // Bytes including this header, kRecordAlign'ed.
+        uint32 len;        // Message bytes following the header.
+        const LogModule *module;
+        int64 timestamp;
+        int32 severity;
+        const char *message() const {
+            return reinterpret_cast<const char*>(this + 1);
+        }
+    };
+    static const size_t kRecordAlign = 8;
+    // A buffer of this size can hold any record handed out by Pop().
+    static const size_t kMaxRecordSize;
+
+    // |capacity| is rounded up to a power of two.
+    explicit LogRing(size_t capacity);
+    ~LogRing();
+
+    // Producer side. Returns false if there is not enough free space.
+    bool TryPush(const LogModule *module, LogSeverity severity,
+                 time_t timestamp, const char *message, size_t len);
+    // Producer side. Throws away the oldest record to make room and
+    // returns true, storing its module in |module| (NULL for padding).
+    // Returns false if the ring is empty.
+    bool DiscardOldest(const LogModule **module);
+
+    // Consumer side. Copies the oldest record into |record|, which must
+    // point to at least kMaxRecordSize bytes. Returns false if empty.
+    bool Pop(Record *record);
+
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) ==
+                head_.load(std::memory_order_acquire);
+    }
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    // Set by the owning thread around a push so StopAsyncLogging() can
+    // wait for in-flight producers.
+    void set_busy(bool busy) {
+        busy_.store(busy, std::memory_order_seq_cst);
+    }
+    bool busy() const {
+        return busy_.load(std::memory_order_seq_cst);
+    }
+    // Set once the owning thread has exited; the writer frees the ring
+    // after draining it.
+    void set_orphaned() {
+        orphaned_.store(true, std::memory_order_release);
+    }
+    bool orphaned() const {
+        return orphaned_.load(std::memory_order_acquire);
+    }
+
+private:
+    char *buffer_;
+    size_t capacity_;
+    uint64 mask_;
+    // Keep producer and consumer positions on separate cache lines.
+    alignas(64) std::atomic<uint64> head_;
+    alignas(64) std::atomic<uint64> tail_;
+    alignas(64) std::atomic<bool> busy_;
+    std::atomic<bool> orphaned_;
+    DISALLOW_COPY_AND_ASSIGN(LogRing);
+};
+
+// Hands a formatted message to the log writer thread. Returns false if
+// asynchronous logging is not running, in which case the caller must
+// write the message itself. Applies |module|'s overflow policy when the
+// calling thread's ring is full.
+bool AsyncLogEnqueue(const LogModule *module, LogSeverity severity,
+                     time_t timestamp, const char *message, size_t len);
+
+// Writes every record still queued in the rings through the destinations'
+// CrashWrite(), for when the process is about to die. Takes no locks and
+// does not allocate, so it can run in a signal handler; the writer thread
+// may keep popping records concurrently. Only for the crash handler:
+// elsewhere StopAsyncLogging() drains the rings safely.
+void CrashDrainRings();
+
+}  // namespace base_logging
+
+#endif  // BASE_LOGGING_ASYNC_LOG_HH_
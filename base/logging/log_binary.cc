@@ -0,0 +1,596 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/logging/log_binary.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "base/logging/log_crash.hh"
+#include "base/logging/log_prefix.hh"
+
+DECLARE_int32(logbufsecs);
+DECLARE_int32(logbufkb);
+
+namespace {
+
+// A binary log file starts with kBinaryLogMagic, followed by entries of
+// one of these kinds, in native byte order:
+//   kEntrySite:    uint32 id, int32 line, int32 severity, then the module
+//                  name, file, format and argument types, each terminated
+//   kEntryMessage: uint32 id, uint32 thread id, int64 timestamp_us,
+//                  uint32 len, then len bytes of arguments
+//   kEntryText:    int32 severity, int64 timestamp (seconds),
+//                  uint32 len, then len bytes of text
+// A site's definition comes before its first message.
+const char kBinaryLogMagic[8] = { 'B', 'I', 'N', 'L', 'O', 'G', '1', '\n' };
+enum BinaryLogEntry {
+    kEntrySite = 'S',
+    kEntryMessage = 'M',
+    kEntryText = 'T',
+};
+
+// Longest rendered message
+const size_t kMaxBinaryMessageLen = 2 * base_logging::kMaxLogBinaryArgsLen;
+// More sites than any program defines; a larger id in a file is corrupt.
+const uint32 kMaxBinaryLogSites = 1 << 20;
+
+Mutex site_registry_lock;
+uint32 num_sites = 0;
+
+// Reads the next argument of type |type| from [*arg, end) into |value|.
+template <typename T>
+bool NextArg(char type, char expected, const char **arg, const char *end,
+             T *value)
+{
+    if (type != expected || static_cast<size_t>(end - *arg) < sizeof(T)) {
+        return false;
+    }
+    memcpy(value, *arg, sizeof(T));
+    *arg += sizeof(T);
+    return true;
+}
+
+// Reads an int32, uint32, int64 or uint64 argument as an int64.
+bool NextIntegerArg(char type, const char **arg, const char *end,
+                    int64 *value)
+{
+    int32 i32;
+    uint32 u32;
+    uint64 u64;
+    if (NextArg(type, 'i', arg, end, &i32)) {
+        *value = i32;
+    } else if (NextArg(type, 'u', arg, end, &u32)) {
+        *value = u32;
+    } else if (NextArg(type, 'U', arg, end, &u64)) {
+        *value = static_cast<int64>(u64);
+    } else if (!NextArg(type, 'I', arg, end, value)) {
+        return false;
+    }
+    return true;
+}
+
+size_t FormatBinaryMessage(char *buf, size_t size, LogSeverity severity,
+                           const char *file, int line, const char *format,
+                           const char *arg_types, int64 timestamp_us,
+                           const base_logging::LogThreadTag &thread,
+                           const char *args, size_t args_len)
+{
+    size_t n = base_logging::LogPrefixFormatter::Format(
+            buf, size - 1, severity, timestamp_us, thread, file, line);
+    n += base_logging::FormatLogBinaryArgs(buf + n, size - 1 - n, format,
+                                           arg_types, args, args_len);
+    buf[n++] = '\n';
+    return n;
+}
+
+template <typename T>
+bool ReadValue(FILE *in, T *value)
+{
+    return fread(value, sizeof(*value), 1, in) == 1;
+}
+
+bool ReadString(FILE *in, std::string *s)
+{
+    s->clear();
+    int c;
+    while ((c = getc(in)) != EOF) {
+        if (c == '\0') {
+            return true;
+        }
+        s->push_back(static_cast<char>(c));
+    }
+    return false;
+}
+
+struct DecodedSite {
+    std::string module;
+    std::string file;
+    std::string format;
+    std::string arg_types;
+    int32 line;
+    int32 severity;
+};
+
+}  // namespace
+
+size_t LogBinarySite::Format(char *buf, size_t size, int64 timestamp_us,
+                             const base_logging::LogThreadTag &thread,
+                             const char *args, size_t args_len) const
+{
+    return FormatBinaryMessage(buf, size, severity, file, line, format,
+                               arg_types, timestamp_us, thread, args,
+                               args_len);
+}
+
+void LogDestination::LogBinary(const LogBinarySite *site, int64 timestamp_us,
+                               const char *args, size_t len)
+{
+    char buf[kMaxBinaryMessageLen];
+    const size_t n = site->Format(buf, sizeof(buf), timestamp_us,
+                                  base_logging::CurrentLogThreadTag(),
+                                  args, len);
+    Log(site->severity,
+        static_cast<time_t>(timestamp_us / base::kMicrosecondsPerSecond),
+        buf, n);
+}
+
+namespace base_logging {
+
+uint32 RegisterLogBinarySite(LogBinarySite *site, const LogModule *module,
+                             const char *arg_types)
+{
+    MutexLock l(site_registry_lock);
+    uint32 id = site->id.load(std::memory_order_relaxed);
+    if (id == 0) {
+        site->module = module;
+        site->arg_types = arg_types;
+        id = ++num_sites;
+        site->id.store(id, std::memory_order_release);
+    }
+    return id;
+}
+
+size_t FormatLogBinaryArgs(char *buf, size_t size, const char *format,
+                           const char *arg_types, const char *args,
+                           size_t args_len)
+{
+    if (size == 0) {
+        return 0;
+    }
+    const char *arg = args;
+    const char *end = args + args_len;
+    const char *type = arg_types;
+    size_t n = 0;
+    const char *f = format;
+    while (*f != '\0' && n < size - 1) {
+        if (*f != '%') {
+            buf[n++] = *f++;
+            continue;
+        }
+        if (f[1] == '%') {
+            buf[n++] = '%';
+            f += 2;
+            continue;
+        }
+        // Rebuild the conversion with the length modifier matching the
+        // stored argument, taking '*' widths and precisions from the
+        // arguments too. Room is left for "ll", the conversion and the
+        // terminator; a longer spec is not one we wrote, so decoding stops
+        // there.
+        char spec[64];
+        const size_t kSpecRoom = sizeof(spec) - 4;
+        size_t len = 0;
+        spec[len++] = *f++;
+        bool ok = true;
+        while (*f != '\0' && strchr("-+ #0'", *f) != NULL) {
+            if (len >= kSpecRoom) {
+                ok = false;
+                break;
+            }
+            spec[len++] = *f++;
+        }
+        for (int part = 0; part < 2 && ok; ++part) {
+            if (part == 1) {
+                if (*f != '.') {
+                    break;
+                }
+                if (len >= kSpecRoom) {
+                    ok = false;
+                    break;
+                }
+                spec[len++] = *f++;
+            }
+            if (*f == '*') {
+                int64 value;
+                ok = NextIntegerArg(*type, &arg, end, &value);
+                if (ok) {
+                    ++type;
+                    const int printed = snprintf(spec + len, kSpecRoom - len,
+                                                 "%d", static_cast<int>(value));
+                    ok = printed >= 0 &&
+                            static_cast<size_t>(printed) < kSpecRoom - len;
+                    if (ok) {
+                        len += printed;
+                    }
+                }
+                ++f;
+            }
+            while (*f >= '0' && *f <= '9' && ok) {
+                if (len >= kSpecRoom) {
+                    ok = false;
+                    break;
+                }
+                spec[len++] = *f++;
+            }
+        }
+        while (*f != '\0' && strchr("hlLqjzt", *f) != NULL) {
+            ++f;
+        }
+        const char conversion = *f;
+        if (conversion == '\0') {
+            break;
+        }
+        ++f;
+
+        int written = -1;
+        int64 integer;
+        double real;
+        uint64 pointer;
+        if (!ok) {
+            break;
+        }
+        if (conversion == 'c' &&
+            NextIntegerArg(*type, &arg, end, &integer)) {
+            // %llc does not exist; a char is passed as an int.
+            spec[len++] = 'c';
+            spec[len] = '\0';
+            written = snprintf(buf + n, size - n, spec,
+                               static_cast<int>(integer));
+        } else if (strchr("diouxX", conversion) != NULL &&
+                   NextIntegerArg(*type, &arg, end, &integer)) {
+            spec[len++] = 'l';
+            spec[len++] = 'l';
+            spec[len++] = conversion;
+            spec[len] = '\0';
+            written = snprintf(buf + n, size - n, spec,
+                               static_cast<long long>(integer));
+        } else if (strchr("fFeEgGaA", conversion) != NULL &&
+                   NextArg(*type, 'f', &arg, end, &real)) {
+            spec[len++] = conversion;
+            spec[len] = '\0';
+            written = snprintf(buf + n, size - n, spec, real);
+        } else if (conversion == 'p' &&
+                   NextArg(*type, 'p', &arg, end, &pointer)) {
+            spec[len++] = 'p';
+            spec[len] = '\0';
+            written = snprintf(buf + n, size - n, spec,
+                               reinterpret_cast<void*>(pointer));
+        } else if (conversion == 's' && *type == 's' && arg < end &&
+                   memchr(arg, '\0', end - arg) != NULL) {
+            spec[len++] = 's';
+            spec[len] = '\0';
+            written = snprintf(buf + n, size - n, spec, arg);
+            arg += strlen(arg) + 1;
+        }
+        if (written < 0) {
+            // The argument is missing, e.g. cut off by
+            // kMaxLogBinaryArgsLen; stop here.
+            break;
+        }
+        ++type;
+        n += std::min(static_cast<size_t>(written), size - 1 - n);
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+bool DecodeBinaryLog(FILE *in, FILE *out)
+{
+    char magic[sizeof(kBinaryLogMagic)];
+    if (fread(magic, sizeof(magic), 1, in) != 1 ||
+        memcmp(magic, kBinaryLogMagic, sizeof(magic)) != 0) {
+        return false;
+    }
+    std::vector<DecodedSite> sites;
+    std::vector<char> data;
+    char buf[kMaxBinaryMessageLen];
+    int kind;
+    while ((kind = getc(in)) != EOF) {
+        switch (kind) {
+        case kEntrySite: {
+            uint32 id;
+            DecodedSite site;
+            if (!ReadValue(in, &id) || !ReadValue(in, &site.line) ||
+                !ReadValue(in, &site.severity) ||
+                !ReadString(in, &site.module) || !ReadString(in, &site.file) ||
+                !ReadString(in, &site.format) ||
+                !ReadString(in, &site.arg_types)) {
+                return true;
+            }
+            if (site.severity < 0 || site.severity >= kLS_MAX ||
+                id >= kMaxBinaryLogSites) {
+                return false;
+            }
+            if (id >= sites.size()) {
+                sites.resize(id + 1);
+            }
+            sites[id] = site;
+            break;
+        }
+        case kEntryMessage: {
+            uint32 id;
+            uint32 thread_id;
+            int64 timestamp_us;
+            uint32 len;
+            if (!ReadValue(in, &id) || !ReadValue(in, &thread_id) ||
+                !ReadValue(in, &timestamp_us) || !ReadValue(in, &len)) {
+                return true;
+            }
+            if (id >= sites.size() || sites[id].file.empty() ||
+                len > base_logging::kMaxLogBinaryArgsLen) {
+                return false;
+            }
+            data.resize(len);
+            if (len != 0 && fread(&data[0], len, 1, in) != 1) {
+                return true;
+            }
+            const DecodedSite &site = sites[id];
+            // Only the thread id is recorded, not its name.
+            base_logging::LogThreadTag thread;
+            thread.Set(static_cast<pid_t>(thread_id), NULL);
+            const size_t n = FormatBinaryMessage(
+                    buf, sizeof(buf), static_cast<LogSeverity>(site.severity),
+                    site.file.c_str(), site.line, site.format.c_str(),
+                    site.arg_types.c_str(), timestamp_us, thread,
+                    len != 0 ? &data[0] : NULL, len);
+            fwrite(buf, 1, n, out);
+            break;
+        }
+        case kEntryText: {
+            int32 severity;
+            int64 timestamp;
+            uint32 len;
+            if (!ReadValue(in, &severity) || !ReadValue(in, &timestamp) ||
+                !ReadValue(in, &len)) {
+                return true;
+            }
+            data.resize(len);
+            if (len != 0 && fread(&data[0], len, 1, in) != 1) {
+                return true;
+            }
+            if (len != 0) {
+                fwrite(&data[0], 1, len, out);
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace base_logging
+
+LogDestinationToBinaryFile::LogDestinationToBinaryFile(
+    const std::string &name) :
+        filename_(name), buffer_(NULL),
+        buffer_size_(base_logging::LogFileBufferSize()),
+        buffer_used_(0), buffer_messages_(0), next_flush_time_us_(0)
+{
+    type = kLOG_DST_BINARY;
+}
+
+LogDestinationToBinaryFile::~LogDestinationToBinaryFile()
+{
+    Unregister();
+    Flush();
+    if (log_fd_ != -1) {
+        close(log_fd_);
+    }
+    free(buffer_);
+}
+
+bool LogDestinationToBinaryFile::OpenUnLocked()
+{
+    if (buffer_ == NULL) {
+        buffer_ = static_cast<char*>(malloc(buffer_size_));
+        if (buffer_ == NULL) {
+            return false;
+        }
+    }
+    log_fd_ = open(filename_.c_str(),
+                   O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664);
+    if (log_fd_ == -1) {
+        return false;
+    }
+    AppendUnLocked(kBinaryLogMagic, sizeof(kBinaryLogMagic));
+    return true;
+}
+
+void LogDestinationToBinaryFile::FlushUnLocked()
+{
+    if (buffer_used_ == 0) {
+        return;
+    }
+    base_logging::ScopedFlushTimer timer(&stats.flush_latency);
+    const char *p = buffer_;
+    while (log_fd_ != -1 && p < buffer_ + buffer_used_) {
+        const ssize_t n = write(log_fd_, p, buffer_ + buffer_used_ - p);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        p += n;
+    }
+    if (p < buffer_ + buffer_used_) {
+        stats.dropped.Add(buffer_messages_);
+        stats.dropped_bytes.Add(buffer_ + buffer_used_ - p);
+        // The lost bytes may hold site definitions; write them again
+        // before their next message, or the decoder can not read it.
+        sites_written_.assign(sites_written_.size(), false);
+    }
+    buffer_used_ = 0;
+    buffer_messages_ = 0;
+}
+
+void LogDestinationToBinaryFile::AppendUnLocked(const void *data, size_t len)
+{
+    while (len > 0) {
+        if (buffer_used_ == buffer_size_) {
+            FlushUnLocked();
+        }
+        const size_t n = std::min(len, buffer_size_ - buffer_used_);
+        memcpy(buffer_ + buffer_used_, data, n);
+        buffer_used_ += n;
+        stats.RecordBufferFill(buffer_used_);
+        data = static_cast<const char*>(data) + n;
+        len -= n;
+    }
+}
+
+void LogDestinationToBinaryFile::MaybeFlushUnLocked(LogSeverity severity,
+                                                    int64 timestamp_us)
+{
+    if (FLAGS_logbufkb <= 0 || severity <= kLS_ERR ||
+        timestamp_us >= next_flush_time_us_) {
+        FlushUnLocked();
+        next_flush_time_us_ = timestamp_us +
+                FLAGS_logbufsecs * base::kMicrosecondsPerSecond;
+    }
+}
+
+std::string LogDestinationToBinaryFile::Describe() const
+{
+    return "binary:" + filename_;
+}
+
+void LogDestinationToBinaryFile::Log(LogSeverity severity, time_t timestamp,
+                                     const char* message, size_t len)
+{
+    MutexLock l(lock_);
+    if (log_fd_ == -1 && !OpenUnLocked()) {
+        stats.dropped.Add(1);
+        stats.dropped_bytes.Add(len);
+        return;
+    }
+    const char kind = kEntryText;
+    const int32 severity32 = severity;
+    const int64 timestamp64 = timestamp;
+    const uint32 len32 = static_cast<uint32>(len);
+    AppendUnLocked(&kind, sizeof(kind));
+    AppendUnLocked(&severity32, sizeof(severity32));
+    AppendUnLocked(&timestamp64, sizeof(timestamp64));
+    AppendUnLocked(&len32, sizeof(len32));
+    AppendUnLocked(message, len);
+    ++buffer_messages_;
+    MaybeFlushUnLocked(severity, timestamp64 * base::kMicrosecondsPerSecond);
+}
+
+void LogDestinationToBinaryFile::LogBinary(const LogBinarySite *site,
+                                           int64 timestamp_us,
+                                           const char *args, size_t len)
+{
+    MutexLock l(lock_);
+    if (log_fd_ == -1 && !OpenUnLocked()) {
+        stats.dropped.Add(1);
+        stats.dropped_bytes.Add(len);
+        return;
+    }
+    const uint32 id = site->id.load(std::memory_order_relaxed);
+    if (id >= sites_written_.size()) {
+        sites_written_.resize(id + 1);
+    }
+    if (!sites_written_[id]) {
+        const char kind = kEntrySite;
+        const int32 line = site->line;
+        const int32 severity = site->severity;
+        AppendUnLocked(&kind, sizeof(kind));
+        AppendUnLocked(&id, sizeof(id));
+        AppendUnLocked(&line, sizeof(line));
+        AppendUnLocked(&severity, sizeof(severity));
+        AppendUnLocked(site->module->name.c_str(),
+                       site->module->name.size() + 1);
+        AppendUnLocked(site->file, strlen(site->file) + 1);
+        AppendUnLocked(site->format, strlen(site->format) + 1);
+        AppendUnLocked(site->arg_types, strlen(site->arg_types) + 1);
+        sites_written_[id] = true;
+    }
+    const char kind = kEntryMessage;
+    const uint32 thread_id = static_cast<uint32>(
+            base_logging::CurrentLogThreadTag().tid);
+    const uint32 len32 = static_cast<uint32>(len);
+    AppendUnLocked(&kind, sizeof(kind));
+    AppendUnLocked(&id, sizeof(id));
+    AppendUnLocked(&thread_id, sizeof(thread_id));
+    AppendUnLocked(&timestamp_us, sizeof(timestamp_us));
+    AppendUnLocked(&len32, sizeof(len32));
+    AppendUnLocked(args, len);
+    ++buffer_messages_;
+    MaybeFlushUnLocked(site->severity, timestamp_us);
+}
+
+void LogDestinationToBinaryFile::Flush()
+{
+    MutexLock l(lock_);
+    FlushUnLocked();
+}
+
+void LogDestinationToBinaryFile::CrashFlush()
+{
+    if (log_fd_ != -1 && buffer_used_ > 0) {
+        const size_t used = buffer_used_;
+        buffer_used_ = 0;
+        buffer_messages_ = 0;
+        base_logging::CrashWriteFd(log_fd_, buffer_, used);
+    }
+}
+
+// Writes a text entry straight to the file, after whatever is buffered.
+void LogDestinationToBinaryFile::CrashWrite(LogSeverity severity,
+                                            time_t timestamp,
+                                            const char* message, size_t len)
+{
+    CrashFlush();
+    if (log_fd_ == -1) {
+        return;
+    }
+    const int32 severity32 = severity;
+    const int64 timestamp64 = timestamp;
+    const uint32 len32 = static_cast<uint32>(len);
+    char header[1 + sizeof(severity32) + sizeof(timestamp64) + sizeof(len32)];
+    char *p = header;
+    *p++ = kEntryText;
+    memcpy(p, &severity32, sizeof(severity32));
+    p += sizeof(severity32);
+    memcpy(p, &timestamp64, sizeof(timestamp64));
+    p += sizeof(timestamp64);
+    memcpy(p, &len32, sizeof(len32));
+    base_logging::CrashWriteFd(log_fd_, header, sizeof(header));
+    base_logging::CrashWriteFd(log_fd_, message, len);
+}
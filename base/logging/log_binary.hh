@@ -0,0 +1,264 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_LOGGING_LOG_BINARY_HH_
+#define BASE_LOGGING_LOG_BINARY_HH_
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.hh"
+#include "base/logging/logging.hh"
+
+namespace base_logging {
+struct LogThreadTag;
+}  // namespace base_logging
+
+// Binary logging
+// LOG_INFO_BIN("opened %s in %d ms", path, ms) costs about as much as
+// copying its arguments: the format string, file, line and argument types
+// are registered once per call site, and each message only carries the
+// site's id, a timestamp and the raw argument bytes. A
+// LogDestinationToBinaryFile stores messages in that form, to be rendered
+// by the log_decode tool later; every other destination gets them
+// formatted as text, so binary statements can be mixed with LOG_INFO()
+// and friends freely. Binary statements are always written synchronously.
+//
+// Arguments may be integers, floating point numbers, C strings and other
+// pointers, and are checked against the format like printf's.
+
+// One per binary log statement, in static storage.
+struct LogBinarySite {
+    const char *file;
+    int line;
+    LogSeverity severity;
+    const char *format;
+    // Set when the site is first hit; id is non-zero from then on.
+    const LogModule *module;
+    const char *arg_types;
+    std::atomic<uint32> id;
+
+    // Renders a message of this site as "<prefix><message>\n" into |buf|,
+    // returning the number of bytes written.
+    size_t Format(char *buf, size_t size, int64 timestamp_us,
+                  const base_logging::LogThreadTag &thread,
+                  const char *args, size_t args_len) const;
+};
+
+namespace base_logging {
+
+// Longest argument encoding of one message; longer strings are cut short.
+const size_t kMaxLogBinaryArgsLen = 4096;
+
+// Assigns |site| its id.
+uint32 RegisterLogBinarySite(LogBinarySite *site, const LogModule *module,
+                             const char *arg_types);
+
+// Formats |args|, encoded for |arg_types|, according to the printf-style
+// |format| into |buf|. Returns the number of bytes written, at most
+// |size| - 1; the result is always terminated.
+size_t FormatLogBinaryArgs(char *buf, size_t size, const char *format,
+                           const char *arg_types, const char *args,
+                           size_t args_len);
+
+// Arguments are encoded in native byte order as int32 ('i'), uint32
+// ('u'), int64 ('I'), uint64 ('U'), double ('f'), pointers as uint64
+// ('p') and terminated strings ('s').
+template <typename T> struct LogBinaryArg;
+
+template <typename T, typename Stored, char kCode>
+struct LogBinaryScalarArg {
+    static const char kType = kCode;
+    static size_t Size(T) {
+        return sizeof(Stored);
+    }
+    static char *Encode(char *p, char *end, T value) {
+        const Stored stored = static_cast<Stored>(value);
+        memcpy(p, &stored, sizeof(stored));
+        return p + sizeof(stored);
+    }
+};
+
+#define LOG_BINARY_SCALAR_ARG(T, Stored, code)                          \
+    template <> struct LogBinaryArg<T>                                  \
+            : LogBinaryScalarArg<T, Stored, code> {}
+
+LOG_BINARY_SCALAR_ARG(bool, int32, 'i');
+LOG_BINARY_SCALAR_ARG(char, int32, 'i');
+LOG_BINARY_SCALAR_ARG(signed char, int32, 'i');
+LOG_BINARY_SCALAR_ARG(unsigned char, uint32, 'u');
+LOG_BINARY_SCALAR_ARG(short, int32, 'i');
+LOG_BINARY_SCALAR_ARG(unsigned short, uint32, 'u');
+LOG_BINARY_SCALAR_ARG(int, int32, 'i');
+LOG_BINARY_SCALAR_ARG(unsigned int, uint32, 'u');
+LOG_BINARY_SCALAR_ARG(long, int64, 'I');
+LOG_BINARY_SCALAR_ARG(unsigned long, uint64, 'U');
+LOG_BINARY_SCALAR_ARG(long long, int64, 'I');
+LOG_BINARY_SCALAR_ARG(unsigned long long, uint64, 'U');
+LOG_BINARY_SCALAR_ARG(float, double, 'f');
+LOG_BINARY_SCALAR_ARG(double, double, 'f');
+
+#undef LOG_BINARY_SCALAR_ARG
+
+template <typename T> struct LogBinaryArg<T*> {
+    static const char kType = 'p';
+    static size_t Size(const T*) {
+        return sizeof(uint64);
+    }
+    static char *Encode(char *p, char *end, const T *value) {
+        const uint64 stored = reinterpret_cast<uintptr_t>(value);
+        memcpy(p, &stored, sizeof(stored));
+        return p + sizeof(stored);
+    }
+};
+
+template <> struct LogBinaryArg<const char*> {
+    static const char kType = 's';
+    static size_t Size(const char *value) {
+        return (value != NULL ? strlen(value) : 6) + 1;
+    }
+    // |p| has room for at least the terminator.
+    static char *Encode(char *p, char *end, const char *value) {
+        if (value == NULL) {
+            value = "(null)";
+        }
+        size_t len = strlen(value);
+        if (len > static_cast<size_t>(end - p) - 1) {
+            len = end - p - 1;
+        }
+        memcpy(p, value, len);
+        p[len] = '\0';
+        return p + len + 1;
+    }
+};
+
+template <> struct LogBinaryArg<char*> : LogBinaryArg<const char*> {};
+
+inline char *EncodeLogBinaryArgs(char *p, char *end)
+{
+    return p;
+}
+
+// Stops at the first argument that does not fit, except that strings are
+// cut short to fit.
+template <typename T, typename... Rest>
+char *EncodeLogBinaryArgs(char *p, char *end, T value, Rest... rest)
+{
+    if (static_cast<size_t>(end - p) < (LogBinaryArg<T>::kType == 's' ?
+                                        1 : LogBinaryArg<T>::Size(value))) {
+        return p;
+    }
+    return EncodeLogBinaryArgs(LogBinaryArg<T>::Encode(p, end, value), end,
+                               rest...);
+}
+
+template <typename... Args>
+const char *LogBinaryArgTypes()
+{
+    static const char types[] = { LogBinaryArg<Args>::kType..., '\0' };
+    return types;
+}
+
+template <typename... Args>
+void LogBinary(const LogModule *module, LogBinarySite *site, Args... args)
+{
+    uint32 id = site->id.load(std::memory_order_acquire);
+    if (PREDICT_BRANCH_NOT_TAKEN(id == 0)) {
+        RegisterLogBinarySite(site, module, LogBinaryArgTypes<Args...>());
+    }
+    char buf[kMaxLogBinaryArgsLen];
+    const char *end = EncodeLogBinaryArgs(buf, buf + sizeof(buf), args...);
+    module->LogBinary(site, base::Time::Now().ToInternalValue(), buf,
+                      end - buf);
+}
+
+// Never called; lets the compiler check the arguments against the format.
+inline void CheckLogBinaryFormat(const char *format, ...)
+        __attribute__((format(printf, 1, 2)));
+inline void CheckLogBinaryFormat(const char *format, ...)
+{
+}
+
+// Renders every message of the binary log read from |in| as text to
+// |out|. Returns false if |in| is not a binary log or is corrupt; a
+// truncated last message is silently ignored.
+bool DecodeBinaryLog(FILE *in, FILE *out);
+
+}  // namespace base_logging
+
+// Writes messages in binary form, along with the definition of each site
+// the first time one of its messages is written. Text messages logged
+// from ordinary LOG_*() statements are stored as they are. Buffered like
+// LogDestinationToFile.
+class LogDestinationToBinaryFile : public LogDestination {
+public:
+    explicit LogDestinationToBinaryFile(const std::string &name);
+    ~LogDestinationToBinaryFile();
+    virtual void Log(LogSeverity severity, time_t timestamp,
+                     const char* message, size_t len);
+    virtual void LogBinary(const LogBinarySite *site, int64 timestamp_us,
+                           const char *args, size_t len);
+    virtual void Flush();
+    virtual void CrashWrite(LogSeverity severity, time_t timestamp,
+                            const char* message, size_t len);
+    virtual void CrashFlush();
+    virtual std::string Describe() const;
+private:
+    bool OpenUnLocked();
+    void AppendUnLocked(const void *data, size_t len);
+    void FlushUnLocked();
+    void MaybeFlushUnLocked(LogSeverity severity, int64 timestamp_us);
+
+    Mutex lock_;
+    std::string filename_;
+    char *buffer_;
+    size_t buffer_size_;
+    size_t buffer_used_;
+    // Messages that ended in buffer_, counted as dropped if it is lost
+    size_t buffer_messages_;
+    int64 next_flush_time_us_;
+    // Ids of the sites whose definition has been written
+    std::vector<bool> sites_written_;
+    DISALLOW_COPY_AND_ASSIGN(LogDestinationToBinaryFile);
+};
+
+#define LOG_BINARY(MODULE, SEVERITY, FORMAT, ...)                       \
+    do {                                                                \
+        if (PREDICT_BRANCH_NOT_TAKEN(LOG_IS_ON(MODULE, SEVERITY)) &&    \
+            (MODULE)->WithinBudget(SEVERITY)) {                         \
+            static LogBinarySite log_binary_site = {                    \
+                __FILE__, __LINE__, SEVERITY, FORMAT, NULL, NULL, {0} }; \
+            if (false) {                                                \
+                base_logging::CheckLogBinaryFormat(FORMAT, ##__VA_ARGS__); \
+            }                                                           \
+            base_logging::LogBinary(MODULE, &log_binary_site, ##__VA_ARGS__); \
+        }                                                               \
+    } while (0)
+
+#define LOG_DEBUG_BIN(...) LOG_BINARY(THIS_MODULE, kLS_DEBUG, __VA_ARGS__)
+#define LOG_INFO_BIN(...) LOG_BINARY(THIS_MODULE, kLS_INFO, __VA_ARGS__)
+#define LOG_WARN_BIN(...) LOG_BINARY(THIS_MODULE, kLS_WARNING, __VA_ARGS__)
+#define LOG_ERR_BIN(...) LOG_BINARY(THIS_MODULE, kLS_ERR, __VA_ARGS__)
+
+#endif  // BASE_LOGGING_LOG_BINARY_HH_
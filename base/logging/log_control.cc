@@ -0,0 +1,214 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/logging/log_control.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <sstream>
+
+#include "base/logging/logging.hh"
+#include "base/threading/thread.hh"
+
+namespace {
+
+int control_pipe[2] = { -1, -1 };
+
+void WakeControlThread(int signo)
+{
+    const int saved_errno = errno;
+    const char c = 0;
+    if (write(control_pipe[1], &c, 1) < 0) {
+        // The pipe is full, so the thread is going to wake up anyway.
+    }
+    errno = saved_errno;
+}
+
+bool ParseSeverity(const std::string &name, LogSeverity *severity)
+{
+    for (int i = 0; i < kLS_MAX; ++i) {
+        if (strcasecmp(name.c_str(),
+                       GetLogSeverityName(static_cast<LogSeverity>(i))) == 0) {
+            *severity = static_cast<LogSeverity>(i);
+            return true;
+        }
+    }
+    if (strcasecmp(name.c_str(), "error") == 0) {
+        *severity = kLS_ERR;
+        return true;
+    }
+    if (strcasecmp(name.c_str(), "warn") == 0) {
+        *severity = kLS_WARNING;
+        return true;
+    }
+    return false;
+}
+
+// Applies "<pattern> [severity=<name>] [vlog=<n>]".
+void ApplyControlLine(const std::string &line)
+{
+    std::istringstream in(line.substr(0, line.find('#')));
+    std::string pattern;
+    if (!(in >> pattern)) {
+        return;
+    }
+    bool set_severity = false;
+    LogSeverity severity = kLS_INFO;
+    bool set_vlog = false;
+    int vlog = 0;
+    std::string setting;
+    while (in >> setting) {
+        const size_t eq = setting.find('=');
+        const std::string key = setting.substr(0, eq);
+        const std::string value = eq == std::string::npos ? "" :
+                setting.substr(eq + 1);
+        if (key == "severity") {
+            if (!ParseSeverity(value, &severity)) {
+                return;
+            }
+            set_severity = true;
+        } else if (key == "vlog") {
+            char *end;
+            vlog = strtol(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0') {
+                return;
+            }
+            set_vlog = true;
+        } else {
+            return;
+        }
+    }
+    if (set_severity) {
+        LogSetModuleSeverity(pattern, severity);
+    }
+    if (set_vlog) {
+        LogSetModuleVlog(pattern, vlog);
+    }
+}
+
+class LogControlThread : public base::Thread {
+public:
+    LogControlThread(const std::string &path)
+            : base::Thread("log_control"), path_(path), quit_(false) {
+    }
+    virtual ~LogControlThread() {
+        Quit();
+        Stop();
+    }
+
+protected:
+    // Sleeps on the pipe until a signal or Quit() writes to it.
+    virtual void Run() {
+        for (;;) {
+            struct pollfd pfd = { control_pipe[0], POLLIN, 0 };
+            if (poll(&pfd, 1, -1) <= 0) {
+                continue;
+            }
+            char buf[64];
+            while (read(control_pipe[0], buf, sizeof(buf)) > 0) {
+            }
+            if (quit_.load(std::memory_order_acquire)) {
+                return;
+            }
+            LogApplyControlFile(path_);
+        }
+    }
+
+private:
+    void Quit() {
+        quit_.store(true, std::memory_order_release);
+        WakeControlThread(0);
+    }
+
+    const std::string path_;
+    std::atomic<bool> quit_;
+    DISALLOW_COPY_AND_ASSIGN(LogControlThread);
+};
+
+Mutex control_lock;
+LogControlThread *control_thread = NULL;
+int control_signo = 0;
+struct sigaction saved_action;
+
+}  // namespace
+
+bool LogApplyControlFile(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == NULL) {
+        return false;
+    }
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), file) != NULL) {
+        ApplyControlLine(buf);
+    }
+    fclose(file);
+    return true;
+}
+
+bool StartLogControl(const std::string &path, int signo)
+{
+    MutexLock l(control_lock);
+    if (control_thread != NULL) {
+        return false;
+    }
+    if (pipe2(control_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        return false;
+    }
+    LogApplyControlFile(path);
+    control_thread = new LogControlThread(path);
+    if (!control_thread->Start()) {
+        delete control_thread;
+        control_thread = NULL;
+        close(control_pipe[0]);
+        close(control_pipe[1]);
+        return false;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = WakeControlThread;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(signo, &action, &saved_action);
+    control_signo = signo;
+    return true;
+}
+
+void StopLogControl()
+{
+    MutexLock l(control_lock);
+    if (control_thread == NULL) {
+        return;
+    }
+    sigaction(control_signo, &saved_action, NULL);
+    delete control_thread;
+    control_thread = NULL;
+    close(control_pipe[0]);
+    close(control_pipe[1]);
+    control_pipe[0] = control_pipe[1] = -1;
+}
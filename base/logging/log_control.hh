@@ -0,0 +1,44 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_LOGGING_LOG_CONTROL_HH_
+#define BASE_LOGGING_LOG_CONTROL_HH_
+
+#include <signal.h>
+
+#include <string>
+
+// Lets an operator change module levels on a live process. The control
+// file at |path| is applied now, and again every time the process gets
+// |signo|. Each line of the file reads
+//   <module pattern> [severity=<fatal|err|warning|info|debug>] [vlog=<n>]
+// e.g. "net_* severity=debug vlog=2", and is handed to
+// LogSetModuleSeverity() and LogSetModuleVlog(); '#' starts a comment.
+// The signal handler only writes to a pipe; a control thread does the
+// rest. Statements below LOG_MIN_SEVERITY are compiled out and stay off
+// whatever the file says; see logging.hh.
+bool StartLogControl(const std::string &path, int signo = SIGHUP);
+void StopLogControl();
+
+// Applies the control file at |path| once. Lines that do not parse are
+// skipped. Returns false if the file can not be read.
+bool LogApplyControlFile(const std::string &path);
+
+#endif  // BASE_LOGGING_LOG_CONTROL_HH_
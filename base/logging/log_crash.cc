@@ -0,0 +1,219 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/logging/log_crash.hh"
+
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "base/logging/async_log.hh"
+#include "base/logging/logging.hh"
+
+namespace {
+
+struct FailureSignal {
+    int signo;
+    const char *name;
+};
+const FailureSignal kFailureSignals[] = {
+    { SIGSEGV, "SIGSEGV" },
+    { SIGABRT, "SIGABRT" },
+    { SIGBUS, "SIGBUS" },
+    { SIGILL, "SIGILL" },
+    { SIGFPE, "SIGFPE" },
+};
+
+const int kMaxStackFrames = 64;
+
+// The alternate stack belongs to the first thread that installs the
+// handler; sharing it between threads would not be safe.
+const size_t kAltStackSize = 64 * 1024;
+char alt_stack[kAltStackSize];
+std::atomic<bool> alt_stack_taken(false);
+
+// The thread reporting a failure, 0 while there is none.
+std::atomic<pid_t> crashing_tid(0);
+
+// Formats one line of the report in place: snprintf() is not
+// async-signal-safe.
+class CrashLine {
+public:
+    CrashLine() : len_(0) {
+    }
+    CrashLine& operator<<(const char *s) {
+        while (*s != '\0' && len_ < sizeof(buf_)) {
+            buf_[len_++] = *s++;
+        }
+        return *this;
+    }
+    CrashLine& operator<<(uint64 n) {
+        char digits[20];
+        int i = 0;
+        do {
+            digits[i++] = static_cast<char>('0' + n % 10);
+            n /= 10;
+        } while (n != 0);
+        while (i > 0 && len_ < sizeof(buf_)) {
+            buf_[len_++] = digits[--i];
+        }
+        return *this;
+    }
+    CrashLine& operator<<(const void *p) {
+        uintptr_t value = reinterpret_cast<uintptr_t>(p);
+        *this << "0x";
+        int shift = 0;
+        while (shift + 4 < static_cast<int>(8 * sizeof(value)) &&
+               (value >> (shift + 4)) != 0) {
+            shift += 4;
+        }
+        for (; shift >= 0 && len_ < sizeof(buf_); shift -= 4) {
+            buf_[len_++] = "0123456789abcdef"[(value >> shift) & 0xf];
+        }
+        return *this;
+    }
+    const char *data() const {
+        return buf_;
+    }
+    size_t size() const {
+        return len_;
+    }
+private:
+    char buf_[128];
+    size_t len_;
+};
+
+const char *SignalName(int signo)
+{
+    for (size_t i = 0; i < arraysize(kFailureSignals); ++i) {
+        if (kFailureSignals[i].signo == signo) {
+            return kFailureSignals[i].name;
+        }
+    }
+    return "signal";
+}
+
+// Lets |signo| do what it would have done without us. It is blocked while
+// its handler runs, so it is delivered once the handler returns.
+void RaiseDefault(int signo)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = SIG_DFL;
+    sigaction(signo, &action, NULL);
+    raise(signo);
+}
+
+void FailureSignalHandler(int signo, siginfo_t *info, void *context)
+{
+    const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    pid_t reporting = 0;
+    if (!crashing_tid.compare_exchange_strong(reporting, tid)) {
+        if (reporting != tid) {
+            // Another thread is reporting and is about to kill the process.
+            for (;;) {
+                sleep(1);
+            }
+        }
+        // We failed again while reporting: die without finishing.
+        RaiseDefault(signo);
+        return;
+    }
+
+    CrashLine header;
+    header << "*** " << SignalName(signo) << " (@" << info->si_addr
+           << ") received by PID " << static_cast<uint64>(getpid())
+           << " (TID " << static_cast<uint64>(tid) << "); stack trace: ***\n";
+    void *frames[kMaxStackFrames];
+    const int depth = backtrace(frames, kMaxStackFrames);
+    base_logging::CrashWriteFd(STDERR_FILENO, header.data(), header.size());
+    backtrace_symbols_fd(frames, depth, STDERR_FILENO);
+
+    // What was logged before the failure goes out before the report.
+    base_logging::CrashDrainRings();
+    LogDestination::CrashFlushAll();
+    const time_t now = time(NULL);
+    // Destinations writing to stderr already have the report.
+    LogDestination::CrashWriteAll(kLS_FATAL, now, header.data(),
+                                  header.size(), STDERR_FILENO);
+    for (int i = 0; i < depth; ++i) {
+        CrashLine frame;
+        frame << "    @ " << frames[i] << "\n";
+        LogDestination::CrashWriteAll(kLS_FATAL, now, frame.data(),
+                                      frame.size(), STDERR_FILENO);
+    }
+    RaiseDefault(signo);
+}
+
+}  // namespace
+
+namespace base_logging {
+
+void CrashWriteFd(int fd, const char *data, size_t len)
+{
+    const int saved_errno = errno;
+    while (len > 0) {
+        const ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+    errno = saved_errno;
+}
+
+}  // namespace base_logging
+
+void InstallFailureSignalHandler()
+{
+    // backtrace() allocates the first time it runs, as it loads libgcc.
+    void *frame;
+    backtrace(&frame, 1);
+
+    bool expected = false;
+    if (alt_stack_taken.compare_exchange_strong(expected, true)) {
+        stack_t stack;
+        memset(&stack, 0, sizeof(stack));
+        stack.ss_sp = alt_stack;
+        stack.ss_size = sizeof(alt_stack);
+        sigaltstack(&stack, NULL);
+    }
+    // Threads without an alternate stack run the handler on their own.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    action.sa_sigaction = FailureSignalHandler;
+    for (size_t i = 0; i < arraysize(kFailureSignals); ++i) {
+        sigaction(kFailureSignals[i].signo, &action, NULL);
+    }
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_LOGGING_LOG_CRASH_HH_
+#define BASE_LOGGING_LOG_CRASH_HH_
+
+#include <stddef.h>
+
+// Installs a handler for SIGSEGV, SIGABRT, SIGBUS, SIGILL and SIGFPE that
+// writes the signal and a stack trace to stderr and to every destination,
+// writes out the messages still queued for the async writer and whatever
+// the destinations have buffered, and then lets the signal kill the
+// process as it would have. In the first thread to call this, the handler
+// runs on an alternate stack, so a stack overflow there is reported too.
+// It only makes async-signal-safe calls; destination locks are not taken,
+// so output may interleave with a thread that was logging when the
+// process crashed.
+void InstallFailureSignalHandler();
+
+namespace base_logging {
+
+// write(2)s all of |len| bytes to |fd|, retrying on EINTR.
+// Async-signal-safe.
+void CrashWriteFd(int fd, const char *data, size_t len);
+
+}  // namespace base_logging
+
+#endif  // BASE_LOGGING_LOG_CRASH_HH_
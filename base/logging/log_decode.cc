@@ -0,0 +1,51 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Renders binary logs written by LogDestinationToBinaryFile as text.
+//
+//   log_decode [FILE...]
+//
+// Reads standard input if no file is given.
+
+#include <stdio.h>
+
+#include "base/logging/log_binary.hh"
+
+int main(int argc, char **argv)
+{
+    if (argc == 1) {
+        return base_logging::DecodeBinaryLog(stdin, stdout) ? 0 : 1;
+    }
+    int ret = 0;
+    for (int i = 1; i < argc; ++i) {
+        FILE *in = fopen(argv[i], "rb");
+        if (in == NULL) {
+            perror(argv[i]);
+            ret = 1;
+            continue;
+        }
+        if (!base_logging::DecodeBinaryLog(in, stdout)) {
+            fprintf(stderr, "%s: not a binary log or corrupt\n", argv[i]);
+            ret = 1;
+        }
+        fclose(in);
+    }
+    return ret;
+}
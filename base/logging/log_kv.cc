@@ -0,0 +1,206 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/logging/log_kv.hh"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+
+namespace {
+
+std::atomic<int> kv_format(kLOG_KV_LOGFMT);
+
+// Ends a record cut short; each field that fits leaves room for it.
+const char kTruncatedLogfmt[] = " truncated=true";
+const char kTruncatedJson[] = ",\"truncated\":true}";
+const size_t kTruncatedFieldLen = sizeof(kTruncatedJson) - 1;
+
+// True if |c| may appear in a logfmt key, or in a value without quotes.
+bool IsLogfmtBareChar(unsigned char c)
+{
+    return c > ' ' && c != '=' && c != '"' && c != '\\' && c != 0x7f;
+}
+
+// True if a logfmt value has to be quoted.
+bool NeedsQuotes(const base::StringPiece &s)
+{
+    if (s.empty()) {
+        return true;
+    }
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (!IsLogfmtBareChar(static_cast<unsigned char>(s[i]))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+void SetLogKVFormat(LogKVFormat format)
+{
+    kv_format.store(format, std::memory_order_relaxed);
+}
+
+LogKVFormat GetLogKVFormat()
+{
+    return static_cast<LogKVFormat>(
+            kv_format.load(std::memory_order_relaxed));
+}
+
+namespace base_logging {
+
+LogKVEncoder::LogKVEncoder(LogMessage::LogStream &stream, const char *event)
+        : stream_(stream), format_(GetLogKVFormat()),
+          start_(stream.pcount()), end_(stream.pcount())
+{
+    stream_ << (format_ == kLOG_KV_JSON ? "{\"event\":" : "event=");
+    Value(event);
+    EndField();
+}
+
+void LogKVEncoder::EndField()
+{
+    if (!stream_.truncated() && stream_.available() >= kTruncatedFieldLen) {
+        end_ = stream_.pcount();
+    }
+}
+
+void LogKVEncoder::End()
+{
+    if (stream_.truncated()) {
+        // Drop the field that was cut short, and any after it.
+        stream_.Rewind(end_);
+        const char *field = format_ == kLOG_KV_JSON ? kTruncatedJson :
+                kTruncatedLogfmt;
+        if (end_ == start_) {
+            // Not even the event fit.
+            if (format_ == kLOG_KV_JSON) {
+                stream_ << '{';
+            }
+            ++field;
+        }
+        stream_ << field;
+        return;
+    }
+    if (format_ == kLOG_KV_JSON) {
+        stream_ << '}';
+    }
+}
+
+void LogKVEncoder::Key(const char *key)
+{
+    const base::StringPiece name(key != NULL ? key : "");
+    if (format_ == kLOG_KV_JSON) {
+        stream_ << ',';
+        String(name);
+        stream_ << ':';
+        return;
+    }
+    stream_ << ' ';
+    if (name.empty()) {
+        stream_ << '_';
+    }
+    size_t start = 0;
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (!IsLogfmtBareChar(static_cast<unsigned char>(name[i]))) {
+            stream_ << name.substr(start, i - start) << '_';
+            start = i + 1;
+        }
+    }
+    stream_ << name.substr(start) << '=';
+}
+
+// Writes |s| quoted, escaping what has to be, or as it is if it is a
+// logfmt value that does not need quotes. Runs of ordinary characters go
+// into the stream in one piece.
+void LogKVEncoder::String(const base::StringPiece &s)
+{
+    if (format_ == kLOG_KV_LOGFMT && !NeedsQuotes(s)) {
+        stream_ << s;
+        return;
+    }
+    stream_ << '"';
+    size_t start = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(s[i]);
+        const char *escape = NULL;
+        char hex[8];
+        switch (c) {
+        case '"': escape = "\\\""; break;
+        case '\\': escape = "\\\\"; break;
+        case '\n': escape = "\\n"; break;
+        case '\r': escape = "\\r"; break;
+        case '\t': escape = "\\t"; break;
+        default:
+            if (c < 0x20) {
+                snprintf(hex, sizeof(hex), "\\u%04x", c);
+                escape = hex;
+            }
+            break;
+        }
+        if (escape != NULL) {
+            stream_ << s.substr(start, i - start) << escape;
+            start = i + 1;
+        }
+    }
+    stream_ << s.substr(start) << '"';
+}
+
+void LogKVEncoder::Value(bool value)
+{
+    stream_ << (value ? "true" : "false");
+}
+
+// NULL is null in JSON and an empty value in logfmt.
+void LogKVEncoder::Value(const char *value)
+{
+    if (value != NULL) {
+        String(value);
+    } else if (format_ == kLOG_KV_JSON) {
+        stream_ << "null";
+    } else {
+        stream_ << "\"\"";
+    }
+}
+
+// Printed with the fewest digits that read back as the same double, so
+// records can be parsed without losing precision. JSON has no NaN or
+// infinity.
+void LogKVEncoder::Double(double value)
+{
+    if (format_ == kLOG_KV_JSON && !isfinite(value)) {
+        stream_ << "null";
+        return;
+    }
+    char text[32];
+    for (int precision = 15; precision <= 17; ++precision) {
+        snprintf(text, sizeof(text), "%.*g", precision, value);
+        if (precision == 17 || strtod(text, NULL) == value) {
+            break;
+        }
+    }
+    stream_ << text;
+}
+
+}  // namespace base_logging
@@ -0,0 +1,177 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_LOGGING_LOG_KV_HH_
+#define BASE_LOGGING_LOG_KV_HH_
+
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+#include "base/basictypes.hh"
+#include "base/logging/logging.hh"
+#include "base/strings/string_piece.hh"
+
+// Structured log statements. The fields of
+//   LOG_INFO_KV("login", kv("user", id), kv("latency_us", t));
+// are encoded straight into the message buffer, after the usual prefix, as
+//   event=login user=42 latency_us=17
+// or, once SetLogKVFormat(kLOG_KV_JSON) has been called, as
+//   {"event":"login","user":42,"latency_us":17}
+// and the message is routed like any other. Integers, floating point
+// values, bools and strings are encoded without allocating; any other
+// type is formatted with its operator<<(std::ostream&) and encoded as a
+// string. logfmt values are only quoted when they have to be; characters
+// a logfmt key can not hold (spaces, '=', quotes and control characters)
+// are replaced with '_'. A record that does not fit in the message is cut
+// back to its last whole field and ends in a "truncated" field that is
+// true, so it still parses.
+enum LogKVFormat {
+    kLOG_KV_LOGFMT,
+    kLOG_KV_JSON,
+};
+void SetLogKVFormat(LogKVFormat format);
+LogKVFormat GetLogKVFormat();
+
+template <typename T>
+struct LogKVField {
+    const char *key;
+    const T &value;
+};
+
+// A field of a LOG_*_KV() statement. |value| is only referenced, so the
+// field must not outlive the statement.
+template <typename T>
+inline LogKVField<T> kv(const char *key, const T &value)
+{
+    LogKVField<T> field = { key, value };
+    return field;
+}
+
+namespace base_logging {
+
+// Writes one record into a message's stream.
+class LogKVEncoder {
+public:
+    LogKVEncoder(LogMessage::LogStream &stream, const char *event);
+
+    template <typename T>
+    void Add(const char *key, const T &value) {
+        Key(key);
+        Value(value);
+        EndField();
+    }
+    void End();
+
+private:
+    void Key(const char *key);
+    void EndField();
+    void String(const base::StringPiece &s);
+
+    void Value(bool value);
+    void Value(char value) {
+        String(base::StringPiece(&value, 1));
+    }
+    void Value(const char *value);
+    void Value(const std::string &value) {
+        String(value);
+    }
+    void Value(const base::StringPiece &value) {
+        String(value);
+    }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value &&
+                            std::is_signed<T>::value>::type
+    Value(T value) {
+        stream_ << static_cast<long long>(value);
+    }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value &&
+                            std::is_unsigned<T>::value>::type
+    Value(T value) {
+        stream_ << static_cast<unsigned long long>(value);
+    }
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type
+    Value(T value) {
+        Double(static_cast<double>(value));
+    }
+    template <typename T>
+    typename std::enable_if<!std::is_arithmetic<T>::value>::type
+    Value(const T &value) {
+        std::ostringstream text;
+        text << value;
+        String(text.str());
+    }
+    void Double(double value);
+
+    LogMessage::LogStream &stream_;
+    const LogKVFormat format_;
+    // Where the record starts in the message, and where its last field
+    // that leaves room to mark the record truncated ends.
+    const size_t start_;
+    size_t end_;
+    DISALLOW_COPY_AND_ASSIGN(LogKVEncoder);
+};
+
+inline void AddLogKVFields(LogKVEncoder *encoder)
+{
+}
+
+template <typename T, typename... Rest>
+inline void AddLogKVFields(LogKVEncoder *encoder,
+                           const LogKVField<T> &field, const Rest&... rest)
+{
+    encoder->Add(field.key, field.value);
+    AddLogKVFields(encoder, rest...);
+}
+
+template <typename... Fields>
+void EncodeLogKV(LogMessage::LogStream &stream, const char *event,
+                 const Fields&... fields)
+{
+    LogKVEncoder encoder(stream, event);
+    AddLogKVFields(&encoder, fields...);
+    encoder.End();
+}
+
+}  // namespace base_logging
+
+// Like LOG_MODULE_IF(), but the message is a record of EVENT and the
+// kv() fields that follow it; nothing can be streamed after them. The
+// fields are not evaluated for a disabled statement.
+#define LOG_MODULE_KV(MODULE, SEVERITY, EVENT, ...)                     \
+    !(PREDICT_BRANCH_NOT_TAKEN(LOG_IS_ON(MODULE, SEVERITY)) &&          \
+      (MODULE)->WithinBudget(SEVERITY))                                 \
+    ? (void) 0 : base_logging::EncodeLogKV(LOG_STREAM(MODULE, SEVERITY), \
+                                           EVENT, ##__VA_ARGS__)
+
+#define LOG_DEBUG_KV(EVENT, ...)                                        \
+    LOG_MODULE_KV(THIS_MODULE, kLS_DEBUG, EVENT, ##__VA_ARGS__)
+#define LOG_INFO_KV(EVENT, ...)                                         \
+    LOG_MODULE_KV(THIS_MODULE, kLS_INFO, EVENT, ##__VA_ARGS__)
+#define LOG_WARN_KV(EVENT, ...)                                         \
+    LOG_MODULE_KV(THIS_MODULE, kLS_WARNING, EVENT, ##__VA_ARGS__)
+#define LOG_ERR_KV(EVENT, ...)                                          \
+    LOG_MODULE_KV(THIS_MODULE, kLS_ERR, EVENT, ##__VA_ARGS__)
+#define LOG_FATAL_KV(EVENT, ...)                                        \
+    LOG_MODULE_KV(THIS_MODULE, kLS_FATAL, EVENT, ##__VA_ARGS__)
+
+#endif  // BASE_LOGGING_LOG_KV_HH_
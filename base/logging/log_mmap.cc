@@ -0,0 +1,544 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/logging/log_mmap.hh"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base/threading/thread.hh"
+
+namespace {
+
+const size_t kRecordAlignment = 8;
+
+size_t RecordSize(size_t len)
+{
+    return (sizeof(LogSegmentRecord) + len + kRecordAlignment - 1) &
+            ~(kRecordAlignment - 1);
+}
+
+// Fills in the record reserved at |at|, committing it last.
+void WriteRecord(char *at, const char *message, size_t len)
+{
+    LogSegmentRecord *record = reinterpret_cast<LogSegmentRecord*>(at);
+    record->len = static_cast<uint32>(len);
+    memcpy(const_cast<char*>(record->message()), message, len);
+    __atomic_store_n(&record->commit,
+                     kLogRecordCommitted ^ static_cast<uint32>(len),
+                     __ATOMIC_RELEASE);
+}
+
+std::string SegmentFileName(const std::string &base, uint64 sequence)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%06llu",
+             static_cast<unsigned long long>(sequence));
+    return base + suffix;
+}
+
+// Returns true and the sequence number of the newest segment of |base|
+// if there is one.
+bool NewestSegment(const std::string &base, uint64 *sequence)
+{
+    const size_t slash = base.rfind('/');
+    const std::string dir = slash == std::string::npos ? "." :
+            slash == 0 ? "/" : base.substr(0, slash);
+    const std::string prefix = (slash == std::string::npos ? base :
+                                base.substr(slash + 1)) + ".";
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL) {
+        return false;
+    }
+    bool found = false;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const std::string name = entry->d_name;
+        if (name.size() != prefix.size() + 6 ||
+            name.compare(0, prefix.size(), prefix) != 0 ||
+            name.find_first_not_of("0123456789", prefix.size()) !=
+            std::string::npos) {
+            continue;
+        }
+        const uint64 n = strtoull(name.c_str() + prefix.size(), NULL, 10);
+        if (!found || n > *sequence) {
+            *sequence = n;
+            found = true;
+        }
+    }
+    closedir(d);
+    return found;
+}
+
+// Maps all of |path|, returning NULL if it is empty or can not be mapped.
+char *MapWholeFile(const std::string &path, int flags, int *fd, size_t *size)
+{
+    *fd = open(path.c_str(), flags | O_CLOEXEC);
+    if (*fd == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(*fd, &st) != 0 || st.st_size == 0) {
+        *size = 0;
+        return NULL;
+    }
+    *size = static_cast<size_t>(st.st_size);
+    const int prot = (flags & O_ACCMODE) == O_RDONLY ? PROT_READ :
+            PROT_READ | PROT_WRITE;
+    void *base = mmap(NULL, *size, prot, MAP_SHARED, *fd, 0);
+    return base == MAP_FAILED ? NULL : static_cast<char*>(base);
+}
+
+}  // namespace
+
+struct LogDestinationToMmap::Segment {
+    enum State {
+        kFree,
+        kMapping,     // being mapped or unmapped by whoever claimed it
+        kReady,       // mapped, waiting to become current
+        kCurrent,
+        kRetiring,    // full; unmapped once the last writer leaves
+    };
+
+    Segment() : state(kFree), cursor(0), writers(0), sequence(0), fd(-1),
+                base(NULL), size(0) {
+    }
+
+    std::atomic<int> state;
+    std::atomic<uint64> cursor;
+    // Writers that may be copying into the mapping
+    std::atomic<int> writers;
+    uint64 sequence;
+    int fd;
+    char *base;
+    size_t size;
+};
+
+class LogDestinationToMmap::Mapper : public base::Thread {
+public:
+    explicit Mapper(LogDestinationToMmap *dst)
+            : base::Thread("log_mmap"), dst_(dst) {
+    }
+    virtual ~Mapper() {
+        Stop();
+    }
+
+protected:
+    virtual void Run() {
+        while (!stopping()) {
+            if (!dst_->PrepareSegments()) {
+                WaitForWork(base::TimeDelta::FromMilliseconds(kRetryMs));
+            }
+        }
+    }
+
+private:
+    // SwitchSegment() wakes us to map the next segment; until then we
+    // only look again for retiring segments whose writers have left, and
+    // to retry a segment that could not be mapped.
+    static const int kRetryMs = 10;
+    LogDestinationToMmap *dst_;
+    DISALLOW_COPY_AND_ASSIGN(Mapper);
+};
+
+LogDestinationToMmap::LogDestinationToMmap(const std::string &name,
+                                           size_t segment_size) :
+        base_filename_(name),
+        segment_size_(segment_size & ~(kRecordAlignment - 1)),
+        segments_(new Segment[kSegmentSlots]), current_(NULL),
+        stalled_sequence_(0), mapper_(NULL)
+{
+    type = kLOG_DST_MMAP;
+    uint64 sequence = 0;
+    if (NewestSegment(base_filename_, &sequence)) {
+        RecoverLogSegment(SegmentFileName(base_filename_, sequence), NULL);
+        ++sequence;
+    }
+    Segment *first = &segments_[sequence % kSegmentSlots];
+    if (MapSegment(first, sequence)) {
+        first->state.store(Segment::kCurrent);
+        current_.store(first);
+    } else {
+        stalled_sequence_.store(sequence);
+    }
+    mapper_ = new Mapper(this);
+    if (!mapper_->Start()) {
+        delete mapper_;
+        mapper_ = NULL;
+    }
+}
+
+LogDestinationToMmap::~LogDestinationToMmap()
+{
+    Unregister();
+    delete mapper_;
+    for (int i = 0; i < kSegmentSlots; ++i) {
+        Segment *segment = &segments_[i];
+        switch (segment->state.load()) {
+        case Segment::kCurrent:
+        case Segment::kRetiring:
+            UnmapSegment(segment);
+            break;
+        case Segment::kReady:
+            UnmapSegment(segment);
+            unlink(SegmentFileName(base_filename_,
+                                   segment->sequence).c_str());
+            break;
+        }
+    }
+    delete[] segments_;
+}
+
+void LogDestinationToMmap::Log(LogSeverity severity, time_t timestamp,
+                               const char* message, size_t len)
+{
+    const size_t size = RecordSize(len);
+    if (len == 0) {
+        return;
+    }
+    if (size > segment_size_) {
+        stats.dropped.Add(1);
+        stats.dropped_bytes.Add(len);
+        return;
+    }
+    for (;;) {
+        Segment *segment = current_.load();
+        if (segment == NULL) {
+            stats.dropped.Add(1);
+            stats.dropped_bytes.Add(len);
+            return;
+        }
+        // Announce ourselves before checking the segment is still
+        // current; see PrepareSegments().
+        segment->writers.fetch_add(1);
+        if (current_.load() != segment) {
+            segment->writers.fetch_sub(1);
+            continue;
+        }
+        const uint64 offset = segment->cursor.fetch_add(
+                size, std::memory_order_relaxed);
+        if (offset + size <= segment->size) {
+            WriteRecord(segment->base + offset, message, len);
+            segment->writers.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+        segment->writers.fetch_sub(1, std::memory_order_release);
+        if (offset <= segment->size) {
+            // Ours is the first reservation past the end; everyone else
+            // waits for us to move on to the next segment.
+            SwitchSegment(segment);
+        } else {
+            // The slot may already hold a later segment by the time we
+            // look, so wait for this one to stop being full rather than
+            // current.
+            while (current_.load() == segment &&
+                   segment->cursor.load(std::memory_order_relaxed) >
+                   segment->size) {
+                sched_yield();
+            }
+        }
+    }
+}
+
+// Like Log(), but never switches segments or waits for whoever does:
+// that could mean mapping a file, or spinning on a thread the crash
+// interrupted. A message that does not fit in the current segment is
+// dropped.
+void LogDestinationToMmap::CrashWrite(LogSeverity severity, time_t timestamp,
+                                      const char* message, size_t len)
+{
+    const size_t size = RecordSize(len);
+    Segment *segment = current_.load();
+    if (len == 0 || segment == NULL) {
+        return;
+    }
+    segment->writers.fetch_add(1);
+    if (current_.load() == segment) {
+        const uint64 offset = segment->cursor.fetch_add(size);
+        if (offset + size <= segment->size) {
+            WriteRecord(segment->base + offset, message, len);
+        }
+    }
+    segment->writers.fetch_sub(1);
+}
+
+// The mappings are shared, so the kernel keeps what was written when the
+// process dies; this only matters if the machine goes down with it.
+void LogDestinationToMmap::CrashFlush()
+{
+    Segment *segment = current_.load();
+    if (segment == NULL) {
+        return;
+    }
+    segment->writers.fetch_add(1);
+    if (current_.load() == segment) {
+        const uint64 used = std::min<uint64>(segment->cursor.load(),
+                                             segment->size);
+        msync(segment->base, used, MS_SYNC);
+    }
+    segment->writers.fetch_sub(1);
+}
+
+bool LogDestinationToMmap::MapSegment(Segment *segment, uint64 sequence)
+{
+    const std::string path = SegmentFileName(base_filename_, sequence);
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0664);
+    if (fd == -1) {
+        return false;
+    }
+    // Allocate the blocks now: a store to a hole the file system can not
+    // fill would raise SIGBUS in the writer.
+    void *base = MAP_FAILED;
+    if (posix_fallocate(fd, 0, segment_size_) == 0) {
+        base = mmap(NULL, segment_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, 0);
+    }
+    if (base == MAP_FAILED) {
+        close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+    segment->sequence = sequence;
+    segment->fd = fd;
+    segment->base = static_cast<char*>(base);
+    segment->size = segment_size_;
+    segment->cursor.store(0);
+    return true;
+}
+
+void LogDestinationToMmap::UnmapSegment(Segment *segment)
+{
+    const uint64 used = std::min<uint64>(segment->cursor.load(),
+                                         segment->size);
+    munmap(segment->base, segment->size);
+    // Should this fail, RecoverLogSegment() trims the unused tail later.
+    int ret = ftruncate(segment->fd, used);
+    (void)ret;
+    close(segment->fd);
+    segment->fd = -1;
+    segment->base = NULL;
+}
+
+bool LogDestinationToMmap::ClaimSegment(Segment *segment)
+{
+    int state = segment->state.load();
+    if (state == Segment::kFree) {
+        return segment->state.compare_exchange_strong(state,
+                                                      Segment::kMapping);
+    }
+    if (state != Segment::kRetiring || segment->writers.load() != 0 ||
+        !segment->state.compare_exchange_strong(state, Segment::kMapping)) {
+        return false;
+    }
+    UnmapSegment(segment);
+    return true;
+}
+
+void LogDestinationToMmap::SwitchSegment(Segment *full)
+{
+    const uint64 sequence = full->sequence + 1;
+    Segment *next = &segments_[sequence % kSegmentSlots];
+    for (;;) {
+        if (next->state.load(std::memory_order_acquire) == Segment::kReady) {
+            next->state.store(Segment::kCurrent);
+            break;
+        }
+        // The mapper thread is behind; map the segment ourselves.
+        if (ClaimSegment(next)) {
+            if (MapSegment(next, sequence)) {
+                next->state.store(Segment::kCurrent);
+                break;
+            }
+            next->state.store(Segment::kFree);
+            // Drop messages until the mapper thread manages to map it.
+            stalled_sequence_.store(sequence);
+            next = NULL;
+            break;
+        }
+        sched_yield();
+    }
+    current_.store(next);
+    full->state.store(Segment::kRetiring);
+    if (mapper_ != NULL) {
+        mapper_->Wake();
+    }
+}
+
+bool LogDestinationToMmap::PrepareSegments()
+{
+    bool busy = false;
+    // A retiring segment's writers were counted before it stopped being
+    // current, so once they are gone nobody else will touch the mapping.
+    for (int i = 0; i < kSegmentSlots; ++i) {
+        Segment *segment = &segments_[i];
+        if (segment->state.load() == Segment::kRetiring &&
+            ClaimSegment(segment)) {
+            segment->state.store(Segment::kFree);
+            busy = true;
+        }
+    }
+    Segment *current = current_.load();
+    const uint64 sequence = current != NULL ? current->sequence + 1 :
+            stalled_sequence_.load();
+    Segment *next = &segments_[sequence % kSegmentSlots];
+    if (ClaimSegment(next)) {
+        // |sequence| is stale if segments were switched meanwhile.
+        const bool stale = current != NULL ?
+                current_.load() != current ||
+                current->sequence + 1 != sequence :
+                current_.load() != NULL;
+        if (stale || !MapSegment(next, sequence)) {
+            next->state.store(Segment::kFree);
+            return busy;
+        }
+        if (current != NULL) {
+            next->state.store(Segment::kReady, std::memory_order_release);
+        } else {
+            next->state.store(Segment::kCurrent);
+            current_.store(next);
+        }
+        busy = true;
+    }
+    return busy;
+}
+
+namespace {
+
+bool IsWholeRecord(const char *base, size_t size, size_t offset)
+{
+    if (offset + sizeof(LogSegmentRecord) > size) {
+        return false;
+    }
+    const LogSegmentRecord *record =
+            reinterpret_cast<const LogSegmentRecord*>(base + offset);
+    return record->len != 0 && offset + RecordSize(record->len) <= size &&
+            record->commit == (kLogRecordCommitted ^ record->len);
+}
+
+// The offset of the first whole record at or after |offset|, or |size|.
+size_t FindWholeRecord(const char *base, size_t size, size_t offset)
+{
+    for (; offset < size; offset += kRecordAlignment) {
+        if (IsWholeRecord(base, size, offset)) {
+            return offset;
+        }
+    }
+    return size;
+}
+
+}  // namespace
+
+bool RecoverLogSegment(const std::string &path, uint64 *valid_bytes)
+{
+    int fd;
+    size_t size;
+    char *base = MapWholeFile(path, O_RDWR, &fd, &size);
+    if (fd == -1) {
+        return false;
+    }
+    uint64 valid = 0;
+    if (base != NULL) {
+        std::vector<LogSegmentRecord*> partial;
+        size_t offset = 0;
+        while (offset + sizeof(LogSegmentRecord) <= size) {
+            LogSegmentRecord *record =
+                    reinterpret_cast<LogSegmentRecord*>(base + offset);
+            // A zero length is space nobody reserved, or whose writer
+            // died between reserving it and writing the header. Other
+            // threads may have committed records after such a hole, so
+            // look for the next whole one and, if there is one, turn the
+            // hole into a skipped record that readers step over.
+            if (record->len == 0) {
+                const size_t next = FindWholeRecord(
+                        base, size, offset + RecordSize(1));
+                if (next == size) {
+                    break;
+                }
+                record->len = static_cast<uint32>(
+                        next - offset - sizeof(LogSegmentRecord));
+                record->commit = kLogRecordSkipped;
+                offset = next;
+                continue;
+            }
+            const size_t record_size = RecordSize(record->len);
+            if (offset + record_size > size) {
+                break;
+            }
+            offset += record_size;
+            if (record->commit == (kLogRecordCommitted ^ record->len)) {
+                valid = offset;
+            } else if (record->commit != kLogRecordSkipped) {
+                partial.push_back(record);
+            }
+        }
+        for (size_t i = 0; i < partial.size(); ++i) {
+            if (reinterpret_cast<char*>(partial[i]) - base <
+                static_cast<ssize_t>(valid)) {
+                partial[i]->commit = kLogRecordSkipped;
+            }
+        }
+        munmap(base, size);
+    }
+    const bool ok = size == valid || ftruncate(fd, valid) == 0;
+    close(fd);
+    if (valid_bytes != NULL) {
+        *valid_bytes = valid;
+    }
+    return ok;
+}
+
+bool PrintLogSegment(const std::string &path, FILE *out)
+{
+    int fd;
+    size_t size;
+    char *base = MapWholeFile(path, O_RDONLY, &fd, &size);
+    if (fd == -1) {
+        return false;
+    }
+    size_t offset = 0;
+    while (base != NULL && offset + sizeof(LogSegmentRecord) <= size) {
+        const LogSegmentRecord *record =
+                reinterpret_cast<const LogSegmentRecord*>(base + offset);
+        const size_t record_size = RecordSize(record->len);
+        if (record->len == 0 || offset + record_size > size) {
+            break;
+        }
+        if (record->commit == (kLogRecordCommitted ^ record->len)) {
+            fwrite(record->message(), 1, record->len, out);
+        }
+        offset += record_size;
+    }
+    if (base != NULL) {
+        munmap(base, size);
+    }
+    close(fd);
+    return true;
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_LOGGING_LOG_MMAP_HH_
+#define BASE_LOGGING_LOG_MMAP_HH_
+
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+
+#include "base/basictypes.hh"
+#include "base/logging/logging.hh"
+
+// Appends messages to memory-mapped segment files "<name>.NNNNNN" of a
+// fixed size. A writer reserves room with one atomic add on the segment's
+// cursor and copies its message in; no syscall and no lock is involved.
+// Since the mappings are shared, the kernel writes the pages out even if
+// the process crashes. A background thread maps the next segment ahead of
+// time and unmaps (and trims) full ones.
+//
+// Each record is a LogSegmentRecord header followed by the message and
+// padding up to 8 bytes. The header's commit word is stored last, so a
+// record without it was cut short by a crash; RecoverLogSegment() deals
+// with those. On construction, the newest existing segment of |name| is
+// recovered and numbering continues after it.
+class LogDestinationToMmap : public LogDestination {
+public:
+    static const size_t kDefaultSegmentSize = 64 << 20;
+
+    explicit LogDestinationToMmap(const std::string &name,
+                                  size_t segment_size = kDefaultSegmentSize);
+    ~LogDestinationToMmap();
+    virtual void Log(LogSeverity severity, time_t timestamp,
+                     const char* message, size_t len);
+    virtual void CrashWrite(LogSeverity severity, time_t timestamp,
+                            const char* message, size_t len);
+    virtual void CrashFlush();
+
+private:
+    struct Segment;
+    class Mapper;
+    friend class Mapper;
+
+    static const int kSegmentSlots = 4;
+
+    bool MapSegment(Segment *segment, uint64 sequence);
+    void UnmapSegment(Segment *segment);
+    // Takes a free segment, or a retiring one its writers have left, for
+    // (re)mapping.
+    bool ClaimSegment(Segment *segment);
+    void SwitchSegment(Segment *full);
+    // Run by the mapper thread: unmaps retired segments and maps the
+    // next one. Returns false if there was nothing to do.
+    bool PrepareSegments();
+
+    std::string base_filename_;
+    size_t segment_size_;
+    // Segment n lives in segments_[n % kSegmentSlots]. The slots are
+    // never freed while logging, so a writer holding a stale pointer can
+    // always safely find out it is stale.
+    Segment *segments_;
+    // NULL while no segment could be mapped; messages are dropped until
+    // the mapper thread maps segment stalled_sequence_.
+    std::atomic<Segment*> current_;
+    std::atomic<uint64> stalled_sequence_;
+    Mapper *mapper_;
+    DISALLOW_COPY_AND_ASSIGN(LogDestinationToMmap);
+};
+
+struct LogSegmentRecord {
+    uint32 len;       // Message bytes following the header.
+    uint32 commit;    // kLogRecordCommitted ^ len once the record is whole.
+
+    const char *message() const {
+        return reinterpret_cast<const char*>(this + 1);
+    }
+};
+const uint32 kLogRecordCommitted = 0x4c4f4721;
+// Marks a record that was cut short but is followed by whole ones.
+const uint32 kLogRecordSkipped = 0xffffffff;
+
+// Makes the segment at |path| consistent after a crash: records cut short
+// at the end of the data are trimmed off, together with the unused
+// preallocated space, and ones cut short in the middle (by a thread that
+// died while others kept writing) are marked skipped. So is space reserved
+// by a thread that died before writing the record's header, if whole
+// records follow it. Stores the size of the remaining data in
+// |valid_bytes| if not NULL.
+bool RecoverLogSegment(const std::string &path, uint64 *valid_bytes);
+
+// Writes every whole record of the segment at |path| to |out|.
+bool PrintLogSegment(const std::string &path, FILE *out);
+
+#endif  // BASE_LOGGING_LOG_MMAP_HH_
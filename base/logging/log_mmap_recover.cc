@@ -0,0 +1,58 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Brings the segments left by LogDestinationToMmap into a consistent state
+// after a crash, and optionally prints them.
+//
+//   log_mmap_recover [-p] SEGMENT...
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "base/logging/log_mmap.hh"
+
+int main(int argc, char **argv)
+{
+    bool print = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "p")) != -1) {
+        if (opt != 'p') {
+            fprintf(stderr, "usage: %s [-p] SEGMENT...\n", argv[0]);
+            return 2;
+        }
+        print = true;
+    }
+    int ret = 0;
+    for (int i = optind; i < argc; ++i) {
+        uint64 valid_bytes;
+        if (!RecoverLogSegment(argv[i], &valid_bytes)) {
+            perror(argv[i]);
+            ret = 1;
+            continue;
+        }
+        if (print) {
+            PrintLogSegment(argv[i], stdout);
+        } else {
+            fprintf(stderr, "%s: %llu bytes\n", argv[i],
+                    static_cast<unsigned long long>(valid_bytes));
+        }
+    }
+    return ret;
+}
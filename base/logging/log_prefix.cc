@@ -0,0 +1,195 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/logging/log_prefix.hh"
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "base/threading/thread.hh"
+#include "base/time/time.hh"
+
+namespace base_logging {
+
+namespace {
+
+// Longest ":line] " that follows the file name.
+const size_t kMaxLineSuffixLen = 13;
+
+// Pre-rendered "MMDD HH:MM:SS" for the second this thread last logged in.
+const size_t kDateTimeLen = 13;
+struct DateTimeCache {
+    time_t second;
+    char text[kDateTimeLen];
+};
+__thread DateTimeCache date_time_cache = { -1, { 0 } };
+
+inline char *WriteTwoDigits(char *p, int value)
+{
+    p[0] = static_cast<char>('0' + value / 10);
+    p[1] = static_cast<char>('0' + value % 10);
+    return p + 2;
+}
+
+// Writes |value| using exactly |width| digits, zero padded.
+inline char *WriteZeroPadded(char *p, uint32 value, int width)
+{
+    for (int i = width - 1; i >= 0; --i) {
+        p[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    return p + width;
+}
+
+// Writes |value| right-aligned in at least |width| columns, space padded.
+inline char *WriteSpacePadded(char *p, uint32 value, int width)
+{
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    for (int i = n; i < width; ++i) {
+        *p++ = ' ';
+    }
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+const char *DateTime(time_t second)
+{
+    DateTimeCache &cache = date_time_cache;
+    if (PREDICT_FALSE(cache.second != second)) {
+        struct ::tm tm_time;
+        localtime_r(&second, &tm_time);
+        char *p = cache.text;
+        p = WriteTwoDigits(p, 1 + tm_time.tm_mon);
+        p = WriteTwoDigits(p, tm_time.tm_mday);
+        *p++ = ' ';
+        p = WriteTwoDigits(p, tm_time.tm_hour);
+        *p++ = ':';
+        p = WriteTwoDigits(p, tm_time.tm_min);
+        *p++ = ':';
+        WriteTwoDigits(p, tm_time.tm_sec);
+        cache.second = second;
+    }
+    return cache.text;
+}
+
+// The calling thread's tag; tid 0 means it has not been rendered yet.
+__thread LogThreadTag current_thread_tag = { 0, 0, { 0 } };
+
+pthread_once_t thread_tag_once = PTHREAD_ONCE_INIT;
+
+// A forked child keeps the parent's thread-local values but runs under a
+// new tid, so it has to render its tag again.
+void ResetThreadTagInChild()
+{
+    current_thread_tag.tid = 0;
+}
+
+void RegisterThreadTagAtFork()
+{
+    pthread_atfork(NULL, NULL, ResetThreadTagInChild);
+}
+
+}  // namespace
+
+void LogThreadTag::Set(pid_t new_tid, const char *name)
+{
+    tid = new_tid;
+    char *p = WriteSpacePadded(text, static_cast<uint32>(new_tid), 5);
+    *p++ = ' ';
+    size_t name_len = 0;
+    if (name != NULL) {
+        for (; name[name_len] != '\0' && name_len < kMaxNameLen; ++name_len) {
+            const char c = name[name_len];
+            // Keep the prefix splittable on spaces.
+            p[name_len] = (c == ' ' || c == '\t' || c == '\n') ? '_' : c;
+        }
+    }
+    if (name_len == 0) {
+        p[name_len++] = '-';
+    }
+    len = p + name_len - text;
+}
+
+const LogThreadTag &CurrentLogThreadTag()
+{
+    LogThreadTag &tag = current_thread_tag;
+    if (PREDICT_FALSE(tag.tid == 0)) {
+        pthread_once(&thread_tag_once, RegisterThreadTagAtFork);
+        char name[LogThreadTag::kMaxNameLen + 1] = { 0 };
+        base::Thread *thread = base::Thread::Current();
+        if (thread != NULL) {
+            strncpy(name, thread->ThreadName().c_str(), sizeof(name) - 1);
+        } else if (pthread_getname_np(pthread_self(), name,
+                                      sizeof(name)) != 0) {
+            name[0] = '\0';
+        }
+        tag.Set(static_cast<pid_t>(syscall(SYS_gettid)), name);
+    }
+    return tag;
+}
+
+// static function
+size_t LogPrefixFormatter::Format(char *buf, size_t size,
+                                  LogSeverity severity, int64 now_us,
+                                  const LogThreadTag &thread,
+                                  const char *file, int line)
+{
+    if (size < kMaxPrefixLen) {
+        return 0;
+    }
+    const time_t second = static_cast<time_t>(
+            now_us / base::kMicrosecondsPerSecond);
+    const uint32 usecs = static_cast<uint32>(
+            now_us % base::kMicrosecondsPerSecond);
+    char *p = buf;
+    *p++ = GetLogSeverityName(severity)[0];
+    memcpy(p, DateTime(second), kDateTimeLen);
+    p += kDateTimeLen;
+    *p++ = ':';
+    p = WriteZeroPadded(p, usecs, 6);
+    *p++ = ' ';
+    memcpy(p, thread.text, thread.len);
+    p += thread.len;
+    *p++ = ' ';
+    size_t file_len = strlen(file);
+    const size_t room = size - (p - buf) - kMaxLineSuffixLen;
+    if (file_len > room) {
+        file_len = room;
+    }
+    memcpy(p, file, file_len);
+    p += file_len;
+    *p++ = ':';
+    p = WriteSpacePadded(p, static_cast<uint32>(line), 0);
+    *p++ = ']';
+    *p++ = ' ';
+    return p - buf;
+}
+
+}  // namespace base_logging
@@ -0,0 +1,71 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_LOGGING_LOG_PREFIX_HH_
+#define BASE_LOGGING_LOG_PREFIX_HH_
+
+#include <sys/types.h>
+
+#include "base/basictypes.hh"
+#include "base/logging/logging.hh"
+
+namespace base_logging {
+
+// The "ttttt name" part of the prefix: the kernel thread id, space padded
+// to five columns, followed by a short thread name ("-" if unknown).
+struct LogThreadTag {
+    // Linux limits thread names to 15 characters.
+    static const size_t kMaxNameLen = 15;
+    static const size_t kMaxLen = 10 + 1 + kMaxNameLen;
+
+    // Renders |tid| and |name| into text; |name| may be NULL.
+    void Set(pid_t tid, const char *name);
+
+    pid_t tid;
+    size_t len;
+    char text[kMaxLen];
+};
+
+// Returns the tag of the calling thread. It is rendered the first time a
+// thread asks for it, using the name of its base::Thread or, failing that,
+// the name set with pthread_setname_np(), and reused from then on.
+const LogThreadTag &CurrentLogThreadTag();
+
+// Writes the prefix of a log line,
+//   "<S>MMDD HH:MM:SS:uuuuuu ttttt name file:line] "
+// without going through iostreams. The "MMDD HH:MM:SS" part only changes
+// once a second, so each thread keeps it pre-rendered and only calls
+// localtime_r() when the second changes.
+class LogPrefixFormatter {
+public:
+    // Longest prefix, not counting the file name.
+    static const size_t kMaxPrefixLen = 64;
+
+    // Formats the prefix for a message logged at |now_us| (microseconds
+    // since the epoch) into |buf|, writing at most |size| bytes, and
+    // returns the number of bytes written. The prefix is not terminated.
+    static size_t Format(char *buf, size_t size, LogSeverity severity,
+                         int64 now_us, const LogThreadTag &thread,
+                         const char *file, int line);
+};
+
+}  // namespace base_logging
+
+#endif  // BASE_LOGGING_LOG_PREFIX_HH_
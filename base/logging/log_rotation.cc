@@ -0,0 +1,289 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/logging/log_rotation.hh"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <list>
+#include <vector>
+
+#include "base/logging/logging.hh"
+#include "base/threading/thread.hh"
+
+namespace base_logging {
+
+namespace {
+
+const char kCompressedSuffix[] = ".gz";
+
+std::string DirName(const std::string &path)
+{
+    const size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+std::string BaseName(const std::string &path)
+{
+    const size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool AllDigits(const std::string &s, size_t pos, size_t len)
+{
+    if (pos + len > s.size()) {
+        return false;
+    }
+    for (size_t i = pos; i < pos + len; ++i) {
+        if (s[i] < '0' || s[i] > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True for names produced by RolledLogFileName(|base|, ...), compressed
+// or not.
+bool IsRolledLogFileName(const std::string &name, const std::string &base)
+{
+    // "<base>." "YYYYMMDD" "-" "HHMMSS" "." "NNNN"
+    const size_t prefix = base.size() + 1;
+    if (name.compare(0, base.size(), base) != 0 || name.size() < prefix ||
+        name[base.size()] != '.') {
+        return false;
+    }
+    if (!AllDigits(name, prefix, 8) || name[prefix + 8] != '-' ||
+        !AllDigits(name, prefix + 9, 6) || name[prefix + 15] != '.' ||
+        !AllDigits(name, prefix + 16, 4)) {
+        return false;
+    }
+    const std::string rest = name.substr(prefix + 20);
+    return rest.empty() || rest == kCompressedSuffix;
+}
+
+// Replaces |path| with |path|.gz.
+void CompressLogFile(const std::string &path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+    const std::string compressed = path + kCompressedSuffix;
+    const std::string tmp = compressed + ".tmp";
+    gzFile out = gzopen(tmp.c_str(), "wb");
+    if (out == NULL) {
+        close(fd);
+        return;
+    }
+    char buf[64 * 1024];
+    ssize_t n;
+    bool ok = true;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ok = false;
+            break;
+        }
+        if (gzwrite(out, buf, static_cast<unsigned>(n)) != n) {
+            ok = false;
+            break;
+        }
+    }
+    close(fd);
+    if (gzclose(out) != Z_OK || !ok) {
+        unlink(tmp.c_str());
+        return;
+    }
+    if (rename(tmp.c_str(), compressed.c_str()) == 0) {
+        unlink(path.c_str());
+    }
+}
+
+// Atomically points |link_path| at |target|. A regular file already at
+// |link_path| is left alone rather than replaced.
+void UpdateLogLink(const std::string &link_path, const std::string &target)
+{
+    struct stat st;
+    if (lstat(link_path.c_str(), &st) == 0 && !S_ISLNK(st.st_mode)) {
+        return;
+    }
+    const std::string tmp = link_path + ".tmp";
+    unlink(tmp.c_str());
+    if (symlink(BaseName(target).c_str(), tmp.c_str()) != 0) {
+        return;
+    }
+    if (rename(tmp.c_str(), link_path.c_str()) != 0) {
+        unlink(tmp.c_str());
+    }
+}
+
+// Deletes all but the newest |keep| files rolled before |current_path|.
+// Files newer than it belong to jobs still queued behind this one.
+void PruneLogFiles(const std::string &link_path,
+                   const std::string &current_path, int keep)
+{
+    const std::string dir = DirName(link_path);
+    const std::string base = BaseName(link_path);
+    const std::string current = BaseName(current_path);
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL) {
+        return;
+    }
+    std::vector<std::string> rolled;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const std::string name = entry->d_name;
+        if (name < current && IsRolledLogFileName(name, base)) {
+            rolled.push_back(name);
+        }
+    }
+    closedir(d);
+    if (rolled.size() <= static_cast<size_t>(keep)) {
+        return;
+    }
+    std::sort(rolled.begin(), rolled.end());
+    for (size_t i = 0; i < rolled.size() - keep; ++i) {
+        unlink((dir + "/" + rolled[i]).c_str());
+    }
+}
+
+class LogRotationThread : public base::Thread {
+public:
+    LogRotationThread() : base::Thread("log_rotation") {
+    }
+    virtual ~LogRotationThread() {
+        Stop();
+    }
+    void Schedule(const LogRotationJob &job) {
+        {
+            MutexLock l(lock_);
+            jobs_.push_back(job);
+        }
+        Wake();
+    }
+
+protected:
+    // Only returns once asked to stop and out of work.
+    virtual void Run() {
+        for (;;) {
+            LogRotationJob job;
+            bool have_job = false;
+            {
+                MutexLock l(lock_);
+                if (!jobs_.empty()) {
+                    job = jobs_.front();
+                    jobs_.pop_front();
+                    have_job = true;
+                } else if (stopping()) {
+                    return;
+                }
+            }
+            if (have_job) {
+                RunLogRotationJob(job);
+            } else {
+                WaitForWork(base::TimeDelta::Max());
+            }
+        }
+    }
+
+private:
+    Mutex lock_;
+    std::list<LogRotationJob> jobs_;
+    DISALLOW_COPY_AND_ASSIGN(LogRotationThread);
+};
+
+Mutex rotation_thread_lock;
+LogRotationThread *rotation_thread = NULL;
+
+}  // namespace
+
+std::string RolledLogFileName(const std::string &base, time_t timestamp,
+                              uint32 sequence)
+{
+    struct ::tm tm_time;
+    localtime_r(&timestamp, &tm_time);
+    // Room for every field at its widest, not just for sane dates.
+    char suffix[80];
+    snprintf(suffix, sizeof(suffix), ".%04d%02d%02d-%02d%02d%02d.%04u",
+             1900 + tm_time.tm_year, 1 + tm_time.tm_mon, tm_time.tm_mday,
+             tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec,
+             sequence % 10000);
+    return base + suffix;
+}
+
+time_t NextLogRotationTime(time_t timestamp, int interval)
+{
+    struct ::tm tm_time;
+    localtime_r(&timestamp, &tm_time);
+    const time_t local = timestamp + tm_time.tm_gmtoff;
+    return (local / interval + 1) * interval - tm_time.tm_gmtoff;
+}
+
+void RunLogRotationJob(const LogRotationJob &job)
+{
+    if (job.rolled_fd != -1) {
+        close(job.rolled_fd);
+    }
+    if (!job.current_path.empty() && !job.link_path.empty()) {
+        UpdateLogLink(job.link_path, job.current_path);
+    }
+    if (!job.rolled_path.empty() && job.compress) {
+        CompressLogFile(job.rolled_path);
+    }
+    if (!job.link_path.empty()) {
+        PruneLogFiles(job.link_path, job.current_path, job.keep_generations);
+    }
+}
+
+void ScheduleLogRotation(const LogRotationJob &job)
+{
+    MutexLock l(rotation_thread_lock);
+    if (rotation_thread == NULL) {
+        rotation_thread = new LogRotationThread();
+        if (!rotation_thread->Start()) {
+            delete rotation_thread;
+            rotation_thread = NULL;
+            RunLogRotationJob(job);
+            return;
+        }
+    }
+    rotation_thread->Schedule(job);
+}
+
+void StopLogRotation()
+{
+    MutexLock l(rotation_thread_lock);
+    delete rotation_thread;
+    rotation_thread = NULL;
+}
+
+}  // namespace base_logging
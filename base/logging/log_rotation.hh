@@ -0,0 +1,66 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_LOGGING_LOG_ROTATION_HH_
+#define BASE_LOGGING_LOG_ROTATION_HH_
+
+#include <time.h>
+
+#include <string>
+
+#include "base/basictypes.hh"
+
+namespace base_logging {
+
+// Work left over after LogDestinationToFile has switched to a new file.
+// None of it is done on the logging path: the rotation thread closes the
+// rolled file, points link_path at the new one, compresses the rolled
+// file and deletes generations beyond keep_generations.
+struct LogRotationJob {
+    LogRotationJob() : rolled_fd(-1), keep_generations(0), compress(false) {
+    }
+    int rolled_fd;               // -1 if nothing was rolled
+    std::string rolled_path;
+    std::string current_path;
+    std::string link_path;
+    int keep_generations;
+    bool compress;
+};
+
+// Returns "<base>.YYYYMMDD-HHMMSS.NNNN", which sorts by creation time.
+std::string RolledLogFileName(const std::string &base, time_t timestamp,
+                              uint32 sequence);
+
+// Returns the first multiple of |interval| seconds of local time after
+// |timestamp|, e.g. the next full hour for 3600.
+time_t NextLogRotationTime(time_t timestamp, int interval);
+
+// Queues |job| for the rotation thread, starting the thread if needed.
+void ScheduleLogRotation(const LogRotationJob &job);
+
+// Finishes every queued job and stops the rotation thread.
+void StopLogRotation();
+
+// Does the work of |job| on the calling thread.
+void RunLogRotationJob(const LogRotationJob &job);
+
+}  // namespace base_logging
+
+#endif  // BASE_LOGGING_LOG_ROTATION_HH_
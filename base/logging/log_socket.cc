@@ -0,0 +1,266 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/logging/log_socket.hh"
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+
+const int kSyslogLevels[kLS_MAX] = {
+#define LOG_SEVERITY(NAME, SEVERITY) SEVERITY,
+    LOG_SEVERITYS
+#undef LOG_SEVERITY
+};
+
+// RFC 5424 limits on HOSTNAME and APP-NAME
+const size_t kMaxHostnameLen = 255;
+const size_t kMaxAppNameLen = 48;
+
+// Fills |addr| from "host:port" or a unix socket path. Returns the
+// address length, or 0 if |address| can not be resolved.
+socklen_t ResolveAddress(const std::string &address,
+                         struct sockaddr_storage *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    if (!address.empty() && address[0] == '/') {
+        struct sockaddr_un *un = reinterpret_cast<struct sockaddr_un*>(addr);
+        if (address.size() >= sizeof(un->sun_path)) {
+            return 0;
+        }
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, address.c_str(), address.size() + 1);
+        return sizeof(*un);
+    }
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        return 0;
+    }
+    std::string host = address.substr(0, colon);
+    if (host.size() > 2 && host[0] == '[' && host[host.size() - 1] == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICSERV;
+    struct addrinfo *result;
+    if (getaddrinfo(host.c_str(), address.c_str() + colon + 1, &hints,
+                    &result) != 0) {
+        return 0;
+    }
+    socklen_t len = 0;
+    if (result->ai_addrlen <= sizeof(*addr)) {
+        memcpy(addr, result->ai_addr, result->ai_addrlen);
+        len = result->ai_addrlen;
+    }
+    freeaddrinfo(result);
+    return len;
+}
+
+// RFC 5424 header fields are printable US-ASCII without spaces, at most
+// |max_len| characters long, and "-" when there is nothing to say.
+std::string SyslogHeaderField(const char *value, size_t max_len)
+{
+    std::string field;
+    for (const char *p = value; *p != '\0' && field.size() < max_len; ++p) {
+        if (*p >= 33 && *p <= 126) {
+            field.push_back(*p);
+        }
+    }
+    return field.empty() ? "-" : field;
+}
+
+}  // namespace
+
+const size_t LogDestinationToSocket::kMaxFrameLen;
+const int LogDestinationToSocket::kBatchSize;
+
+LogDestinationToSocket::LogDestinationToSocket(const std::string &address)
+        : address_(address)
+{
+    type = kLOG_DST_SOCK;
+    Init();
+}
+
+LogDestinationToSocket::LogDestinationToSocket(const std::string &address,
+                                               Log_Destination type)
+        : address_(address)
+{
+    this->type = type;
+    Init();
+}
+
+void LogDestinationToSocket::Init()
+{
+    addr_len_ = ResolveAddress(address_, &addr_);
+    next_open_time_ = 0;
+    timestamp_ = -1;
+    timestamp_text_[0] = '\0';
+    n_queued_ = 0;
+
+    char host[256];
+    if (gethostname(host, sizeof(host)) != 0) {
+        strcpy(host, "-");
+    }
+    host[sizeof(host) - 1] = '\0';
+    char pid[16];
+    snprintf(pid, sizeof(pid), "%d", static_cast<int>(getpid()));
+    header_suffix_ = SyslogHeaderField(host, kMaxHostnameLen) + " " +
+            SyslogHeaderField(program_invocation_short_name,
+                              kMaxAppNameLen) +
+            " " + pid + " - - ";
+
+    frames_ = static_cast<char*>(malloc(kBatchSize * kMaxFrameLen));
+    memset(msgs_, 0, sizeof(msgs_));
+    for (int i = 0; i < kBatchSize; ++i) {
+        iovs_[i].iov_base = frames_ + i * kMaxFrameLen;
+        iovs_[i].iov_len = 0;
+        msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+LogDestinationToSocket::~LogDestinationToSocket()
+{
+    Unregister();
+    Flush();
+    if (log_fd_ != -1) {
+        close(log_fd_);
+    }
+    free(frames_);
+}
+
+bool LogDestinationToSocket::OpenUnLocked(time_t timestamp)
+{
+    if (addr_len_ == 0 || frames_ == NULL || timestamp < next_open_time_) {
+        return false;
+    }
+    log_fd_ = socket(addr_.ss_family,
+                     SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (log_fd_ != -1 &&
+        connect(log_fd_, reinterpret_cast<struct sockaddr*>(&addr_),
+                addr_len_) != 0) {
+        close(log_fd_);
+        log_fd_ = -1;
+    }
+    if (log_fd_ == -1) {
+        next_open_time_ = timestamp + 1;
+        return false;
+    }
+    return true;
+}
+
+void LogDestinationToSocket::CloseUnLocked()
+{
+    close(log_fd_);
+    log_fd_ = -1;
+    next_open_time_ = time(NULL) + 1;
+}
+
+void LogDestinationToSocket::SendUnLocked()
+{
+    base_logging::ScopedFlushTimer timer(&stats.flush_latency);
+    int sent = 0;
+    while (log_fd_ != -1 && sent < n_queued_) {
+        const int n = sendmmsg(log_fd_, msgs_ + sent, n_queued_ - sent,
+                               MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // A full socket buffer just costs us this batch; anything else
+            // means the collector went away.
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+                CloseUnLocked();
+            }
+            break;
+        }
+        sent += n;
+    }
+    for (int i = sent; i < n_queued_; ++i) {
+        stats.dropped_bytes.Add(iovs_[i].iov_len);
+    }
+    stats.dropped.Add(n_queued_ - sent);
+    n_queued_ = 0;
+}
+
+void LogDestinationToSocket::Log(LogSeverity severity, time_t timestamp,
+                                 const char* message, size_t len)
+{
+    MutexLock l(lock_);
+    if (log_fd_ == -1 && !OpenUnLocked(timestamp)) {
+        stats.dropped.Add(1);
+        stats.dropped_bytes.Add(len);
+        return;
+    }
+    if (timestamp != timestamp_) {
+        struct ::tm tm_time;
+        gmtime_r(&timestamp, &tm_time);
+        snprintf(timestamp_text_, sizeof(timestamp_text_),
+                 "%04d-%02d-%02dT%02d:%02d:%02dZ",
+                 1900 + tm_time.tm_year, 1 + tm_time.tm_mon, tm_time.tm_mday,
+                 tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
+        timestamp_ = timestamp;
+    }
+    char *frame = frames_ + n_queued_ * kMaxFrameLen;
+    size_t n = snprintf(frame, kMaxFrameLen, "<%d>1 %s %s",
+                        SYSLOG_DAEMON | kSyslogLevels[severity],
+                        timestamp_text_, header_suffix_.c_str());
+    n = std::min(n, kMaxFrameLen);
+    if (len > 0 && message[len - 1] == '\n') {
+        --len;
+    }
+    len = std::min(len, kMaxFrameLen - n);
+    memcpy(frame + n, message, len);
+    iovs_[n_queued_].iov_len = n + len;
+    ++n_queued_;
+    if (n_queued_ == kBatchSize || severity <= kLS_ERR ||
+        !IsAsyncLogging()) {
+        SendUnLocked();
+    }
+}
+
+void LogDestinationToSocket::Flush()
+{
+    MutexLock l(lock_);
+    if (n_queued_ > 0) {
+        SendUnLocked();
+    }
+}
+
+std::string LogDestinationToSocket::Describe() const
+{
+    return LogDestination::Describe() + ":" + address_;
+}
+
+LogDestinationToSyslog::LogDestinationToSyslog(const std::string &path)
+        : LogDestinationToSocket(path, kLOG_DST_SYSLOG)
+{
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_LOGGING_LOG_SOCKET_HH_
+#define BASE_LOGGING_LOG_SOCKET_HH_
+
+#include <sys/socket.h>
+#include <time.h>
+
+#include <atomic>
+#include <string>
+
+#include "base/basictypes.hh"
+#include "base/logging/logging.hh"
+
+// Sends each message as one RFC 5424 datagram,
+//   "<PRI>1 2014-06-01T12:00:00Z host app pid - - message",
+// to a collector at |address|: "host:port" for UDP, or the path of a
+// unix datagram socket. Frames are built in place in a batch of reusable
+// buffers. While logging asynchronously, the batch is sent with one
+// sendmmsg() once it is full, a message at least as severe as kLS_ERR is
+// logged, or the writer thread runs out of messages and calls Flush();
+// otherwise every message is sent right away. Logging never blocks: the
+// socket is non-blocking and frames the collector can not take right now
+// are dropped and counted. An unreachable collector is retried at most
+// once a second.
+class LogDestinationToSocket : public LogDestination {
+public:
+    static const size_t kMaxFrameLen = 2048;
+    static const int kBatchSize = 32;
+
+    explicit LogDestinationToSocket(const std::string &address);
+    ~LogDestinationToSocket();
+    virtual void Log(LogSeverity severity, time_t timestamp,
+                     const char* message, size_t len);
+    virtual void Flush();
+    virtual std::string Describe() const;
+    // Messages dropped because the collector was unreachable or slow
+    uint64 n_dropped() const {
+        return stats.dropped.Value();
+    }
+
+protected:
+    LogDestinationToSocket(const std::string &address, Log_Destination type);
+
+private:
+    void Init();
+    bool OpenUnLocked(time_t timestamp);
+    void CloseUnLocked();
+    void SendUnLocked();
+
+    Mutex lock_;
+    std::string address_;
+    struct sockaddr_storage addr_;
+    socklen_t addr_len_;
+    time_t next_open_time_;
+    // "<host> <app> <pid> - - ", the part of the header after the time
+    std::string header_suffix_;
+    // The RFC 3339 form of timestamp_, rendered once a second
+    time_t timestamp_;
+    // Sized for any int in each field, as -Wformat-truncation assumes.
+    char timestamp_text_[80];
+    char *frames_;
+    struct mmsghdr msgs_[kBatchSize];
+    struct iovec iovs_[kBatchSize];
+    int n_queued_;
+    DISALLOW_COPY_AND_ASSIGN(LogDestinationToSocket);
+};
+
+// Sends messages to the local syslog daemon.
+class LogDestinationToSyslog : public LogDestinationToSocket {
+public:
+    explicit LogDestinationToSyslog(const std::string &path = "/dev/log");
+private:
+    DISALLOW_COPY_AND_ASSIGN(LogDestinationToSyslog);
+};
+
+#endif  // BASE_LOGGING_LOG_SOCKET_HH_
@@ -0,0 +1,176 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/logging/log_stats.hh"
+
+#include "base/strings/string_printf.hh"
+#include "base/time/time.hh"
+
+namespace base_logging {
+
+__thread int log_stat_stripe = 0;
+
+namespace {
+
+std::atomic<uint32> next_stat_stripe(0);
+
+}  // namespace
+
+int AssignLogStatStripe()
+{
+    log_stat_stripe = static_cast<int>(
+            next_stat_stripe.fetch_add(1, std::memory_order_relaxed) %
+            LogStatCounter::kStripes) + 1;
+    return log_stat_stripe;
+}
+
+const int LogStatCounter::kStripes;
+
+LogStatCounter::LogStatCounter()
+{
+    for (int i = 0; i < kStripes; ++i) {
+        cells_[i].value.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64 LogStatCounter::Value() const
+{
+    uint64 sum = 0;
+    for (int i = 0; i < kStripes; ++i) {
+        sum += cells_[i].value.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+ScopedFlushTimer::ScopedFlushTimer(LogLatencyHistogram *histogram) :
+        histogram_(histogram),
+        start_us_(base::TimeTicks::Now().ToInternalValue())
+{
+}
+
+ScopedFlushTimer::~ScopedFlushTimer()
+{
+    histogram_->Record(base::TimeTicks::Now().ToInternalValue() - start_us_);
+}
+
+}  // namespace base_logging
+
+namespace {
+
+// uint64 is unsigned long on LP64, so widen it to match %llu.
+unsigned long long ToULL(uint64 n)
+{
+    return n;
+}
+
+void AppendJsonString(std::string *out, const std::string &s)
+{
+    out->push_back('"');
+    for (size_t i = 0; i < s.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c == '"' || c == '\\') {
+            out->push_back('\\');
+            out->push_back(static_cast<char>(c));
+        } else if (c < 0x20) {
+            StringAppendF(out, "\\u%04x", c);
+        } else {
+            out->push_back(static_cast<char>(c));
+        }
+    }
+    out->push_back('"');
+}
+
+}  // namespace
+
+std::string LogStatsText()
+{
+    std::vector<LogModuleStatsSnapshot> modules;
+    std::vector<LogDestinationStatsSnapshot> destinations;
+    LogCollectStats(&modules, &destinations);
+    std::string out;
+    for (size_t i = 0; i < modules.size(); ++i) {
+        const LogModuleStatsSnapshot &m = modules[i];
+        out += "module " + m.name + ":";
+        StringAppendF(&out,
+                      " messages=%llu bytes=%llu dropped=%llu"
+                      " over_budget=%llu\n",
+                      ToULL(m.messages), ToULL(m.bytes), ToULL(m.dropped),
+                      ToULL(m.over_budget));
+    }
+    for (size_t i = 0; i < destinations.size(); ++i) {
+        const LogDestinationStatsSnapshot &d = destinations[i];
+        const base_logging::LogLatencyHistogram::Snapshot &h =
+                d.flush_latency;
+        out += "destination " + d.name + ":";
+        StringAppendF(&out,
+                      " messages=%llu bytes=%llu dropped=%llu"
+                      " dropped_bytes=%llu buffer_high_water=%llu",
+                      ToULL(d.messages), ToULL(d.bytes), ToULL(d.dropped),
+                      ToULL(d.dropped_bytes), ToULL(d.buffer_high_water));
+        StringAppendF(&out, " flushes=%llu flush_us_sum=%llu flush_us_max=%llu",
+                      ToULL(h.count), ToULL(h.sum_us), ToULL(h.max_us));
+        out += " flush_us=";
+        base_logging::LogLatencyHistogram::AppendBucketsText(h, &out);
+        out += '\n';
+    }
+    return out;
+}
+
+std::string LogStatsJson()
+{
+    std::vector<LogModuleStatsSnapshot> modules;
+    std::vector<LogDestinationStatsSnapshot> destinations;
+    LogCollectStats(&modules, &destinations);
+    std::string out = "{\"modules\":[";
+    for (size_t i = 0; i < modules.size(); ++i) {
+        const LogModuleStatsSnapshot &m = modules[i];
+        out += i == 0 ? "{\"name\":" : ",{\"name\":";
+        AppendJsonString(&out, m.name);
+        StringAppendF(&out,
+                      ",\"messages\":%llu,\"bytes\":%llu,\"dropped\":%llu"
+                      ",\"over_budget\":%llu}",
+                      ToULL(m.messages), ToULL(m.bytes), ToULL(m.dropped),
+                      ToULL(m.over_budget));
+    }
+    out += "],\"destinations\":[";
+    for (size_t i = 0; i < destinations.size(); ++i) {
+        const LogDestinationStatsSnapshot &d = destinations[i];
+        const base_logging::LogLatencyHistogram::Snapshot &h =
+                d.flush_latency;
+        out += i == 0 ? "{\"name\":" : ",{\"name\":";
+        AppendJsonString(&out, d.name);
+        StringAppendF(&out,
+                      ",\"messages\":%llu,\"bytes\":%llu,\"dropped\":%llu"
+                      ",\"dropped_bytes\":%llu,\"buffer_high_water\":%llu",
+                      ToULL(d.messages), ToULL(d.bytes), ToULL(d.dropped),
+                      ToULL(d.dropped_bytes), ToULL(d.buffer_high_water));
+        StringAppendF(&out,
+                      ",\"flush_latency_us\":{\"count\":%llu,\"sum\":%llu"
+                      ",\"max\":%llu,\"buckets\":[",
+                      ToULL(h.count), ToULL(h.sum_us), ToULL(h.max_us));
+        for (int b = 0; b < base_logging::LogLatencyHistogram::kBuckets; ++b) {
+            StringAppendF(&out, b == 0 ? "%llu" : ",%llu",
+                          ToULL(h.buckets[b]));
+        }
+        out += "]}}";
+    }
+    out += "]}";
+    return out;
+}
@@ -0,0 +1,156 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_LOGGING_LOG_STATS_HH_
+#define BASE_LOGGING_LOG_STATS_HH_
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.hh"
+#include "base/compiler_specific.hh"
+#include "base/time/time_histogram.hh"
+
+namespace base_logging {
+
+// Stripe of the calling thread, 1-based; 0 until it is first needed.
+extern __thread int log_stat_stripe;
+int AssignLogStatStripe();
+
+// A counter that many threads add to without sharing a cache line: each
+// thread adds to one of kStripes cells, assigned round robin the first
+// time it counts anything, and Value() sums them.
+class LogStatCounter {
+public:
+    static const int kStripes = 16;
+
+    LogStatCounter();
+    void Add(uint64 n) {
+        int stripe = log_stat_stripe;
+        if (PREDICT_FALSE(stripe == 0)) {
+            stripe = AssignLogStatStripe();
+        }
+        cells_[stripe - 1].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    // Adds that race with this may or may not be included.
+    uint64 Value() const;
+
+private:
+    // Padded rather than aligned: counters live in modules and
+    // destinations made with plain new, which C++11 does not align past
+    // 16 bytes. Cells a cache line apart never share one either way.
+    struct Cell {
+        std::atomic<uint64> value;
+        char pad[64 - sizeof(std::atomic<uint64>)];
+    };
+    Cell cells_[kStripes];
+    DISALLOW_COPY_AND_ASSIGN(LogStatCounter);
+};
+
+// Latencies in power-of-two buckets of microseconds.
+typedef base::MicrosecondHistogram LogLatencyHistogram;
+
+// What a LogModule has dispatched to its destinations.
+struct LogModuleStats {
+    LogStatCounter messages;
+    LogStatCounter bytes;
+};
+
+// What a LogDestination has been handed by modules, what it lost, and how
+// its writes went. Destinations without a write buffer or explicit writes
+// leave buffer_high_water and flush_latency empty.
+struct LogDestinationStats {
+    LogDestinationStats() : buffer_high_water(0) {
+    }
+    // Notes that the write buffer holds |used| bytes.
+    void RecordBufferFill(uint64 used) {
+        uint64 high = buffer_high_water.load(std::memory_order_relaxed);
+        while (used > high &&
+               !buffer_high_water.compare_exchange_weak(
+                       high, used, std::memory_order_relaxed)) {
+        }
+    }
+
+    LogStatCounter messages;
+    LogStatCounter bytes;
+    // Messages that did not make it out, and their bytes. A write that
+    // fails part way counts every message in it but only the bytes lost.
+    LogStatCounter dropped;
+    LogStatCounter dropped_bytes;
+    LogLatencyHistogram flush_latency;
+    std::atomic<uint64> buffer_high_water;
+};
+
+// Times a write of buffered messages into a LogLatencyHistogram.
+class ScopedFlushTimer {
+public:
+    explicit ScopedFlushTimer(LogLatencyHistogram *histogram);
+    ~ScopedFlushTimer();
+
+private:
+    LogLatencyHistogram *histogram_;
+    int64 start_us_;
+    DISALLOW_COPY_AND_ASSIGN(ScopedFlushTimer);
+};
+
+}  // namespace base_logging
+
+// The counters of one module or destination, read at one point in time.
+struct LogModuleStatsSnapshot {
+    std::string name;
+    uint64 messages;
+    uint64 bytes;
+    // LogModule::n_dropped and n_over_budget
+    uint64 dropped;
+    uint64 over_budget;
+};
+struct LogDestinationStatsSnapshot {
+    std::string name;
+    uint64 messages;
+    uint64 bytes;
+    uint64 dropped;
+    uint64 dropped_bytes;
+    uint64 buffer_high_water;
+    base_logging::LogLatencyHistogram::Snapshot flush_latency;
+};
+
+// Reads the counters of every live module and destination.
+void LogCollectStats(std::vector<LogModuleStatsSnapshot> *modules,
+                     std::vector<LogDestinationStatsSnapshot> *destinations);
+
+// The same as text, one line per module or destination, e.g.
+//   module net: messages=10 bytes=812 dropped=0 over_budget=0
+// and for a destination
+//   destination file:main.log: messages=10 bytes=812 dropped=0
+//   dropped_bytes=0 buffer_high_water=812 flushes=1 flush_us_sum=35
+//   flush_us_max=35 flush_us=<64:1
+// (without the line breaks), where flush_us lists the non-empty latency
+// buckets as "<limit:count", or "-" if there were no flushes.
+std::string LogStatsText();
+// The same as a JSON object:
+//   {"modules":[{"name":..,"messages":..,"bytes":..,"dropped":..,
+//    "over_budget":..}],"destinations":[{"name":..,"messages":..,
+//    "bytes":..,"dropped":..,"dropped_bytes":..,"buffer_high_water":..,
+//    "flush_latency_us":{"count":..,"sum":..,"max":..,"buckets":[..]}}]}
+// with bucket i of "buckets" as in LogLatencyHistogram.
+std::string LogStatsJson();
+
+#endif  // BASE_LOGGING_LOG_STATS_HH_
@@ -20,16 +20,31 @@
 
 #include "base/logging/logging.hh"
 
+#include <algorithm>
 #include <cstdio>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdint.h>
+#include <fnmatch.h>
 #include <sstream>
 #include <iomanip>
 #include <map>
+#include <new>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "base/logging/async_log.hh"
+#include "base/logging/log_binary.hh"
+#include "base/logging/log_control.hh"
+#include "base/logging/log_crash.hh"
+#include "base/logging/log_prefix.hh"
+#include "base/logging/log_rotation.hh"
 
 LOG_DEFINE_THIS_MODULE(log);
+LogModule log_module_default("default");
 
 const char* const LogSeverityNames[] = {
 #define LOG_SEVERITY(NAME,SEVERITY)#NAME,
@@ -41,21 +56,540 @@ const char* GetLogSeverityName(LogSeverity severity) {
 }
 
 // LogModule
-static std::list<LogModule*> module_list;
+// Every live module, for changing levels at runtime. Function statics, as
+// modules are constructed during static initialization.
+static std::list<LogModule*> &ModuleList()
+{
+    static std::list<LogModule*> module_list;
+    return module_list;
+}
+static Mutex &ModuleListLock()
+{
+    static Mutex module_list_lock;
+    return module_list_lock;
+}
+// Serializes updates of the enabled masks.
+static Mutex &ModuleConfigLock()
+{
+    static Mutex module_config_lock;
+    return module_config_lock;
+}
+
+// Destination tables
+// A module's destinations for every severity. A published table is never
+// changed; LogModule::PublishTable() swaps in a new one, RCU style.
+struct LogDestinationTable {
+    LogDestination *dsts[kLS_MAX][kLOG_DST_MAX];
+};
+
+namespace {
+
+// Every thread that dispatches messages has a reader slot, saying which
+// epoch its current read started in (0 while it is not reading). A table
+// replaced in epoch N can be freed once no slot holds an epoch below N.
+// Each slot is only written by its own thread, so readers never contend.
+struct TableReader {
+    TableReader() : epoch(0), depth(0) {
+    }
+    alignas(64) std::atomic<uint64> epoch;
+    // Reads nested through a destination that logs itself
+    int depth;
+};
+
+std::atomic<uint64> table_epoch(1);
+pthread_key_t table_reader_key;
+pthread_once_t table_reader_once = PTHREAD_ONCE_INIT;
+__thread TableReader *table_reader = NULL;
+
+Mutex &TableReadersLock()
+{
+    static Mutex lock;
+    return lock;
+}
+std::vector<TableReader*> &TableReaders()
+{
+    static std::vector<TableReader*> readers;
+    return readers;
+}
+
+void DeleteTableReader(void *arg)
+{
+    TableReader *reader = static_cast<TableReader*>(arg);
+    {
+        MutexLock l(TableReadersLock());
+        std::vector<TableReader*> &readers = TableReaders();
+        readers.erase(std::find(readers.begin(), readers.end(), reader));
+    }
+    table_reader = NULL;
+    reader->~TableReader();
+    free(reader);
+}
+
+void CreateTableReaderKey()
+{
+    pthread_key_create(&table_reader_key, DeleteTableReader);
+}
+
+TableReader *CurrentTableReader()
+{
+    if (PREDICT_TRUE(table_reader != NULL)) {
+        return table_reader;
+    }
+    pthread_once(&table_reader_once, CreateTableReaderKey);
+    // Plain new does not honour alignas(64) before C++17.
+    void *memory = NULL;
+    if (posix_memalign(&memory, 64, sizeof(TableReader)) != 0) {
+        abort();
+    }
+    TableReader *reader = new (memory) TableReader();
+    {
+        MutexLock l(TableReadersLock());
+        TableReaders().push_back(reader);
+    }
+    pthread_setspecific(table_reader_key, reader);
+    table_reader = reader;
+    return reader;
+}
+
+// Marks the calling thread as reading destination tables while in scope.
+class TableReadSection {
+public:
+    TableReadSection() : reader_(CurrentTableReader()) {
+        if (reader_->depth++ == 0) {
+            // Pairs with WaitForTableReaders(): either the writer sees this
+            // store and waits for us, or we see the table it published.
+            reader_->epoch.store(table_epoch.load(std::memory_order_acquire),
+                                 std::memory_order_seq_cst);
+        }
+    }
+    ~TableReadSection() {
+        if (--reader_->depth == 0) {
+            reader_->epoch.store(0, std::memory_order_release);
+        }
+    }
+private:
+    TableReader *reader_;
+    DISALLOW_COPY_AND_ASSIGN(TableReadSection);
+};
+
+// Waits until every thread that may have loaded a table before the one
+// just published is done with it.
+void WaitForTableReaders()
+{
+    const uint64 epoch =
+            table_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    MutexLock l(TableReadersLock());
+    const std::vector<TableReader*> &readers = TableReaders();
+    for (size_t i = 0; i < readers.size(); ++i) {
+        if (readers[i] == table_reader) {
+            continue;
+        }
+        for (;;) {
+            const uint64 reading =
+                    readers[i]->epoch.load(std::memory_order_seq_cst);
+            if (reading == 0 || reading >= epoch) {
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+}  // namespace
+
 LogModule::LogModule(const std::string m_name) :
         name(m_name),min_severity(kLS_INFO),
-        vlog_on(true), n_bytes(0), max_bytes(kuint32max)
+        vlog_level(0), overflow_policy(kLOG_OVERFLOW_BLOCK), n_dropped(0),
+        n_over_budget(0), budget_bytes_(0), budget_messages_(0),
+        budget_window_secs_(0), budget_window_start_(0), window_bytes_(0),
+        window_messages_(0), over_budget_(false)
+{
+    dst_table_.store(NULL, std::memory_order_relaxed);
+    UpdateEnabledSeverities();
+    MutexLock l(ModuleListLock());
+    ModuleList().push_back(this);
+}
+
+LogModule::~LogModule()
+{
+    {
+        MutexLock l(ModuleListLock());
+        ModuleList().remove(this);
+    }
+    delete dst_table_.load(std::memory_order_relaxed);
+}
+
+void LogModule::AddLogDestination(LogDestination *dst, LogSeverity severity)
+{
+    MutexLock l(ModuleConfigLock());
+    LogDestinationTable *table = new LogDestinationTable();
+    const LogDestinationTable *current =
+            dst_table_.load(std::memory_order_relaxed);
+    if (current != NULL) {
+        *table = *current;
+    }
+    table->dsts[severity][dst->type] = dst;
+    PublishTable(table);
+}
+
+void LogModule::RemoveLogDestination(LogDestination *dst,
+                                     LogSeverity severity)
+{
+    MutexLock l(ModuleConfigLock());
+    const LogDestinationTable *current =
+            dst_table_.load(std::memory_order_relaxed);
+    if (current == NULL || current->dsts[severity][dst->type] != dst) {
+        return;
+    }
+    LogDestinationTable *table = new LogDestinationTable(*current);
+    table->dsts[severity][dst->type] = NULL;
+    PublishTable(table);
+}
+
+void LogModule::PublishTable(const LogDestinationTable *table)
+{
+    const LogDestinationTable *old =
+            dst_table_.exchange(table, std::memory_order_seq_cst);
+    UpdateEnabledSeverities();
+    WaitForTableReaders();
+    delete old;
+}
+
+void LogModule::SetMinSeverity(LogSeverity severity)
+{
+    MutexLock l(ModuleConfigLock());
+    min_severity.store(severity, std::memory_order_relaxed);
+    UpdateEnabledSeverities();
+}
+
+void LogModule::SetVlogLevel(int level)
 {
-    for (int severity = 0; severity < kLS_MAX; ++severity) {
+    MutexLock l(ModuleConfigLock());
+    vlog_level.store(level < 0 ? 0 :
+                     level > kMaxVlogLevel ? kMaxVlogLevel : level,
+                     std::memory_order_relaxed);
+    UpdateEnabledSeverities();
+}
+
+void LogModule::UpdateEnabledSeverities()
+{
+    const LogDestinationTable *table =
+            dst_table_.load(std::memory_order_relaxed);
+    const LogSeverity min = min_severity.load(std::memory_order_relaxed);
+    uint32_t enabled = 0;
+    for (int severity = 0; table != NULL && severity <= min; ++severity) {
         for (int dst = 0; dst < kLOG_DST_MAX; ++dst) {
-            severity_dsts[severity][dst] = NULL;
+            if (table->dsts[severity][dst] != NULL) {
+                enabled |= 1u << severity;
+                break;
+            }
         }
     }
-    //module_list.push_back(this);
+    enabled |= static_cast<uint32_t>(
+            vlog_level.load(std::memory_order_relaxed)) << kVlogShift;
+    enabled_.store(enabled, std::memory_order_relaxed);
 }
-void LogModule::AddLogDestination(LogDestination *dst, LogSeverity severity)
+
+int LogSetModuleSeverity(const std::string &pattern, LogSeverity severity)
+{
+    MutexLock l(ModuleListLock());
+    int matched = 0;
+    std::list<LogModule*>::iterator it;
+    for (it = ModuleList().begin(); it != ModuleList().end(); ++it) {
+        if (fnmatch(pattern.c_str(), (*it)->name.c_str(), 0) == 0) {
+            (*it)->SetMinSeverity(severity);
+            ++matched;
+        }
+    }
+    return matched;
+}
+
+int LogSetModuleVlog(const std::string &pattern, int level)
 {
-    severity_dsts[severity][dst->type] = dst;
+    MutexLock l(ModuleListLock());
+    int matched = 0;
+    std::list<LogModule*>::iterator it;
+    for (it = ModuleList().begin(); it != ModuleList().end(); ++it) {
+        if (fnmatch(pattern.c_str(), (*it)->name.c_str(), 0) == 0) {
+            (*it)->SetVlogLevel(level);
+            ++matched;
+        }
+    }
+    return matched;
+}
+
+std::vector<std::string> LogListModules()
+{
+    MutexLock l(ModuleListLock());
+    std::vector<std::string> names;
+    std::list<LogModule*>::iterator it;
+    for (it = ModuleList().begin(); it != ModuleList().end(); ++it) {
+        names.push_back((*it)->name);
+    }
+    return names;
+}
+
+void LogModule::SetBudget(uint64_t max_bytes, uint64_t max_messages,
+                          int window_secs)
+{
+    budget_bytes_.store(max_bytes, std::memory_order_relaxed);
+    budget_messages_.store(max_messages, std::memory_order_relaxed);
+    budget_window_secs_.store(window_secs, std::memory_order_relaxed);
+    budget_window_start_.store(0, std::memory_order_relaxed);
+    window_bytes_.store(0, std::memory_order_relaxed);
+    window_messages_.store(0, std::memory_order_relaxed);
+    over_budget_.store(false, std::memory_order_relaxed);
+}
+
+bool LogModule::CheckBudget() const
+{
+    const time_t now = time(NULL);
+    time_t start = budget_window_start_.load(std::memory_order_relaxed);
+    if (now < start + budget_window_secs_.load(std::memory_order_relaxed)) {
+        n_over_budget.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // Whoever moves the window on also resets the usage.
+    if (budget_window_start_.compare_exchange_strong(
+            start, now, std::memory_order_relaxed)) {
+        window_bytes_.store(0, std::memory_order_relaxed);
+        window_messages_.store(0, std::memory_order_relaxed);
+        over_budget_.store(false, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void LogModule::ChargeBudget(time_t timestamp, size_t len) const
+{
+    const uint64_t max_bytes = budget_bytes_.load(std::memory_order_relaxed);
+    const uint64_t max_messages =
+            budget_messages_.load(std::memory_order_relaxed);
+    if (max_bytes == 0 && max_messages == 0) {
+        return;
+    }
+    time_t start = budget_window_start_.load(std::memory_order_relaxed);
+    if (timestamp >= start +
+        budget_window_secs_.load(std::memory_order_relaxed) &&
+        budget_window_start_.compare_exchange_strong(
+                start, timestamp, std::memory_order_relaxed)) {
+        window_bytes_.store(0, std::memory_order_relaxed);
+        window_messages_.store(0, std::memory_order_relaxed);
+        over_budget_.store(false, std::memory_order_relaxed);
+    }
+    const uint64_t bytes =
+            window_bytes_.fetch_add(len, std::memory_order_relaxed) + len;
+    const uint64_t messages =
+            window_messages_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if ((max_bytes != 0 && bytes >= max_bytes) ||
+        (max_messages != 0 && messages >= max_messages)) {
+        over_budget_.store(true, std::memory_order_relaxed);
+    }
+}
+
+// Dispatch takes no lock: threads logging to different destinations do
+// not serialize, and each destination handles its own concurrency.
+void LogModule::Log(LogSeverity severity, time_t timestamp,
+                    const char* message, size_t len) const
+{
+    ChargeBudget(timestamp, len);
+    stats.messages.Add(1);
+    stats.bytes.Add(len);
+    TableReadSection section;
+    const LogDestinationTable *table =
+            dst_table_.load(std::memory_order_seq_cst);
+    for (int i = 0; table != NULL && i < kLOG_DST_MAX; ++i) {
+        LogDestination *dst = table->dsts[severity][i];
+        if (dst) {
+            dst->stats.messages.Add(1);
+            dst->stats.bytes.Add(len);
+            dst->Log(severity, timestamp, message, len);
+        }
+    }
+}
+
+void LogModule::LogBinary(const LogBinarySite *site, int64 timestamp_us,
+                          const char *args, size_t len) const
+{
+    ChargeBudget(static_cast<time_t>(timestamp_us /
+                                     base::kMicrosecondsPerSecond), len);
+    stats.messages.Add(1);
+    stats.bytes.Add(len);
+    TableReadSection section;
+    const LogDestinationTable *table =
+            dst_table_.load(std::memory_order_seq_cst);
+    for (int i = 0; table != NULL && i < kLOG_DST_MAX; ++i) {
+        LogDestination *dst = table->dsts[site->severity][i];
+        if (dst) {
+            dst->stats.messages.Add(1);
+            dst->stats.bytes.Add(len);
+            dst->LogBinary(site, timestamp_us, args, len);
+        }
+    }
+}
+
+// Does not announce itself as a reader: a signal handler can not
+// allocate a reader slot, and nothing is freed once the process is dying.
+void LogModule::CrashLog(LogSeverity severity, time_t timestamp,
+                         const char* message, size_t len) const
+{
+    const LogDestinationTable *table =
+            dst_table_.load(std::memory_order_acquire);
+    for (int i = 0; table != NULL && i < kLOG_DST_MAX; ++i) {
+        LogDestination *dst = table->dsts[severity][i];
+        if (dst) {
+            dst->CrashWrite(severity, timestamp, message, len);
+        }
+    }
+}
+
+// LogStreamBuf
+const char base_logging::LogStreamBuf::kTruncatedMarker[] = "...[truncated]";
+
+void base_logging::LogStreamBuf::AppendTruncated(const char *s, size_t n)
+{
+    const size_t room = epptr() - pptr();
+    memcpy(pptr(), s, room);
+    pbump(static_cast<int>(room));
+    Truncate();
+}
+
+void base_logging::LogStreamBuf::Truncate()
+{
+    if (truncated_) {
+        return;
+    }
+    truncated_ = true;
+    const size_t marker_len = sizeof(kTruncatedMarker) - 1;
+    const size_t size = epptr() - pbase();
+    const size_t n = std::min(marker_len, size);
+    memcpy(epptr() - n, kTruncatedMarker + marker_len - n, n);
+    pbump(static_cast<int>(epptr() - pptr()));
+}
+
+// LogStream
+const std::ios_base::fmtflags LogMessage::LogStream::kDefaultFlags;
+const std::streamsize LogMessage::LogStream::kDefaultPrecision;
+
+namespace {
+
+const char kDigitPairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+// Writes |n| in decimal so that it ends just before |end|, and returns
+// where it starts.
+inline char *FormatDecimal(unsigned long long n, char *end)
+{
+    char *p = end;
+    while (n >= 100) {
+        const unsigned int pair = static_cast<unsigned int>(n % 100) * 2;
+        n /= 100;
+        *--p = kDigitPairs[pair + 1];
+        *--p = kDigitPairs[pair];
+    }
+    if (n >= 10) {
+        const unsigned int pair = static_cast<unsigned int>(n) * 2;
+        *--p = kDigitPairs[pair + 1];
+        *--p = kDigitPairs[pair];
+    } else {
+        *--p = static_cast<char>('0' + n);
+    }
+    return p;
+}
+
+}  // namespace
+
+void LogMessage::LogStream::ResetOstream()
+{
+    ostream_->clear();
+    ostream_->flags(kDefaultFlags);
+    ostream_->width(0);
+    ostream_->precision(kDefaultPrecision);
+    ostream_->fill('0');
+}
+
+LogMessage::LogStream& LogMessage::LogStream::AppendSigned(long long n)
+{
+    if (PREDICT_FALSE(Formatted())) {
+        *ostream_ << n;
+        return *this;
+    }
+    char buf[24];
+    char *end = buf + sizeof(buf);
+    // Negate as unsigned so that LLONG_MIN does not overflow.
+    const unsigned long long magnitude =
+            n < 0 ? 0ULL - static_cast<unsigned long long>(n) : n;
+    char *p = FormatDecimal(magnitude, end);
+    if (n < 0) {
+        *--p = '-';
+    }
+    streambuf_.append(p, end - p);
+    return *this;
+}
+
+LogMessage::LogStream& LogMessage::LogStream::AppendUnsigned(
+        unsigned long long n)
+{
+    if (PREDICT_FALSE(Formatted())) {
+        *ostream_ << n;
+        return *this;
+    }
+    char buf[24];
+    char *end = buf + sizeof(buf);
+    char *p = FormatDecimal(n, end);
+    streambuf_.append(p, end - p);
+    return *this;
+}
+
+LogMessage::LogStream& LogMessage::LogStream::operator<<(double d)
+{
+    if (PREDICT_FALSE(Formatted())) {
+        *ostream_ << d;
+        return *this;
+    }
+    // Whole numbers below 1e6 are common and print as plain integers
+    // under %.6g. Zero is left to snprintf(), which keeps -0.0's sign.
+    if (d > -1e6 && d < 1e6 && d != 0 &&
+        d == static_cast<double>(static_cast<long long>(d))) {
+        return AppendSigned(static_cast<long long>(d));
+    }
+    // "%.6g" is what an ostream in its default state prints.
+    char buf[32];
+    const int n = snprintf(buf, sizeof(buf), "%.6g", d);
+    streambuf_.append(buf, n);
+    return *this;
+}
+
+LogMessage::LogStream& LogMessage::LogStream::operator<<(const void *p)
+{
+    if (PREDICT_FALSE(Formatted())) {
+        *ostream_ << p;
+        return *this;
+    }
+    // Like an ostream: "0x" and the address in lower case hex, or "0".
+    uintptr_t value = reinterpret_cast<uintptr_t>(p);
+    if (value == 0) {
+        return *this << '0';
+    }
+    char buf[2 + 2 * sizeof(value)];
+    char *end = buf + sizeof(buf);
+    char *q = end;
+    while (value != 0) {
+        *--q = "0123456789abcdef"[value & 0xf];
+        value >>= 4;
+    }
+    *--q = 'x';
+    *--q = '0';
+    streambuf_.append(q, end - q);
+    return *this;
 }
 
 // LogMessageData
@@ -68,7 +602,6 @@ struct LogMessage::LogMessageData {
     LogSeverity severity_;
     int line_;
     time_t timestamp_;
-    struct ::tm tm_time_;
     size_t num_prefix_chars_;
     size_t num_chars_to_log_;
     const char* basename_;
@@ -81,126 +614,468 @@ private:
 };
 
 // LogDestination
+// Every live destination, so they can be flushed together.
+static Mutex& DestinationListLock()
+{
+    static Mutex lock;
+    return lock;
+}
+static std::list<LogDestination*>& DestinationList()
+{
+    static std::list<LogDestination*> destinations;
+    return destinations;
+}
+
+// Destinations buffer, so make sure nothing is left behind at exit,
+// including messages still queued for the async writer.
+static pthread_once_t flush_at_exit_once = PTHREAD_ONCE_INIT;
+static void FlushAllAtExit()
+{
+    StopLogControl();
+    StopAsyncLogging();
+    LogDestination::FlushAll();
+    base_logging::StopLogRotation();
+}
+static void RegisterFlushAtExit()
+{
+    atexit(FlushAllAtExit);
+}
+
+LogDestination::LogDestination() : type(kLOG_DST_MAX), log_fd_(-1)
+{
+    MutexLock l(DestinationListLock());
+    DestinationList().push_back(this);
+    pthread_once(&flush_at_exit_once, RegisterFlushAtExit);
+}
+
+// Concrete destinations have unregistered already; this only keeps a
+// destination that forgot from being left dangling on the list.
+LogDestination::~LogDestination()
+{
+    Unregister();
+}
+
+void LogDestination::Unregister()
+{
+    MutexLock l(DestinationListLock());
+    DestinationList().remove(this);
+}
+
+// static function
+void LogDestination::FlushAll()
+{
+    MutexLock l(DestinationListLock());
+    std::list<LogDestination*>::iterator it;
+    for (it = DestinationList().begin(); it != DestinationList().end(); ++it) {
+        (*it)->Flush();
+    }
+}
+
+// The list lock is not taken: the crashing thread may hold it.
+void LogDestination::CrashWriteAll(LogSeverity severity, time_t timestamp,
+                                   const char* message, size_t len,
+                                   int skip_fd)
+{
+    struct stat skip;
+    if (skip_fd == -1 || fstat(skip_fd, &skip) != 0) {
+        skip_fd = -1;
+    }
+    std::list<LogDestination*>::iterator it;
+    for (it = DestinationList().begin(); it != DestinationList().end(); ++it) {
+        struct stat st;
+        if (skip_fd != -1 && (*it)->log_fd_ != -1 &&
+            fstat((*it)->log_fd_, &st) == 0 &&
+            st.st_dev == skip.st_dev && st.st_ino == skip.st_ino) {
+            continue;
+        }
+        (*it)->CrashWrite(severity, timestamp, message, len);
+    }
+}
+
+void LogDestination::CrashFlushAll()
+{
+    std::list<LogDestination*>::iterator it;
+    for (it = DestinationList().begin(); it != DestinationList().end(); ++it) {
+        (*it)->CrashFlush();
+    }
+}
+
+std::string LogDestination::Describe() const
+{
+    static const char *const kTypeNames[] = {
+        "file", "stderr", "syslog", "socket", "mmap", "binary"
+    };
+    return type < kLOG_DST_MAX ? kTypeNames[type] : "unknown";
+}
+
+void LogCollectStats(std::vector<LogModuleStatsSnapshot> *modules,
+                     std::vector<LogDestinationStatsSnapshot> *destinations)
+{
+    modules->clear();
+    destinations->clear();
+    {
+        MutexLock l(ModuleListLock());
+        std::list<LogModule*>::iterator it;
+        for (it = ModuleList().begin(); it != ModuleList().end(); ++it) {
+            const LogModule *module = *it;
+            LogModuleStatsSnapshot snapshot;
+            snapshot.name = module->name;
+            snapshot.messages = module->stats.messages.Value();
+            snapshot.bytes = module->stats.bytes.Value();
+            snapshot.dropped =
+                    module->n_dropped.load(std::memory_order_relaxed);
+            snapshot.over_budget =
+                    module->n_over_budget.load(std::memory_order_relaxed);
+            modules->push_back(snapshot);
+        }
+    }
+    MutexLock l(DestinationListLock());
+    std::list<LogDestination*>::iterator it;
+    for (it = DestinationList().begin(); it != DestinationList().end(); ++it) {
+        const LogDestination *dst = *it;
+        LogDestinationStatsSnapshot snapshot;
+        snapshot.name = dst->Describe();
+        snapshot.messages = dst->stats.messages.Value();
+        snapshot.bytes = dst->stats.bytes.Value();
+        snapshot.dropped = dst->stats.dropped.Value();
+        snapshot.dropped_bytes = dst->stats.dropped_bytes.Value();
+        snapshot.buffer_high_water =
+                dst->stats.buffer_high_water.load(std::memory_order_relaxed);
+        dst->stats.flush_latency.Read(&snapshot.flush_latency);
+        destinations->push_back(snapshot);
+    }
+}
+
 DEFINE_int32(logbufsecs, 30,
              "Buffer log messages for at most this many seconds");
+DEFINE_int32(logbufkb, 256,
+             "Buffer at most this many kilobytes of log messages per file, "
+             "0 writes every message through");
+DEFINE_int32(max_log_size, 0,
+             "Roll log files once they reach this many megabytes, 0 never");
+DEFINE_int32(logrotatesecs, 0,
+             "Roll log files at every multiple of this many seconds of "
+             "local time, 0 never");
+DEFINE_int32(logfilegenerations, 10, "Number of rolled log files to keep");
+DEFINE_bool(logcompress, true, "gzip rolled log files");
+
+namespace base_logging {
+
+// The file header is built in the buffer, so even a file written through
+// gets one this big.
+static const size_t kMinLogFileBufferSize = 4096;
+
+size_t LogFileBufferSize()
+{
+    if (FLAGS_logbufkb <= 0) {
+        return kMinLogFileBufferSize;
+    }
+    return std::max(kMinLogFileBufferSize,
+                    static_cast<size_t>(FLAGS_logbufkb) * 1024);
+}
+
+}  // namespace base_logging
+
 LogDestinationToFile::LogDestinationToFile(std::string name) :
-        base_filename_(name),file_(NULL),
-        file_length_(0),
-        bytes_since_flush_(0),bytes_max_flush_(kuint32max),
-        next_flush_time_(0)
+        base_filename_(name), buffer_(NULL),
+        buffer_size_(base_logging::LogFileBufferSize()),
+        write_through_(FLAGS_logbufkb <= 0),
+        buffer_used_(0), buffer_messages_(0), file_length_(0),
+        next_flush_time_(0), flush_severity_(kLS_ERR),
+        max_file_length_(static_cast<uint64_t>(FLAGS_max_log_size) << 20),
+        rotate_interval_(FLAGS_logrotatesecs), next_rotate_time_(0),
+        keep_generations_(FLAGS_logfilegenerations),
+        compress_(FLAGS_logcompress), roll_count_(0)
 {
 	type = kLOG_DST_FILE;
 }
 
 LogDestinationToFile::~LogDestinationToFile()
+{
+    Unregister();
+    MutexLock l(lock_);
+    if (log_fd_ != -1) {
+        FlushUnLocked();
+        close(log_fd_);
+        log_fd_ = -1;
+    }
+    free(buffer_);
+}
+
+void LogDestinationToFile::set_flush_severity(LogSeverity severity)
+{
+    MutexLock l(lock_);
+    flush_severity_ = severity;
+}
+
+void LogDestinationToFile::SetRotation(uint64_t max_bytes, int interval_secs,
+                                       int keep_generations, bool compress)
 {
     MutexLock l(lock_);
-    if (file_ != NULL) {
-        // TODO(geshuning): close here, how about fd;
-        fclose(file_);
-        file_ = NULL;
+    max_file_length_ = max_bytes;
+    rotate_interval_ = interval_secs;
+    keep_generations_ = keep_generations;
+    compress_ = compress;
+}
+
+// Writes all of |iov|, which holds |messages| messages, retrying short
+// writes. Data that can not be written (e.g. the disk is full) is dropped
+// and counted in stats.
+void LogDestinationToFile::WriteUnLocked(struct iovec* iov, int iovcnt,
+                                         size_t messages)
+{
+    base_logging::ScopedFlushTimer timer(&stats.flush_latency);
+    while (iovcnt > 0) {
+        ssize_t written = writev(log_fd_, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            size_t lost = 0;
+            for (int i = 0; i < iovcnt; ++i) {
+                lost += iov[i].iov_len;
+            }
+            stats.dropped.Add(messages);
+            stats.dropped_bytes.Add(lost);
+            return;
+        }
+        while (iovcnt > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
     }
 }
 
 void LogDestinationToFile::FlushUnLocked()
 {
-    if (file_ != NULL) {
-        fflush(file_);
-        bytes_since_flush_ = 0;
+    if (log_fd_ != -1 && buffer_used_ > 0) {
+        struct iovec iov = { buffer_, buffer_used_ };
+        WriteUnLocked(&iov, 1, buffer_messages_);
+        buffer_used_ = 0;
+        buffer_messages_ = 0;
     }
-    const int64 next = FLAGS_logbufsecs * static_cast<int64>(10000000);
-    next_flush_time_ = base::Time::Now().ToInternalValue()+ next;
+    next_flush_time_ = time(NULL) + FLAGS_logbufsecs;
 }
 
-void LogDestinationToFile::Log(LogSeverity severity, time_t timestamp,
-                               const char* message, size_t len)
+void LogDestinationToFile::Flush()
 {
     MutexLock l(lock_);
+    FlushUnLocked();
+}
+
+// Writes the buffer as it stands, without lock_.
+void LogDestinationToFile::CrashFlush()
+{
+    if (log_fd_ != -1 && buffer_used_ > 0) {
+        const size_t used = buffer_used_;
+        buffer_used_ = 0;
+        buffer_messages_ = 0;
+        base_logging::CrashWriteFd(log_fd_, buffer_, used);
+    }
+}
+
+void LogDestinationToFile::CrashWrite(LogSeverity severity, time_t timestamp,
+                                      const char* message, size_t len)
+{
+    CrashFlush();
+    // The message may have been waiting in an async ring since before the
+    // file was opened. open(2) is async-signal-safe, but naming a rolled
+    // file and writing the header are not, so those are skipped.
+    if (log_fd_ == -1 && !rotating() && !base_filename_.empty()) {
+        log_fd_ = open(base_filename_.c_str(),
+                       O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0664);
+    }
+    if (log_fd_ != -1) {
+        base_logging::CrashWriteFd(log_fd_, message, len);
+        file_length_ += len;
+    }
+}
+
+std::string LogDestinationToFile::Describe() const
+{
+    return "file:" + base_filename_;
+}
+
+// Opens the file, if needed, and queues its header.
+bool LogDestinationToFile::OpenUnLocked(time_t timestamp)
+{
+    if (log_fd_ != -1) {
+        return true;
+    }
     if (base_filename_.empty()) {
-        return;
+        return false;
     }
-    if (file_ == NULL) {
-        const char* filename = base_filename_.c_str();
-        log_fd_ = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0664);
-        if (log_fd_ == -1) {
-            LOG_WARN() << "Can not open file " << base_filename_;
-            return;
-        }
-        fcntl(log_fd_, F_SETFD, FD_CLOEXEC);
-        file_ = fdopen(log_fd_, "a");
-        if (file_ == NULL) {
-            close(log_fd_);
-            unlink(filename);
-            LOG_WARN() << "Faild to do fdopen with " << base_filename_;
+    if (buffer_ == NULL) {
+        void* buffer = NULL;
+        if (posix_memalign(&buffer, 4096, buffer_size_) != 0) {
+            return false;
         }
+        buffer_ = static_cast<char*>(buffer);
     }
-    if (file_ == NULL) {
-        return;
+    if (rotating()) {
+        current_filename_ = base_logging::RolledLogFileName(
+                base_filename_, timestamp, roll_count_++);
+        next_rotate_time_ = rotate_interval_ == 0 ? 0 :
+                base_logging::NextLogRotationTime(timestamp, rotate_interval_);
+    } else {
+        current_filename_ = base_filename_;
     }
-    if (bytes_since_flush_ > bytes_max_flush_) {
-        LOG_WARN() << base_filename_ << "had exceed its max length("
-                   << bytes_max_flush_ << "bytes)";
-        return;
+    const char* filename = current_filename_.c_str();
+    log_fd_ = open(filename, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0664);
+    if (log_fd_ == -1) {
+        LOG_WARN() << "Can not open file " << current_filename_;
+        return false;
     }
-    // TODO(gene.ge): use time struct
     struct ::tm tm_time;
     localtime_r(&timestamp, &tm_time);
-    std::ostringstream file_header_stream;
-    file_header_stream.fill('0');
-    file_header_stream << "Log file created at:"
-                       << 1900 + tm_time.tm_year << '/'
-                       << std::setw(2) << 1 + tm_time.tm_mon << '/'
-                       << std::setw(2) << tm_time.tm_mday
-                       << ' '
-                       << std::setw(2) << tm_time.tm_hour << ':'
-                       << std::setw(2) << tm_time.tm_min << ':'
-                       << std::setw(2) << tm_time.tm_sec << '\n' << '\n';
-    const std::string& file_header_string = file_header_stream.str();
-    const int header_len = file_header_string.size();
-    //TODO(gene.ge):change to aio
-    fwrite(file_header_string.data(), 1, header_len, file_);
-    file_length_ += header_len;
-    bytes_since_flush_ += header_len;
-
-    // Write log to file
-    errno = 0;
-    fwrite(message, 1, len, file_);
-    if (errno == ENOSPC) {
-        LOG_WARN() << "Disk full";
-        return;
+    const int header_len = snprintf(buffer_, buffer_size_,
+                                    "Log file created at:%04d/%02d/%02d "
+                                    "%02d:%02d:%02d\n\n",
+                                    1900 + tm_time.tm_year,
+                                    1 + tm_time.tm_mon, tm_time.tm_mday,
+                                    tm_time.tm_hour, tm_time.tm_min,
+                                    tm_time.tm_sec);
+    buffer_used_ = header_len < 0 ? 0 :
+            std::min(static_cast<size_t>(header_len), buffer_size_ - 1);
+    file_length_ = buffer_used_;
+    next_flush_time_ = timestamp + FLAGS_logbufsecs;
+    return true;
+}
+
+// Counts a message of |len| bytes that there is no file to write to.
+void LogDestinationToFile::DropUnLocked(size_t len)
+{
+    stats.dropped.Add(1);
+    stats.dropped_bytes.Add(len);
+}
+
+// Switches to a new file. Everything slow about it (closing the old
+// file, compressing it, pruning old generations) is left to the rotation
+// thread; the old fd stays open until then.
+void LogDestinationToFile::RollUnLocked(time_t timestamp)
+{
+    FlushUnLocked();
+    base_logging::LogRotationJob job;
+    job.rolled_fd = log_fd_;
+    job.rolled_path = current_filename_;
+    log_fd_ = -1;
+    OpenUnLocked(timestamp);
+    job.current_path = log_fd_ == -1 ? "" : current_filename_;
+    job.link_path = base_filename_;
+    job.keep_generations = keep_generations_;
+    job.compress = compress_;
+    base_logging::ScheduleLogRotation(job);
+}
+
+// Messages are gathered in buffer_ and written with a single writev() once
+// it fills up, FLAGS_logbufsecs have passed, or a message at least as
+// severe as flush_severity_ arrives; or straight away when writing through.
+void LogDestinationToFile::Log(LogSeverity severity, time_t timestamp,
+                               const char* message, size_t len)
+{
+    MutexLock l(lock_);
+    if (log_fd_ == -1) {
+        if (!OpenUnLocked(timestamp)) {
+            DropUnLocked(len);
+            return;
+        }
+        if (rotating()) {
+            base_logging::LogRotationJob job;
+            job.current_path = current_filename_;
+            job.link_path = base_filename_;
+            job.keep_generations = keep_generations_;
+            base_logging::ScheduleLogRotation(job);
+        }
+    } else if (PREDICT_FALSE(rotating()) &&
+               ((max_file_length_ != 0 &&
+                 file_length_ + len > max_file_length_) ||
+                (rotate_interval_ != 0 && timestamp >= next_rotate_time_))) {
+        RollUnLocked(timestamp);
+        if (log_fd_ == -1) {
+            DropUnLocked(len);
+            return;
+        }
+    }
+    if (buffer_used_ + len > buffer_size_) {
+        stats.RecordBufferFill(buffer_used_);
+        struct iovec iov[2] = {
+            { buffer_, buffer_used_ },
+            { const_cast<char*>(message), len }
+        };
+        WriteUnLocked(iov, 2, buffer_messages_ + 1);
+        buffer_used_ = 0;
+        buffer_messages_ = 0;
+        next_flush_time_ = timestamp + FLAGS_logbufsecs;
     } else {
-        file_length_ += len;
-        bytes_since_flush_ += len;
+        memcpy(buffer_ + buffer_used_, message, len);
+        buffer_used_ += len;
+        ++buffer_messages_;
+        stats.RecordBufferFill(buffer_used_);
     }
+    file_length_ += len;
 
-    if ((bytes_since_flush_ >= 1000000)
-        || (base::Time::Now().ToInternalValue()>= next_flush_time_)) {
+    if (write_through_ || severity <= flush_severity_ ||
+        timestamp >= next_flush_time_) {
         FlushUnLocked();
     }
 }
 
-// A lock that allows only one thread to log at a time, to keep
-// things from getting jumbled.
-// Some other very uncommon logging operations(like changing the
-// destination file for log messages of a given severity and module)
-// also lock this mutex.
-// Please be sure that anybody who might possibly need to lock it
-// does so.
-static Mutex log_mutex;
 LogMessage::LogMessageData::LogMessageData() :
         stream_(message_text_, LogMessage::kMaxLogMessageLen, 0)
 {
 }
 
-std::ostream& LogMessage::stream()
+LogMessage::LogStream& LogMessage::stream()
 {
     return data_->stream_;
 }
 
+// Each thread keeps one LogMessageData and reuses it for every message it
+// logs, so the logging path does not allocate. A message logged while the
+// thread's data is busy (e.g. from inside an operator<< of another
+// message) falls back to a heap allocated one.
+static pthread_key_t thread_msg_data_key;
+static pthread_once_t thread_msg_data_once = PTHREAD_ONCE_INIT;
+static __thread LogMessage::LogMessageData* thread_msg_data = NULL;
+static __thread bool thread_msg_data_in_use = false;
+
+static void DeleteThreadMsgData(void* data)
+{
+    thread_msg_data = NULL;
+    delete static_cast<LogMessage::LogMessageData*>(data);
+}
+
+static void CreateThreadMsgDataKey()
+{
+    pthread_key_create(&thread_msg_data_key, DeleteThreadMsgData);
+}
+
+static LogMessage::LogMessageData* AcquireThreadMsgData()
+{
+    if (PREDICT_FALSE(thread_msg_data_in_use)) {
+        return NULL;
+    }
+    if (PREDICT_FALSE(thread_msg_data == NULL)) {
+        pthread_once(&thread_msg_data_once, CreateThreadMsgDataKey);
+        thread_msg_data = new LogMessage::LogMessageData();
+        pthread_setspecific(thread_msg_data_key, thread_msg_data);
+    }
+    thread_msg_data_in_use = true;
+    thread_msg_data->stream_.Reset();
+    return thread_msg_data;
+}
+
 LogMessage::~LogMessage()
 {
-    printf("~LogMessage\n");
     Flush();
+    if (allocated_ == NULL && data_ == thread_msg_data) {
+        thread_msg_data_in_use = false;
+    }
     delete allocated_;
 }
 
@@ -211,41 +1086,35 @@ void LogMessage::Init(const LogModule *module,
 {
     allocated_ = NULL;
     if (severity != kLS_FATAL) {
-        allocated_ = new LogMessageData();
-        data_ = allocated_;  // just another pointer named better.
+        data_ = AcquireThreadMsgData();
+        if (data_ == NULL) {
+            allocated_ = new LogMessageData();
+            data_ = allocated_;  // just another pointer named better.
+        }
         data_->first_fatal_ = false;
     } else {
         MutexLock l(fatal_msg_lock);
         data_ = &fatal_msg_data_exclusive;
+        data_->stream_.Reset();
         data_->first_fatal_ = true;
         // TODO(geshuning): record the crash reason
         // TODO(geshuning): use shared_fatal_msg or exclusive_fatal_msg
     }
-    stream().fill('0');
+    data_->preserved_errno_ = errno;
     data_->severity_ = severity;
     data_->line_ = line;
     data_->module_ = module->name.c_str();
-    double now = base::Time::Now().ToInternalValue() * 0.000001;
-    data_->timestamp_ = static_cast<time_t>(now);
-    localtime_r(&data_->timestamp_, &data_->tm_time_);
-    int usecs = static_cast<int> ((now - data_->timestamp_) * 1000000);
+    const int64 now_us = base::Time::Now().ToInternalValue();
+    data_->timestamp_ = static_cast<time_t>(now_us /
+                                            base::kMicrosecondsPerSecond);
     data_->num_chars_to_log_ = 0;
     data_->fullname_ = file;
     data_->basename_ = file;
     data_->has_been_flushed_ = false;
-    stream() << LogSeverityNames[severity][0]
-             << std::setw(2) << 1 + data_->tm_time_.tm_mon
-             << std::setw(2) << data_->tm_time_.tm_mday
-             << ' '
-             << std::setw(2) << data_->tm_time_.tm_hour << ':'
-             << std::setw(2) << data_->tm_time_.tm_min << ':'
-             << std::setw(2) << data_->tm_time_.tm_sec << ':'
-             << std::setw(6) << usecs
-             << ' '
-             << std::setfill(' ') << std::setw(5)
-             << static_cast<unsigned int> (pthread_self()) << std::setfill('0')
-             << ' '
-             << data_->basename_ << ':' << data_->line_ << "] ";
+    data_->stream_.Advance(base_logging::LogPrefixFormatter::Format(
+            data_->stream_.pbase(), LogMessage::kMaxLogMessageLen,
+            severity, now_us, base_logging::CurrentLogThreadTag(),
+            data_->basename_, data_->line_));
     data_->num_prefix_chars_ = data_->stream_.pcount();
 }
 //TODO(gene.ge): what this for??
@@ -258,19 +1127,36 @@ LogMessage::LogMessage(const char* file, int line, const CheckOpString& result)
 
 LogMessage::LogMessage(const LogModule *module, const char* file, int line,
                        LogSeverity severity)
+        : module_(module)
 {
-    if (module && (module->n_bytes >= module->max_bytes)) {
-        LOG_WARN() << "module(" << module->name << ")'s max size has exceed("
-                   << module->max_bytes << ")";
-    } else {
-        // TODO(gene.ge): add a member to indicate whether should be write
-        module_ = module;
-        Init(module, file, line, severity);
+    Init(module, file, line, severity);
+}
+
+LogMessage::LogMessage(const LogModule *module, const char* file, int line,
+                       LogSeverity severity, LogRateLimit *rate_limit)
+        : LogMessage(module, file, line, severity)
+{
+    const uint64 n_suppressed = rate_limit->TakeSuppressed();
+    if (n_suppressed != 0) {
+        stream() << "[" << n_suppressed << " suppressed] ";
     }
 }
+
+LogMessage::LogMessage(const LogModule *module, const char* file, int line,
+                       LogSeverity severity, uint64 occurrence)
+        : LogMessage(module, file, line, severity)
+{
+    data_->stream_.set_ctr(occurrence);
+}
+
+LogMessage::LogStream& operator<<(LogMessage::LogStream& os,
+                                  const PRIVATE_Counter&)
+{
+    return os << os.ctr();
+}
+
 void LogMessage::Flush() {
   if (data_->has_been_flushed_) { // TODO(geshuning): has_been_flushed_
-      printf("here1\n");
       return;
   }
   data_->num_chars_to_log_ = data_->stream_.pcount();
@@ -282,18 +1168,19 @@ void LogMessage::Flush() {
     data_->message_text_[data_->num_chars_to_log_++] = '\n';
   }
 
-  {
-    MutexLock l(log_mutex);
-    for (int i = 0; i < kLOG_DST_MAX; ++i) {
-        LogDestination *dst = module_->severity_dsts[data_->severity_][i];
-
-        printf("here1111\n");
-        if (dst) {
-            printf("here\n");
-            dst->Log(data_->severity_, data_->timestamp_,
-                     data_->message_text_, data_->num_chars_to_log_);
-        }
-    }
+  // FATAL messages are written synchronously: we are about to abort. The
+  // messages still queued for the writer go first, so they are not lost;
+  // stopping drains them under the usual locks. The lock-free Crash*
+  // paths are for the signal handler only.
+  if (data_->severity_ == kLS_FATAL) {
+      StopAsyncLogging();
+  }
+  if (data_->severity_ == kLS_FATAL ||
+      !base_logging::AsyncLogEnqueue(module_, data_->severity_,
+                                     data_->timestamp_, data_->message_text_,
+                                     data_->num_chars_to_log_)) {
+      module_->Log(data_->severity_, data_->timestamp_,
+                   data_->message_text_, data_->num_chars_to_log_);
   }
 
   if (append_newline) {
@@ -303,27 +1190,45 @@ void LogMessage::Flush() {
     errno = data_->preserved_errno_;
   }
   data_->has_been_flushed_ = true;
+  if (data_->severity_ == kLS_FATAL) {
+    LogDestination::FlushAll();
+    Fail();
+  }
+}
+
+static void DefaultFailureFunction()
+{
+    abort();
+}
+static LogFailureFunction g_failure_function = DefaultFailureFunction;
+
+void InstallFailureFunction(LogFailureFunction fail_func)
+{
+    g_failure_function = fail_func;
 }
 
 void LogMessage::Fail() {
-  // TODO(geshuning): some user-defined fail-functions
+  g_failure_function();
+  // A failure function must not return; make sure we die anyway.
   abort();
 }
-/*
-LogMessageFatal::LogMessageFatal(const char* file, int line) {
-//  : LogMessage(file, line, kLS_FATAL){
+
+LogMessageFatal::LogMessageFatal(const char* file, int line)
+        : LogMessage(&log_module_default, file, line, kLS_FATAL)
+{
 }
 
 LogMessageFatal::LogMessageFatal(const char* file, int line,
-                                 const CheckOpString& result) {
- // : LogMessage(file, line ,result) {
+                                 const CheckOpString& result)
+        : LogMessage(&log_module_default, file, line, kLS_FATAL)
+{
+  stream() << "Check failed: " << *result.str_ << " ";
 }
 
 LogMessageFatal::~LogMessageFatal() {
   Flush();
   LogMessage::Fail();
 }
-*/
 
 // global functions
 static const char* g_log_dir = "/tmp";
@@ -333,6 +1238,5 @@ void InitLoggingUtilities(const char* argv0) {
   const char* slash = strrchr(argv0, '/');
   g_program_invocation_short_name = slash ? slash + 1 : argv0;
   g_program_invocation_pid = getpid();
-  // TODO(geshuning): install failure function
-  // InstallFailuerFunction()
+  InstallFailureSignalHandler();
 }
@@ -21,10 +21,14 @@
 #ifndef BASE_LOGGING_LOGGING_HH_
 #define BASE_LOGGING_LOGGING_HH_
 
+#include <atomic>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <iostream>
 #include <iosfwd>
+#include <cstring>
 #include <sstream>
 #include <list>
 #include <cstdio>
@@ -32,6 +36,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/uio.h>
 #include <sstream>
 #include <iomanip>
 #include <map>
@@ -39,7 +44,9 @@
 #include "base/basictypes.hh"
 #include "base/compiler_specific.hh"
 #include "base/flags.hh"
+#include "base/logging/log_stats.hh"
 #include "base/logging/syslog.hh"
+#include "base/strings/string_piece.hh"
 #include "base/synchronization/lock.hh"
 #include "base/time/time.hh"
 
@@ -72,24 +79,96 @@ enum LogSeverity
 #undef LOG_SEVERITY
     kLS_MAX
 };
+const char* GetLogSeverityName(LogSeverity severity);
 
 // base_logging
 namespace base_logging {
 class LogStreamBuf : public std::streambuf {
     public:
-    LogStreamBuf(char *buf, int len) {
+    // Replaces the tail of a message that did not fit in the buffer.
+    static const char kTruncatedMarker[];
+    LogStreamBuf(char *buf, int len) : truncated_(false) {
       setp(buf, buf + len - 2);
     }
+    // Reached once the buffer is full: the rest of the message is dropped.
     virtual int_type overflow(int_type ch) {
+      Truncate();
       return ch;
     }
+    // Copies |n| bytes to the put position, truncating the message if
+    // they do not all fit.
+    void append(const char *s, size_t n) {
+      if (PREDICT_TRUE(n <= static_cast<size_t>(epptr() - pptr()))) {
+        memcpy(pptr(), s, n);
+        pbump(static_cast<int>(n));
+      } else {
+        AppendTruncated(s, n);
+      }
+    }
+    // Moves the put position |n| bytes forward, over bytes written
+    // into the buffer directly.
+    void advance(size_t n) {
+      pbump(static_cast<int>(n));
+    }
+    // Rewinds to the start of the buffer so it can be reused.
+    void reset() {
+      setp(pbase(), epptr());
+      truncated_ = false;
+    }
+    // Moves the put position back to |n| bytes from the start, dropping
+    // what follows, including a truncation marker.
+    void rewind(size_t n) {
+      reset();
+      pbump(static_cast<int>(n));
+    }
     size_t pcount() const {
       return pptr() - pbase();
     }
+    // Bytes that still fit before the message is truncated.
+    size_t available() const {
+      return epptr() - pptr();
+    }
     char* pbase() const {
       return std::streambuf::pbase();
     }
+    bool truncated() const {
+      return truncated_;
+    }
+    private:
+    void AppendTruncated(const char *s, size_t n);
+    // Overwrites the end of the buffer with kTruncatedMarker and fills it,
+    // so everything written afterwards is dropped.
+    void Truncate();
+    bool truncated_;
   };
+
+// The buffer size for file destinations: FLAGS_logbufkb, but at least a
+// page, which is also what a file written through (FLAGS_logbufkb 0) gets.
+size_t LogFileBufferSize();
+
+namespace enum_inserter {
+// Chosen by `ostream << value` only when nothing matches better. The
+// ostream's integer overloads need a promotion for an enum, so this
+// catch-all wins unless the enum has an operator<< of its own.
+struct None {};
+template <typename T>
+None operator<<(std::ostream&, const T&);
+
+template <typename T>
+struct Lacks : std::is_same<None, decltype(std::declval<std::ostream&>() <<
+                                           std::declval<const T&>())> {
+};
+}  // namespace enum_inserter
+
+// True for an unscoped enum without an operator<< of its own, which an
+// ostream would print as its integer value.
+template <typename T, bool = std::is_enum<T>::value &&
+                             std::is_convertible<T, int>::value>
+struct LogsAsInteger : std::false_type {
+};
+template <typename T>
+struct LogsAsInteger<T, true> : enum_inserter::Lacks<T> {
+};
 }  // namespace base_logging
 
 // Log Destination
@@ -98,26 +177,63 @@ enum Log_Destination {
     kLOG_DST_STDERR,
     kLOG_DST_SYSLOG,
     kLOG_DST_SOCK,
+    kLOG_DST_MMAP,
+    kLOG_DST_BINARY,
     kLOG_DST_MAX
 };
 
+struct LogBinarySite;
+
 class LogDestination {
 public:
-    LogDestination() : log_fd_(-1), type(kLOG_DST_MAX)
-    {
-    }
-    ~LogDestination()
-    {
-    }
+    LogDestination();
+    virtual ~LogDestination();
     virtual void Log(LogSeverity severity, time_t timestamp,
                      const char* message, size_t len) = 0;
+    // Takes a message of a binary log statement (see log_binary.hh). By
+    // default it is formatted as text and passed to Log().
+    virtual void LogBinary(const LogBinarySite *site, int64 timestamp_us,
+                           const char *args, size_t len);
+    // Pushes out anything the destination has buffered.
+    virtual void Flush() {}
+    // Flushes every live destination.
+    static void FlushAll();
+    // Called when the process is about to die, possibly from a signal
+    // handler and while another thread holds the destination's locks.
+    // They write a message, and anything buffered, using async-signal-safe
+    // calls only and without taking locks. By default they do nothing.
+    virtual void CrashWrite(LogSeverity severity, time_t timestamp,
+                            const char* message, size_t len) {}
+    virtual void CrashFlush() {}
+    // CrashWrite()s a message to, or CrashFlush()es, every live
+    // destination. Destinations writing to the same file as |skip_fd|,
+    // which already got the message, are left out.
+    static void CrashWriteAll(LogSeverity severity, time_t timestamp,
+                              const char* message, size_t len,
+                              int skip_fd = -1);
+    static void CrashFlushAll();
+    // Names the destination in LogStatsText() and LogStatsJson(). By
+    // default the kind of destination, e.g. "stderr".
+    virtual std::string Describe() const;
 public:
     enum Log_Destination type;
     int log_fd_;
+    // Counted by the modules that dispatch to the destination, and by the
+    // destination itself for what it drops and writes.
+    base_logging::LogDestinationStats stats;
+protected:
+    // Takes the destination off the list FlushAll() and the crash handler
+    // walk, waiting out a FlushAll() in progress. Every concrete
+    // destination calls it first thing in its destructor, before tearing
+    // down what Flush() touches; the base destructor is too late.
+    void Unregister();
 private:
     DISALLOW_COPY_AND_ASSIGN(LogDestination);
 };
 
+// Writes messages to a file through a large buffer, so that a busy
+// process makes one write per FLAGS_logbufkb of messages instead of one
+// per message.
 class LogDestinationToFile : public LogDestination {
 public:
     LogDestinationToFile(std::string name);
@@ -125,29 +241,153 @@ public:
     void FlushUnLocked();
     virtual void Log(LogSeverity severity, time_t timestamp,
                      const char* message, size_t len);
+    virtual void Flush();
+    virtual void CrashWrite(LogSeverity severity, time_t timestamp,
+                            const char* message, size_t len);
+    virtual void CrashFlush();
+    virtual std::string Describe() const;
+    // Messages at least this severe are written out immediately, along
+    // with everything buffered before them. Defaults to kLS_ERR.
+    void set_flush_severity(LogSeverity severity);
+    // Rolls to a new file once the current one would grow past
+    // |max_bytes|, or at every multiple of |interval_secs| of local time
+    // (e.g. 3600 rolls on the hour); 0 disables either trigger. While
+    // rolling, files are named "<name>.YYYYMMDD-HHMMSS.NNNN" and <name> is
+    // a symlink to the current one. The newest |keep_generations| rolled
+    // files are kept, gzip'ed if |compress|. Defaults come from
+    // FLAGS_max_log_size, FLAGS_logrotatesecs, FLAGS_logfilegenerations
+    // and FLAGS_logcompress. Takes effect when the next file is opened.
+    void SetRotation(uint64_t max_bytes, int interval_secs,
+                     int keep_generations, bool compress);
 private:
+    bool OpenUnLocked(time_t timestamp);
+    void RollUnLocked(time_t timestamp);
+    void WriteUnLocked(struct iovec* iov, int iovcnt, size_t messages);
+    void DropUnLocked(size_t len);
+    bool rotating() const {
+        return max_file_length_ != 0 || rotate_interval_ != 0;
+    }
+
   Mutex lock_;
   std::string base_filename_;
-  FILE* file_;
-  uint32_t file_length_;
-  uint32_t bytes_since_flush_;
-  uint32_t bytes_max_flush_;
-  int64_t next_flush_time_;
+  std::string current_filename_;
+  char* buffer_;
+  size_t buffer_size_;
+  // FLAGS_logbufkb was 0: every message is written as it comes.
+  bool write_through_;
+  size_t buffer_used_;
+  // Messages that ended in buffer_, counted as dropped if it is lost
+  size_t buffer_messages_;
+  uint64_t file_length_;
+  time_t next_flush_time_;
+  LogSeverity flush_severity_;
+  uint64_t max_file_length_;
+  int rotate_interval_;
+  time_t next_rotate_time_;
+  int keep_generations_;
+  bool compress_;
+  uint32_t roll_count_;
   DISALLOW_COPY_AND_ASSIGN(LogDestinationToFile);
 };
 
+// What an asynchronous producer does when its log ring is full
+enum LogOverflowPolicy {
+    kLOG_OVERFLOW_BLOCK,        // wait for the writer thread to make room
+    kLOG_OVERFLOW_DROP_OLDEST,  // discard the oldest queued records
+    kLOG_OVERFLOW_DROP_NEWEST,  // discard the message being logged
+};
+
 // module
+struct LogDestinationTable;
 class LogModule {
 public:
     const std::string name;
-    LogSeverity min_severity;
-    bool vlog_on;
-    uint32_t n_bytes;
-    uint32_t max_bytes;
-    LogDestination *severity_dsts[kLS_MAX][kLOG_DST_MAX];
+    // Change with SetMinSeverity() and SetVlogLevel(), or at runtime with
+    // LogSetModuleSeverity() and LogSetModuleVlog(), so the enabled mask
+    // follows. Atomic since the log control thread may change them.
+    std::atomic<LogSeverity> min_severity;
+    // VLOG(n) messages are logged (at INFO) if n <= vlog_level.
+    std::atomic<int> vlog_level;
+    // May be changed while threads log; each push reads it once.
+    std::atomic<LogOverflowPolicy> overflow_policy;
+    // Messages lost to overflow_policy
+    mutable std::atomic<uint64_t> n_dropped;
+    // Messages held back because the module was over its budget
+    mutable std::atomic<uint64_t> n_over_budget;
+    // Messages and bytes dispatched to destinations; see log_stats.hh.
+    mutable base_logging::LogModuleStats stats;
     LogModule(const std::string m_name);
+    ~LogModule();
+    // Log() takes no lock: it reads an immutable snapshot of the module's
+    // destinations, and these publish a new one. They return once no
+    // thread can still be writing through the old snapshot, so a removed
+    // destination may be deleted right away. Must not be called from a
+    // destination's Log().
     void AddLogDestination(LogDestination *dst, LogSeverity severity);
+    void RemoveLogDestination(LogDestination *dst, LogSeverity severity);
+    void SetMinSeverity(LogSeverity severity);
+    void SetVlogLevel(int level);
+    // True if |severity| is at least min_severity and has a destination.
+    // This is the only check a disabled log statement pays for.
+    bool IsOn(LogSeverity severity) const {
+        return enabled_.load(std::memory_order_relaxed) & (1u << severity);
+    }
+    // True if VLOG(|level|) is on: INFO is on and |level| <= vlog_level.
+    // Reads the same single atomic as IsOn().
+    bool VlogIsOn(int level) const {
+        const uint32_t enabled = enabled_.load(std::memory_order_relaxed);
+        return (enabled & (1u << kLS_INFO)) &&
+                static_cast<int>(enabled >> kVlogShift) >= level;
+    }
+    // Limits the module to |max_bytes| bytes and |max_messages| messages
+    // (0 for no limit) in every window of |window_secs| seconds, so that
+    // one chatty module can not take all of the disk bandwidth. Once over,
+    // its log statements are skipped, and counted in n_over_budget, until
+    // the window ends; the message going over is still written. FATAL
+    // messages are never held back.
+    void SetBudget(uint64_t max_bytes, uint64_t max_messages,
+                   int window_secs);
+    // False if the module has used up its budget for the current window.
+    bool WithinBudget(LogSeverity severity) const {
+        return PREDICT_TRUE(!over_budget_.load(std::memory_order_relaxed)) ||
+                severity == kLS_FATAL || CheckBudget();
+    }
+    // Writes a formatted message to every destination of |severity|.
+    void Log(LogSeverity severity, time_t timestamp,
+             const char* message, size_t len) const;
+    // Passes a message of a binary log statement to every destination of
+    // the statement's severity.
+    void LogBinary(const LogBinarySite *site, int64 timestamp_us,
+                   const char *args, size_t len) const;
+    // Like Log(), but through the destinations' CrashWrite().
+    void CrashLog(LogSeverity severity, time_t timestamp,
+                  const char* message, size_t len) const;
 private:
+    static const int kVlogShift = 16;
+    static const int kMaxVlogLevel = 0x7fff;
+    void UpdateEnabledSeverities();
+    // Makes |table| the current snapshot and frees the previous one.
+    void PublishTable(const LogDestinationTable *table);
+    // Starts a new budget window if the current one is over.
+    bool CheckBudget() const;
+    void ChargeBudget(time_t timestamp, size_t len) const;
+    // Bit N is set if severity N is enabled; the bits from kVlogShift on
+    // hold vlog_level. Static modules start out zero-initialized, so
+    // logging from another static constructor before this module has been
+    // constructed is safely disabled.
+    std::atomic<uint32_t> enabled_;
+    // The current destinations, NULL until the first one is added
+    std::atomic<const LogDestinationTable*> dst_table_;
+    // The budget, and what has been used of it since budget_window_start_.
+    // All relaxed: a window may let through a few messages too many when
+    // threads race at its start or end.
+    std::atomic<uint64_t> budget_bytes_;
+    std::atomic<uint64_t> budget_messages_;
+    std::atomic<int> budget_window_secs_;
+    mutable std::atomic<time_t> budget_window_start_;
+    mutable std::atomic<uint64_t> window_bytes_;
+    mutable std::atomic<uint64_t> window_messages_;
+    mutable std::atomic<bool> over_budget_;
     DISALLOW_COPY_AND_ASSIGN(LogModule);
 };
 
@@ -157,24 +397,135 @@ private:
         THIS_MODULE->AddLogDestination(dst, kLS_INFO);              \
     } while(0)
 
+// Token bucket for LOG_*_RL(): lets through |rate| messages per minute
+// on average, in bursts of up to |burst|. Declare one static per log
+// statement,
+//   static LogRateLimit rl(5, 20);
+//   LOG_WARN_RL(&rl) << "bad packet from " << addr;
+// and the messages over the limit are counted instead of logged; the next
+// message let through starts with "[N suppressed] ". The bucket is a
+// single atomic (the time at which it will be full again, as in GCRA), so
+// Allow() takes no lock.
+class LogRateLimit {
+public:
+    constexpr LogRateLimit(int rate, int burst)
+            : interval_us_(base::kMicrosecondsPerMinute / rate),
+              tolerance_us_(base::kMicrosecondsPerMinute / rate *
+                            (burst - 1)),
+              full_at_(0), n_suppressed_(0) {
+    }
+    // True if a message may be logged now.
+    bool Allow() {
+        const int64 now = base::TimeTicks::Now().ToInternalValue();
+        int64 full_at = full_at_.load(std::memory_order_relaxed);
+        for (;;) {
+            const int64 start = full_at > now ? full_at : now;
+            if (start - now > tolerance_us_) {
+                n_suppressed_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (full_at_.compare_exchange_weak(full_at,
+                                               start + interval_us_,
+                                               std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+    // Returns the number of messages suppressed since the last call.
+    uint64 TakeSuppressed() {
+        if (n_suppressed_.load(std::memory_order_relaxed) == 0) {
+            return 0;
+        }
+        return n_suppressed_.exchange(0, std::memory_order_relaxed);
+    }
+private:
+    const int64 interval_us_;
+    const int64 tolerance_us_;
+    std::atomic<int64> full_at_;
+    std::atomic<uint64> n_suppressed_;
+    DISALLOW_COPY_AND_ASSIGN(LogRateLimit);
+};
+
+// Call site state of LOG_EVERY_N(), LOG_FIRST_N() and LOG_EVERY_T(). Each
+// statement expands to one static LogOccurrences, which counts the times
+// the statement was reached while enabled. Lock-free: an occurrence that
+// is not logged costs one atomic increment and a compare (plus reading
+// the clock for LOG_EVERY_T()). Each method counts one occurrence and
+// returns its number, starting at 1, if it is to be logged, or 0.
+class LogOccurrences {
+public:
+    constexpr LogOccurrences() : count_(0), next_(0) {
+    }
+    // The first |n| occurrences
+    uint64 FirstN(uint64 n) {
+        const uint64 occurrence = Count();
+        return occurrence <= n ? occurrence : 0;
+    }
+    // Occurrence 1, n + 1, 2n + 1, ...
+    uint64 EveryN(uint64 n) {
+        const uint64 occurrence = Count();
+        return Claim(occurrence, occurrence, n);
+    }
+    // The first occurrence, then the first one at least |seconds| after
+    // the last one logged.
+    uint64 EveryT(double seconds) {
+        const uint64 occurrence = Count();
+        const int64 now = base::TimeTicks::Now().ToInternalValue();
+        return Claim(occurrence, now,
+                     static_cast<int64>(seconds * base::kMicrosecondsPerSecond));
+    }
+private:
+    uint64 Count() {
+        return count_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+    // Returns |occurrence| if |position| has reached next_, and moves
+    // next_ |step| past it. Only one of the threads racing for a position
+    // wins it.
+    uint64 Claim(uint64 occurrence, int64 position, int64 step) {
+        int64 next = next_.load(std::memory_order_relaxed);
+        while (PREDICT_FALSE(position >= next)) {
+            if (next_.compare_exchange_weak(next, position + step,
+                                            std::memory_order_relaxed)) {
+                return occurrence;
+            }
+        }
+        return 0;
+    }
+    std::atomic<uint64> count_;
+    // The occurrence number, or for EveryT() the time in microseconds, at
+    // which the next message is due
+    std::atomic<int64> next_;
+    DISALLOW_COPY_AND_ASSIGN(LogOccurrences);
+};
+
 class LogModule;
 class LogMessage {
 public:
     enum {kNoLogPrefix = -1};
     // LogStream begin
-    class LogStream : public std::ostream {
+    // Formats a message straight into its buffer. Integers, floating
+    // point numbers, pointers and strings are converted by hand; any other
+    // type, and any iostream manipulator, goes through a std::ostream that
+    // is only built the first time one is used. Once the ostream's
+    // formatting state is changed (std::hex, std::setw, ...) numbers go
+    // through it too, so manipulators keep working. A message longer than
+    // the buffer ends in kTruncatedMarker.
+    class LogStream {
     public:
-        LogStream(char *buf, int len, int ctr)
-                :std::ostream(NULL),
-                 streambuf_(buf, len),
+        LogStream(char *buf, int len, uint64 ctr)
+                :streambuf_(buf, len),
+                 ostream_(NULL),
                  ctr_(ctr),
                  self_(this) {
-            rdbuf(&streambuf_);
         }
-        int ctr() const {
+        ~LogStream() {
+            delete ostream_;
+        }
+        // The occurrence number printed by COUNTER
+        uint64 ctr() const {
             return ctr_;
         }
-        void set_str(int ctr) {
+        void set_ctr(uint64 ctr) {
             ctr_ = ctr;
         }
         LogStream* self() const {
@@ -189,10 +540,179 @@ public:
         char* str() const {
             return pbase();
         }
+        bool truncated() const {
+            return streambuf_.truncated();
+        }
+        size_t available() const {
+            return streambuf_.available();
+        }
+        // Accounts for |n| bytes written directly at pbase().
+        void Advance(size_t n) {
+            streambuf_.advance(n);
+        }
+        // Cuts the message back to its first |n| bytes.
+        void Rewind(size_t n) {
+            streambuf_.rewind(n);
+        }
+        // Empties the stream and restores the default formatting state,
+        // so one LogStream can serve many messages.
+        void Reset() {
+            streambuf_.reset();
+            if (ostream_ != NULL) {
+                ResetOstream();
+            }
+            ctr_ = 0;
+        }
+        // The std::ostream writing into this stream's buffer.
+        std::ostream& ostream() {
+            if (PREDICT_FALSE(ostream_ == NULL)) {
+                ostream_ = new std::ostream(&streambuf_);
+                ResetOstream();
+            }
+            return *ostream_;
+        }
+
+        LogStream& operator<<(char c) {
+            if (PREDICT_FALSE(Padded())) {
+                *ostream_ << c;
+                return *this;
+            }
+            streambuf_.append(&c, 1);
+            return *this;
+        }
+        LogStream& operator<<(const char *s) {
+            if (s == NULL) {
+                return *this << "(null)";
+            }
+            return *this << base::StringPiece(s);
+        }
+        LogStream& operator<<(char *s) {
+            return *this << const_cast<const char*>(s);
+        }
+        // Like an ostream, which prints these as strings too.
+        LogStream& operator<<(const signed char *s) {
+            return *this << reinterpret_cast<const char*>(s);
+        }
+        LogStream& operator<<(signed char *s) {
+            return *this << reinterpret_cast<const char*>(s);
+        }
+        LogStream& operator<<(const unsigned char *s) {
+            return *this << reinterpret_cast<const char*>(s);
+        }
+        LogStream& operator<<(unsigned char *s) {
+            return *this << reinterpret_cast<const char*>(s);
+        }
+        LogStream& operator<<(const std::string &s) {
+            return *this << base::StringPiece(s);
+        }
+        LogStream& operator<<(const base::StringPiece &s) {
+            if (PREDICT_FALSE(Padded())) {
+                *ostream_ << s.as_string();
+                return *this;
+            }
+            streambuf_.append(s.data(), s.size());
+            return *this;
+        }
+        LogStream& operator<<(bool b) {
+            if (PREDICT_FALSE(Formatted())) {
+                *ostream_ << b;
+                return *this;
+            }
+            return *this << (b ? '1' : '0');
+        }
+        LogStream& operator<<(short n) {
+            return *this << static_cast<int>(n);
+        }
+        LogStream& operator<<(unsigned short n) {
+            return *this << static_cast<unsigned int>(n);
+        }
+        LogStream& operator<<(int n) {
+            return AppendSigned(n);
+        }
+        LogStream& operator<<(unsigned int n) {
+            return AppendUnsigned(n);
+        }
+        LogStream& operator<<(long n) {
+            return AppendSigned(n);
+        }
+        LogStream& operator<<(unsigned long n) {
+            return AppendUnsigned(n);
+        }
+        LogStream& operator<<(long long n) {
+            return AppendSigned(n);
+        }
+        LogStream& operator<<(unsigned long long n) {
+            return AppendUnsigned(n);
+        }
+        LogStream& operator<<(float f) {
+            return *this << static_cast<double>(f);
+        }
+        LogStream& operator<<(double d);
+        LogStream& operator<<(const void *p);
+        // Any other object pointer prints its address. Function pointers
+        // are left to the ostream, which prints them as bool.
+        template <typename T>
+        typename std::enable_if<!std::is_function<T>::value,
+                                LogStream&>::type
+        operator<<(T *p) {
+            return *this << const_cast<const void*>(
+                    static_cast<const volatile void*>(p));
+        }
+
+        // Manipulators such as std::endl and std::hex.
+        LogStream& operator<<(std::ostream& (*manip)(std::ostream&)) {
+            manip(ostream());
+            return *this;
+        }
+        LogStream& operator<<(std::ios_base& (*manip)(std::ios_base&)) {
+            manip(ostream());
+            return *this;
+        }
+        // Everything else: user types with an operator<<(std::ostream&, T),
+        // std::setw(), long double, ... An unscoped enum without an
+        // operator<< of its own is formatted here as its integer value,
+        // as the ostream would.
+        template <typename T>
+        LogStream& operator<<(const T& value) {
+            return Append(value, base_logging::LogsAsInteger<T>());
+        }
+
     private:
+        // True if a std::setw() is pending on the ostream.
+        bool Padded() const {
+            return ostream_ != NULL && ostream_->width() != 0;
+        }
+        // True if the ostream no longer has its default formatting state,
+        // so numbers have to be formatted by it.
+        bool Formatted() const {
+            return ostream_ != NULL &&
+                    (ostream_->flags() != kDefaultFlags ||
+                     ostream_->width() != 0 ||
+                     ostream_->precision() != kDefaultPrecision);
+        }
+        template <typename T>
+        LogStream& Append(const T& value, std::false_type) {
+            ostream() << value;
+            return *this;
+        }
+        template <typename T>
+        LogStream& Append(const T& value, std::true_type) {
+            return *this <<
+                    static_cast<typename std::underlying_type<T>::type>(value);
+        }
+        void ResetOstream();
+        LogStream& AppendSigned(long long n);
+        LogStream& AppendUnsigned(unsigned long long n);
+
+        static const std::ios_base::fmtflags kDefaultFlags =
+                std::ios_base::skipws | std::ios_base::dec;
+        static const std::streamsize kDefaultPrecision = 6;
+
         base_logging::LogStreamBuf streambuf_;
-        int ctr_;
+        std::ostream *ostream_;
+        uint64 ctr_;
         LogStream *self_;
+        DISALLOW_COPY_AND_ASSIGN(LogStream);
     };
     // LogStream end
 public:
@@ -202,12 +722,18 @@ public:
     LogMessage(const char* file, int line, const CheckOpString& result){}
     LogMessage(const LogModule *module, const char* file, int line,
                LogSeverity severity);
+    // For LOG_*_RL(): reports the messages |rate_limit| has suppressed.
+    LogMessage(const LogModule *module, const char* file, int line,
+               LogSeverity severity, LogRateLimit *rate_limit);
+    // For LOG_EVERY_N() and friends: |occurrence| is what COUNTER prints.
+    LogMessage(const LogModule *module, const char* file, int line,
+               LogSeverity severity, uint64 occurrence);
     ~LogMessage();
     void Flush();
     static const size_t kMaxLogMessageLen;
     void SendToLog();
     void Fail();
-    std::ostream& stream();
+    LogStream& stream();
     struct LogMessageData;
 
 private:
@@ -227,28 +753,33 @@ private:
 // When CHECK failed, it will log a FATAL ERROR
 class LogMessageFatal : public LogMessage {
   public:
-    /*
   LogMessageFatal(const char* file, int line);
   LogMessageFatal(const char* file, int line, const CheckOpString& result);
   ~LogMessageFatal();
-  */
-    LogMessageFatal(const char* file, int line){}
-  LogMessageFatal(const char* file, int line, const CheckOpString& result){}
-  ~LogMessageFatal(){}
 };
 
-// Allow folks to put a counter in the LOG_EVERY_X()'ed messages. This
-// only works if ostream is a LogStream. If the ostream is not a
-// LogStream you'll get an assert saying as much at runtime.
+// LogMessage::Fail() calls |fail_func| once a FATAL message has been
+// written, instead of abort(). It must not return.
+typedef void (*LogFailureFunction)();
+void InstallFailureFunction(LogFailureFunction fail_func);
+
+// Records the program name and installs the fatal signal handler (see
+// InstallFailureSignalHandler() in log_crash.hh).
+void InitLoggingUtilities(const char* argv0);
+
+// Allow folks to put a counter in the LOG_EVERY_X()'ed messages:
+//   LOG_EVERY_N(INFO, 100) << "cache miss " << COUNTER;
+// prints the number of times the statement was reached.
 enum PRIVATE_Counter {COUNTER};
-std::ostream& operator<<(std::ostream& os, const PRIVATE_Counter&);
+LogMessage::LogStream& operator<<(LogMessage::LogStream& os,
+                                  const PRIVATE_Counter&);
 
 // Used in macro LOG_IF()
 class LogMessageVoidify {
   public:
   LogMessageVoidify() {}
   ~LogMessageVoidify() {}
-  void operator&(std::ostream&) {}
+  void operator&(LogMessage::LogStream&) {}
 };
 
 
@@ -259,19 +790,86 @@ class LogMessageVoidify {
     LOG_DEFINE_MODULE(MODULE);                                  \
     static LogModule *const THIS_MODULE = &log_module_##MODULE
 
-#define LOG_INFO() LogMessage(THIS_MODULE, \
-                              __FILE__, __LINE__, kLS_INFO).stream()
-#define LOG_WARN() LogMessage(THIS_MODULE, \
-                              __FILE__, __LINE__, kLS_WARNING).stream()
-#define LOG_ERR() LogMessage(THIS_MODULE, \
-                             __FILE__, __LINE__, kLS_ERROR).stream()
-#define LOG_FATAL() LogMessage(THIS_MODULE, \
-                               __FILE__, __LINE__, kLS_FATAL).stream()
-
-#define LOG_INFO_RL(RL)
-#define LOG_WARN_RL(RL)
-#define LOG_ERR_RL(RL)
-#define LOG_FATAL_RL(RL)
+// Log statements less severe than LOG_MIN_SEVERITY are compiled out
+// entirely. Release builds keep WARNING and above unless told otherwise,
+// e.g. with -DLOG_MIN_SEVERITY=kLS_DEBUG. Runtime control can not bring
+// back what is compiled out: a release build that should be able to turn
+// on LOG_INFO(), LOG_DEBUG() or VLOG() in the field must set it.
+#ifndef LOG_MIN_SEVERITY
+#if defined(NDEBUG)
+#define LOG_MIN_SEVERITY kLS_WARNING
+#else
+#define LOG_MIN_SEVERITY kLS_DEBUG
+#endif
+#endif
+
+// True if a message of SEVERITY logged to MODULE would be written anywhere.
+// SEVERITY is a constant at every call site, so this folds down to a single
+// test of MODULE's enabled mask (or to a constant for FATAL and for
+// compiled out severities). FATAL is always on since it must reach
+// LogMessage to abort.
+#define LOG_IS_ON(MODULE, SEVERITY)                                     \
+    ((SEVERITY) == kLS_FATAL ||                                         \
+     ((SEVERITY) <= LOG_MIN_SEVERITY && (MODULE)->IsOn(SEVERITY)))
+
+#define LOG_STREAM(MODULE, SEVERITY)                                    \
+    LogMessage(MODULE, __FILE__, __LINE__, SEVERITY).stream()
+
+// The stream expression after a disabled LOG_* is not evaluated at all,
+// and neither is it while MODULE is over its budget.
+#define LOG_MODULE_IF(MODULE, SEVERITY, condition)                      \
+    !(PREDICT_BRANCH_NOT_TAKEN(LOG_IS_ON(MODULE, SEVERITY)) && (condition) && \
+      (MODULE)->WithinBudget(SEVERITY))                                 \
+    ? (void) 0 : LogMessageVoidify() & LOG_STREAM(MODULE, SEVERITY)
+
+#define LOG_DEBUG() LOG_MODULE_IF(THIS_MODULE, kLS_DEBUG, true)
+#define LOG_INFO() LOG_MODULE_IF(THIS_MODULE, kLS_INFO, true)
+#define LOG_WARN() LOG_MODULE_IF(THIS_MODULE, kLS_WARNING, true)
+#define LOG_ERR() LOG_MODULE_IF(THIS_MODULE, kLS_ERR, true)
+#define LOG_FATAL() LOG_MODULE_IF(THIS_MODULE, kLS_FATAL, true)
+
+// Like LOG_MODULE_IF(), with messages over the LogRateLimit RL dropped.
+// The limiter is only consulted for enabled statements.
+#define LOG_MODULE_RL(MODULE, SEVERITY, RL)                             \
+    !(PREDICT_BRANCH_NOT_TAKEN(LOG_IS_ON(MODULE, SEVERITY)) &&          \
+      (MODULE)->WithinBudget(SEVERITY) && (RL)->Allow())                \
+    ? (void) 0 : LogMessageVoidify() &                                  \
+    LogMessage(MODULE, __FILE__, __LINE__, SEVERITY, RL).stream()
+
+#define LOG_DEBUG_RL(RL) LOG_MODULE_RL(THIS_MODULE, kLS_DEBUG, RL)
+#define LOG_INFO_RL(RL) LOG_MODULE_RL(THIS_MODULE, kLS_INFO, RL)
+#define LOG_WARN_RL(RL) LOG_MODULE_RL(THIS_MODULE, kLS_WARNING, RL)
+#define LOG_ERR_RL(RL) LOG_MODULE_RL(THIS_MODULE, kLS_ERR, RL)
+// A FATAL message must never be dropped.
+#define LOG_FATAL_RL(RL) LOG_FATAL()
+
+// The LogOccurrences of the statement it is expanded in.
+#define LOG_SITE_OCCURRENCES()                                          \
+    ([]() -> LogOccurrences& {                                          \
+        static LogOccurrences log_occurrences;                          \
+        return log_occurrences;                                         \
+    }())
+
+// Like LOG_MODULE_IF(), but only logs if LogOccurrences::SAMPLE picks this
+// occurrence. A statement, not an expression, so that the occurrence
+// number can be handed to the message.
+#define LOG_MODULE_SAMPLED(MODULE, SEVERITY, CONDITION, SAMPLE)         \
+    for (uint64 log_occurrence =                                        \
+                 PREDICT_BRANCH_NOT_TAKEN(LOG_IS_ON(MODULE, SEVERITY)) && \
+                 (CONDITION) ? LOG_SITE_OCCURRENCES().SAMPLE : 0;       \
+         log_occurrence != 0 && (MODULE)->WithinBudget(SEVERITY);       \
+         log_occurrence = 0)                                            \
+        LogMessage(MODULE, __FILE__, __LINE__, SEVERITY,                \
+                   log_occurrence).stream()
+
+#define LOG_MODULE_EVERY_N(MODULE, SEVERITY, N)                         \
+    LOG_MODULE_SAMPLED(MODULE, SEVERITY, true, EveryN(N))
+#define LOG_MODULE_IF_EVERY_N(MODULE, SEVERITY, CONDITION, N)           \
+    LOG_MODULE_SAMPLED(MODULE, SEVERITY, CONDITION, EveryN(N))
+#define LOG_MODULE_FIRST_N(MODULE, SEVERITY, N)                         \
+    LOG_MODULE_SAMPLED(MODULE, SEVERITY, true, FirstN(N))
+#define LOG_MODULE_EVERY_T(MODULE, SEVERITY, SECONDS)                   \
+    LOG_MODULE_SAMPLED(MODULE, SEVERITY, true, EveryT(SECONDS))
 #if 0
 #define COMPACT_LOG_INFO LogMessage(__FILE__, __LINE__)
 #define COMPACT_LOG_WARNING LogMessage(__FILE__, __LINE__, kLS_WARNING)
@@ -279,17 +877,56 @@ class LogMessageVoidify {
 #define COMPACT_LOG_FATAL LogMessage(__FILE__, __LINE__, kLS_FATAL)
 #define LOG(severity) COMPACT_LOG_##severity.stream()
 #endif
-#define LOG(severity) LogMessage().stream()
-
+// LOG(severity) and friends are for code that has no module of its own,
+// e.g. CHECK(); they log to log_module_default.
+extern LogModule log_module_default;
 #define LOG_IF(severity, condition) \
-  !(condition) ? (void) 0 : LogMessageVoidify() & LOG(severity)
+  LOG_MODULE_IF(&log_module_default, kLS_##severity, condition)
+#define LOG(severity) LOG_IF(severity, true)
+#define LOG_EVERY_N(severity, n) \
+  LOG_MODULE_EVERY_N(&log_module_default, kLS_##severity, n)
+#define LOG_IF_EVERY_N(severity, condition, n) \
+  LOG_MODULE_IF_EVERY_N(&log_module_default, kLS_##severity, condition, n)
+#define LOG_FIRST_N(severity, n) \
+  LOG_MODULE_FIRST_N(&log_module_default, kLS_##severity, n)
+#define LOG_EVERY_T(severity, seconds) \
+  LOG_MODULE_EVERY_T(&log_module_default, kLS_##severity, seconds)
 
-// TODO(geshuning):VLOG
-#define VLOG(verboselevel) LOG_IF(INFO, false)
+// Verbose logging, on for a module if VERBOSELEVEL <= its vlog_level.
+#define LOG_MODULE_VLOG(MODULE, VERBOSELEVEL)                           \
+    !(PREDICT_BRANCH_NOT_TAKEN(kLS_INFO <= LOG_MIN_SEVERITY &&          \
+                               (MODULE)->VlogIsOn(VERBOSELEVEL)) &&     \
+      (MODULE)->WithinBudget(kLS_INFO))                                 \
+    ? (void) 0 : LogMessageVoidify() & LOG_STREAM(MODULE, kLS_INFO)
+#define LOG_VLOG(verboselevel) LOG_MODULE_VLOG(THIS_MODULE, verboselevel)
+#define VLOG(verboselevel) \
+  LOG_MODULE_VLOG(&log_module_default, verboselevel)
 #define DLOG(severity) \
-  true ? (void) 0 : LogMessageVoidify() & LOG(severity)
+  true ? (void) 0 : \
+  LogMessageVoidify() & LOG_STREAM(&log_module_default, kLS_##severity)
 #define DVLOG(verboselevel) VLOG(verboselevel)
 
+// Runtime control
+// Sets the minimum severity, or the vlog level, of every module whose name
+// matches the shell wildcard |pattern| (see fnmatch(3)) and returns how
+// many did. Takes effect on the very next log statement, but only for
+// statements LOG_MIN_SEVERITY kept.
+int LogSetModuleSeverity(const std::string &pattern, LogSeverity severity);
+int LogSetModuleVlog(const std::string &pattern, int level);
+// Names of all the modules
+std::vector<std::string> LogListModules();
+
+// Asynchronous logging
+// Once started, non-FATAL messages are queued on a per-thread lock-free ring
+// and written by a dedicated writer thread, so logging threads never wait
+// on disk I/O. What happens when a ring fills up is decided per module by
+// LogModule::overflow_policy. Stopping drains everything queued so far;
+// a FATAL message stops it before it is written. Stopping from the writer
+// thread itself does nothing.
+void StartAsyncLogging();
+void StopAsyncLogging();
+bool IsAsyncLogging();
+
 namespace base {
 
 }  // namespace base
@@ -0,0 +1,273 @@
+// Micro-benchmarks for the logging hot path. Run with no arguments; each
+// benchmark prints one line with its cost per operation.
+//
+// Build with debug=no: debug builds add the base::Lock owner and lock
+// order checks to every logging lock, so their numbers say nothing
+// about release code.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <vector>
+
+#include "base/logging/log_prefix.hh"
+#include "base/logging/logging.hh"
+#include "base/synchronization/waitable_event.hh"
+#include "base/time/time.hh"
+
+LOG_DEFINE_THIS_MODULE(logging_benchmark);
+
+namespace {
+
+const int kPrefixIterations = 2000000;
+// Messages logged per LOG_INFO() benchmark, split between its threads
+const int kLogMessages = 400000;
+
+int64 NowNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64>(ts.tv_sec) * base::kNanosecondsPerSecond +
+            ts.tv_nsec;
+}
+
+// The iostream based prefix LogMessage::Init() used to build, kept as the
+// baseline for LogPrefixFormatter. It looked the thread id up for every
+// message instead of using the cached tag.
+size_t FormatPrefixWithIostream(char *buf, size_t size,
+                                LogSeverity severity, int64 now_us,
+                                const base_logging::LogThreadTag &thread,
+                                const char *file, int line)
+{
+    const unsigned int thread_id = static_cast<unsigned int>(pthread_self());
+    base_logging::LogStreamBuf streambuf(buf, size);
+    std::ostream stream(&streambuf);
+    stream.fill('0');
+    double now = now_us * 0.000001;
+    time_t timestamp = static_cast<time_t>(now);
+    struct ::tm tm_time;
+    localtime_r(&timestamp, &tm_time);
+    int usecs = static_cast<int> ((now - timestamp) * 1000000);
+    stream << GetLogSeverityName(severity)[0]
+           << std::setw(2) << 1 + tm_time.tm_mon
+           << std::setw(2) << tm_time.tm_mday
+           << ' '
+           << std::setw(2) << tm_time.tm_hour << ':'
+           << std::setw(2) << tm_time.tm_min << ':'
+           << std::setw(2) << tm_time.tm_sec << ':'
+           << std::setw(6) << usecs
+           << ' '
+           << std::setfill(' ') << std::setw(5)
+           << thread_id << std::setfill('0')
+           << ' '
+           << file << ':' << line << "] ";
+    return streambuf.pcount();
+}
+
+typedef size_t (*PrefixFunction)(char *buf, size_t size,
+                                 LogSeverity severity, int64 now_us,
+                                 const base_logging::LogThreadTag &thread,
+                                 const char *file, int line);
+
+// Only reads the clock; both prefix benchmarks pay this too.
+size_t FormatNothing(char *buf, size_t size, LogSeverity severity,
+                     int64 now_us,
+                     const base_logging::LogThreadTag &thread,
+                     const char *file, int line)
+{
+    buf[0] = '\0';
+    return 0;
+}
+
+void BenchmarkPrefix(const char *name, PrefixFunction format)
+{
+    char buf[256];
+    size_t total = 0;
+    const int64 start = NowNanos();
+    for (int i = 0; i < kPrefixIterations; ++i) {
+        const int64 now_us = base::Time::Now().ToInternalValue();
+        total += format(buf, sizeof(buf), kLS_INFO, now_us,
+                        base_logging::CurrentLogThreadTag(),
+                        __FILE__, __LINE__);
+    }
+    const int64 elapsed = NowNanos() - start;
+    printf("%-32s %8.1f ns/message (%.*s)\n", name,
+           static_cast<double>(elapsed) / kPrefixIterations,
+           static_cast<int>(total / kPrefixIterations), buf);
+}
+
+struct LogThreadArgs {
+    int iterations;
+    // LOG_INFO()s timed together; a disabled one is too quick to time
+    // on its own.
+    int batch;
+    // Threads yet to start; the last one to arrive signals |start|.
+    std::atomic<int> *waiting;
+    base::WaitableEvent *start;
+    LogModule *module;
+    // Nanoseconds per batch
+    std::vector<int64> latencies;
+};
+
+void *LogThread(void *arg)
+{
+    LogThreadArgs *args = static_cast<LogThreadArgs*>(arg);
+    args->latencies.reserve(args->iterations / args->batch);
+    // Start together, so the threads really contend. There may be more
+    // threads than CPUs, so the early ones sleep rather than spin.
+    if (args->waiting->fetch_sub(1) == 1) {
+        args->start->Signal();
+    } else {
+        args->start->Wait();
+    }
+    for (int i = 0; i < args->iterations; i += args->batch) {
+        const int64 start = NowNanos();
+        for (int j = i; j < i + args->batch; ++j) {
+            LOG_MODULE_IF(args->module, kLS_INFO, true)
+                    << "benchmark message " << j << ' ' << 3.25;
+        }
+        args->latencies.push_back(NowNanos() - start);
+    }
+    return NULL;
+}
+
+double Percentile(const std::vector<int64> &sorted, double p, int batch)
+{
+    return static_cast<double>(sorted[std::min(
+            sorted.size() - 1, static_cast<size_t>(sorted.size() * p))]) /
+            batch;
+}
+
+// Logs kLogMessages messages from |num_threads| threads through
+// THIS_MODULE, or thread i through |modules[i]|, as set up by the caller,
+// and prints the cost per message, the throughput and latency
+// percentiles.
+void BenchmarkLog(const char *name, int num_threads, int batch,
+                  LogModule *const *modules = NULL)
+{
+    std::atomic<int> waiting(num_threads);
+    base::WaitableEvent start_event(base::WaitableEvent::kManualReset,
+                                    base::WaitableEvent::kNotSignaled);
+    std::vector<LogThreadArgs> args(num_threads);
+    std::vector<pthread_t> threads(num_threads);
+    const int64 start = NowNanos();
+    for (int i = 0; i < num_threads; ++i) {
+        args[i].iterations = kLogMessages / num_threads / batch * batch;
+        args[i].batch = batch;
+        args[i].waiting = &waiting;
+        args[i].start = &start_event;
+        args[i].module = modules != NULL ? modules[i] : THIS_MODULE;
+        pthread_create(&threads[i], NULL, LogThread, &args[i]);
+    }
+    std::vector<int64> latencies;
+    int64 total = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        pthread_join(threads[i], NULL);
+        latencies.insert(latencies.end(), args[i].latencies.begin(),
+                         args[i].latencies.end());
+        total += args[i].iterations;
+    }
+    // Asynchronous messages only count once written.
+    StopAsyncLogging();
+    LogDestination::FlushAll();
+    const int64 elapsed = NowNanos() - start;
+    std::sort(latencies.begin(), latencies.end());
+    int64 sum = 0;
+    for (size_t i = 0; i < latencies.size(); ++i) {
+        sum += latencies[i];
+    }
+    printf("%-32s %8.1f ns/message %10.0f messages/s"
+           "  p50 %7.1f  p99 %7.1f  p999 %8.1f ns\n",
+           name, static_cast<double>(sum) / total,
+           total * static_cast<double>(base::kNanosecondsPerSecond) / elapsed,
+           Percentile(latencies, 0.5, batch),
+           Percentile(latencies, 0.99, batch),
+           Percentile(latencies, 0.999, batch));
+}
+
+// Runs BenchmarkLog() with LOG_INFO() going to |dst|, possibly through
+// the asynchronous writer.
+void BenchmarkLogTo(const char *name, LogDestination *dst, bool async,
+                    int num_threads)
+{
+    THIS_MODULE->AddLogDestination(dst, kLS_INFO);
+    if (async) {
+        StartAsyncLogging();
+    }
+    BenchmarkLog(name, num_threads, 1);
+    THIS_MODULE->RemoveLogDestination(dst, kLS_INFO);
+}
+
+// Runs BenchmarkLog() with every thread logging to a module and a
+// /dev/null file of its own, which should scale with the threads as
+// nothing is shared.
+void BenchmarkLogPerThread(const char *name, int num_threads)
+{
+    std::vector<LogModule*> modules(num_threads);
+    std::vector<LogDestinationToFile*> dsts(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+        char module_name[32];
+        snprintf(module_name, sizeof(module_name), "benchmark_%d", i);
+        modules[i] = new LogModule(module_name);
+        dsts[i] = new LogDestinationToFile("/dev/null");
+        modules[i]->AddLogDestination(dsts[i], kLS_INFO);
+    }
+    BenchmarkLog(name, num_threads, 1, &modules[0]);
+    for (int i = 0; i < num_threads; ++i) {
+        modules[i]->RemoveLogDestination(dsts[i], kLS_INFO);
+        delete dsts[i];
+        delete modules[i];
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+#if !defined(NDEBUG)
+    fprintf(stderr, "warning: debug build, rebuild with debug=no\n");
+#endif
+    BenchmarkPrefix("prefix/Time::Now only",
+                    FormatNothing);
+    BenchmarkPrefix("prefix/iostream",
+                    FormatPrefixWithIostream);
+    BenchmarkPrefix("prefix/LogPrefixFormatter",
+                    base_logging::LogPrefixFormatter::Format);
+
+    BenchmarkLog("LOG_INFO/disabled", 1, 1000);
+    {
+        LogDestinationToFile dst("/dev/null");
+        BenchmarkLogTo("LOG_INFO/dev/null", &dst, false, 1);
+    }
+
+    char path[] = "/tmp/logging_benchmark.XXXXXX";
+    close(mkstemp(path));
+    LogDestinationToFile dst(path);
+    const int kThreads[] = { 1, 4, 16, 64 };
+    for (size_t i = 0; i < sizeof(kThreads) / sizeof(kThreads[0]); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "LOG_INFO/file/%d threads",
+                 kThreads[i]);
+        BenchmarkLogTo(name, &dst, false, kThreads[i]);
+    }
+    for (size_t i = 0; i < sizeof(kThreads) / sizeof(kThreads[0]); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "LOG_INFO/file async/%d threads",
+                 kThreads[i]);
+        BenchmarkLogTo(name, &dst, true, kThreads[i]);
+    }
+    unlink(path);
+    for (size_t i = 0; i < sizeof(kThreads) / sizeof(kThreads[0]); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "LOG_INFO/own module/%d threads",
+                 kThreads[i]);
+        BenchmarkLogPerThread(name, kThreads[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,1404 @@
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "base/logging/async_log.hh"
+#include "base/logging/log_binary.hh"
+#include "base/logging/log_control.hh"
+#include "base/logging/log_crash.hh"
+#include "base/logging/log_kv.hh"
+#include "base/logging/log_mmap.hh"
+#include "base/logging/log_socket.hh"
+#include "base/logging/log_rotation.hh"
+#include "base/logging/logging.hh"
+#include "base/threading/thread.hh"
+#include "unit_testing/gtest-1.7.0/include/gtest/gtest.h"
+
+LOG_DEFINE_THIS_MODULE(logging_unittest);
+
+DECLARE_int32(logbufkb);
+
+namespace {
+
+// Remembers every message it is handed.
+class LogDestinationToMemory : public LogDestination {
+public:
+    LogDestinationToMemory() {
+        type = kLOG_DST_STDERR;
+    }
+    virtual ~LogDestinationToMemory() {
+        Unregister();
+    }
+    virtual void Log(LogSeverity severity, time_t timestamp,
+                     const char* message, size_t len) {
+        MutexLock l(lock_);
+        messages_.push_back(std::string(message, len));
+    }
+    std::vector<std::string> messages() {
+        MutexLock l(lock_);
+        return messages_;
+    }
+private:
+    Mutex lock_;
+    std::vector<std::string> messages_;
+};
+
+bool PushString(base_logging::LogRing *ring, const LogModule *module,
+                const std::string &s)
+{
+    return ring->TryPush(module, kLS_INFO, 0, s.data(), s.size());
+}
+
+std::string PopString(base_logging::LogRing *ring)
+{
+    std::vector<char> buf(base_logging::LogRing::kMaxRecordSize);
+    base_logging::LogRing::Record *record =
+            reinterpret_cast<base_logging::LogRing::Record*>(&buf[0]);
+    if (!ring->Pop(record)) {
+        return "";
+    }
+    return std::string(record->message(), record->len);
+}
+
+}  // namespace
+
+TEST(LogRingTest, PushPopInOrder)
+{
+    base_logging::LogRing ring(4096);
+    EXPECT_TRUE(ring.empty());
+    EXPECT_TRUE(PushString(&ring, THIS_MODULE, "first"));
+    EXPECT_TRUE(PushString(&ring, THIS_MODULE, "second"));
+    EXPECT_EQ("first", PopString(&ring));
+    EXPECT_EQ("second", PopString(&ring));
+    EXPECT_TRUE(ring.empty());
+    EXPECT_EQ("", PopString(&ring));
+}
+
+TEST(LogRingTest, WrapsAroundAndReportsFull)
+{
+    base_logging::LogRing ring(256);
+    const std::string message(100, 'x');
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_TRUE(PushString(&ring, THIS_MODULE, message));
+        EXPECT_EQ(message, PopString(&ring));
+    }
+    EXPECT_TRUE(PushString(&ring, THIS_MODULE, message));
+    EXPECT_FALSE(PushString(&ring, THIS_MODULE, std::string(200, 'y')));
+}
+
+TEST(LogRingTest, DiscardOldest)
+{
+    base_logging::LogRing ring(256);
+    EXPECT_TRUE(PushString(&ring, THIS_MODULE, "old"));
+    EXPECT_TRUE(PushString(&ring, THIS_MODULE, "new"));
+    const LogModule *victim = NULL;
+    EXPECT_TRUE(ring.DiscardOldest(&victim));
+    EXPECT_EQ(THIS_MODULE, victim);
+    EXPECT_EQ("new", PopString(&ring));
+    EXPECT_FALSE(ring.DiscardOldest(&victim));
+}
+
+namespace {
+
+struct DropOldestArgs {
+    base_logging::LogRing *ring;
+    std::atomic<bool> done;
+};
+
+// Message |len| bytes long, every byte telling its length.
+std::string DropOldestMessage(size_t len)
+{
+    return std::string(len, static_cast<char>('a' + len % 26));
+}
+
+void *PushDroppingOldest(void *arg)
+{
+    DropOldestArgs *args = static_cast<DropOldestArgs*>(arg);
+    for (int i = 0; i < 200000; ++i) {
+        const std::string message = DropOldestMessage(1 + i % 300);
+        const LogModule *victim = NULL;
+        while (!PushString(args->ring, THIS_MODULE, message)) {
+            args->ring->DiscardOldest(&victim);
+        }
+    }
+    args->done = true;
+    return NULL;
+}
+
+}  // namespace
+
+// The consumer keeps losing the tail to the producer's DiscardOldest()
+// and reading headers as they are overwritten; whatever it pops must
+// still be a whole record.
+TEST(LogRingTest, PopRacesDiscardOldest)
+{
+    base_logging::LogRing ring(1024);
+    DropOldestArgs args;
+    args.ring = &ring;
+    args.done = false;
+    pthread_t producer;
+    pthread_create(&producer, NULL, PushDroppingOldest, &args);
+    int popped = 0;
+    int torn = 0;
+    while (!args.done.load() || !ring.empty()) {
+        const std::string message = PopString(&ring);
+        if (message.empty()) {
+            continue;
+        }
+        ++popped;
+        if (message != DropOldestMessage(message.size())) {
+            ++torn;
+        }
+    }
+    pthread_join(producer, NULL);
+    EXPECT_LT(0, popped);
+    EXPECT_EQ(0, torn);
+}
+
+static void *LogFromThread(void *arg)
+{
+    for (int i = 0; i < 1000; ++i) {
+        LOG_INFO() << "message " << i;
+    }
+    return NULL;
+}
+
+TEST(AsyncLoggingTest, DeliversEveryMessage)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    StartAsyncLogging();
+    EXPECT_TRUE(IsAsyncLogging());
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i) {
+        pthread_create(&threads[i], NULL, LogFromThread, NULL);
+    }
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    StopAsyncLogging();
+    EXPECT_FALSE(IsAsyncLogging());
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(4000u, messages.size());
+    EXPECT_EQ(0u, THIS_MODULE->n_dropped.load());
+    EXPECT_NE(std::string::npos, messages.back().find("message 999\n"));
+}
+
+namespace {
+
+pthread_key_t late_log_key;
+
+// Runs after the async ring's own key destructor, which was created first.
+void LogFromKeyDestructor(void *)
+{
+    LOG_INFO() << "from key destructor";
+}
+
+void *LogThenExit(void *)
+{
+    LOG_INFO() << "before exit";
+    pthread_setspecific(late_log_key, &late_log_key);
+    return NULL;
+}
+
+}  // namespace
+
+TEST(AsyncLoggingTest, LogsAfterRingIsOrphaned)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    StartAsyncLogging();
+    LOG_INFO() << "creates the ring key";
+    pthread_key_create(&late_log_key, LogFromKeyDestructor);
+    pthread_t thread;
+    pthread_create(&thread, NULL, LogThenExit, NULL);
+    pthread_join(thread, NULL);
+    StopAsyncLogging();
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+    pthread_key_delete(late_log_key);
+
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(3u, messages.size());
+    // Written synchronously, so possibly ahead of the queued ones.
+    int late = 0;
+    for (size_t i = 0; i < messages.size(); ++i) {
+        late += messages[i].find("from key destructor\n") != std::string::npos;
+    }
+    EXPECT_EQ(1, late);
+}
+
+namespace {
+
+// Logs while it is being streamed into another message.
+struct LogsWhileStreamed {
+};
+
+std::ostream& operator<<(std::ostream& os, const LogsWhileStreamed&)
+{
+    LOG_INFO() << "inner";
+    return os << "outer";
+}
+
+}  // namespace
+
+TEST(LogMessageTest, NestedLoggingFromOperator)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    LOG_INFO() << "before";
+    LOG_INFO() << LogsWhileStreamed();
+    LOG_INFO() << std::hex << 255;
+    LOG_INFO() << 255;
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(5u, messages.size());
+    EXPECT_NE(std::string::npos, messages[0].find("] before\n"));
+    EXPECT_NE(std::string::npos, messages[1].find("] inner\n"));
+    EXPECT_NE(std::string::npos, messages[2].find("] outer\n"));
+    EXPECT_NE(std::string::npos, messages[3].find("] ff\n"));
+    // Formatting state does not leak into the next message.
+    EXPECT_NE(std::string::npos, messages[4].find("] 255\n"));
+}
+
+namespace {
+
+struct Point {
+    int x;
+    int y;
+};
+
+std::ostream& operator<<(std::ostream& os, const Point& p)
+{
+    return os << '(' << p.x << ',' << p.y << ')';
+}
+
+// The text after the prefix, without the trailing newline.
+std::string MessageBody(const std::string &message)
+{
+    const size_t start = message.find("] ") + 2;
+    return message.substr(start, message.size() - start - 1);
+}
+
+}  // namespace
+
+TEST(LogMessageTest, FormatsWithoutIostreams)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    LOG_INFO() << 0 << ' ' << -42 << ' ' << 18446744073709551615ULL << ' '
+               << (-9223372036854775807LL - 1) << ' ' << true;
+    LOG_INFO() << 1.5 << ' ' << 0.1f << ' ' << 1e20 << ' ' << 3.14159265;
+    LOG_INFO() << static_cast<const void*>(NULL) << ' '
+               << reinterpret_cast<const void*>(0xbeef);
+    LOG_INFO() << std::string("str") << ' ' << base::StringPiece("piece", 2)
+               << ' ' << static_cast<const char*>(NULL);
+    LOG_INFO() << Point{1, 2} << ' ' << std::setw(4) << 7 << ' ' << 7;
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(5u, messages.size());
+    EXPECT_EQ("0 -42 18446744073709551615 -9223372036854775808 1",
+              MessageBody(messages[0]));
+    EXPECT_EQ("1.5 0.1 1e+20 3.14159", MessageBody(messages[1]));
+    EXPECT_EQ("0 0xbeef", MessageBody(messages[2]));
+    EXPECT_EQ("str pi (null)", MessageBody(messages[3]));
+    EXPECT_EQ("(1,2) 0007 7", MessageBody(messages[4]));
+}
+
+namespace {
+
+enum Color { kRed, kGreen = 7 };
+enum Offset : short { kBack = -3 };
+enum Named { kOff, kOn };
+
+std::ostream& operator<<(std::ostream &os, Named named)
+{
+    return os << (named == kOn ? "on" : "off");
+}
+
+void NoOp()
+{
+}
+
+}  // namespace
+
+TEST(LogMessageTest, FormatsPointersAndEnums)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    char text[] = "chars";
+    int *int_pointer = reinterpret_cast<int*>(0xbeef);
+    const volatile long *volatile_pointer =
+            reinterpret_cast<const volatile long*>(0xf00d);
+    LOG_INFO() << text << ' ' << reinterpret_cast<unsigned char*>(text) << ' '
+               << int_pointer << ' ' << volatile_pointer << ' '
+               << static_cast<int*>(NULL) << ' ' << &NoOp;
+    LOG_INFO() << kRed << ' ' << kGreen << ' ' << kBack << ' ' << kOn;
+    LOG_INFO() << 42.0 << ' ' << -999999.0 << ' ' << 1e6 << ' ' << 0.0
+               << ' ' << -0.0 << ' ' << 2.5;
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(3u, messages.size());
+    EXPECT_EQ("chars chars 0xbeef 0xf00d 0 1", MessageBody(messages[0]));
+    EXPECT_EQ("0 7 -3 on", MessageBody(messages[1]));
+    EXPECT_EQ("42 -999999 1e+06 0 -0 2.5", MessageBody(messages[2]));
+}
+
+TEST(LogMessageTest, MarksTruncatedMessages)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    const std::string big(LogMessage::kMaxLogMessageLen, 'x');
+    LOG_INFO() << big << "lost";
+    LOG_INFO() << "short";
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(2u, messages.size());
+    const std::string marker = base_logging::LogStreamBuf::kTruncatedMarker;
+    EXPECT_EQ(LogMessage::kMaxLogMessageLen - 1, messages[0].size());
+    EXPECT_EQ(marker + "\n",
+              messages[0].substr(messages[0].size() - marker.size() - 1));
+    EXPECT_EQ(std::string::npos, messages[0].find("lost"));
+    // The next message on this thread starts out untruncated.
+    EXPECT_EQ("short", MessageBody(messages[1]));
+}
+
+namespace {
+
+class LoggingThread : public base::Thread {
+public:
+    explicit LoggingThread(const std::string &name) :
+            base::Thread(name), tid_(0) {}
+    virtual ~LoggingThread() {
+        Stop();
+    }
+    pid_t tid() const {
+        return tid_;
+    }
+
+protected:
+    virtual void Run() {
+        tid_ = static_cast<pid_t>(syscall(SYS_gettid));
+        LOG_INFO() << "from " << ThreadName();
+    }
+
+private:
+    pid_t tid_;
+};
+
+}  // namespace
+
+TEST(LogMessageTest, PrefixNamesTheThread)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    LoggingThread thread("prefix worker thread");
+    ASSERT_TRUE(thread.Start());
+    thread.Stop();
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(1u, messages.size());
+    // Spaces become underscores and the name is cut at 15 characters.
+    char tag[64];
+    snprintf(tag, sizeof(tag), " %5d prefix_worker_t ",
+             static_cast<int>(thread.tid()));
+    EXPECT_NE(std::string::npos, messages[0].find(tag)) << messages[0];
+    EXPECT_EQ("from prefix worker thread", MessageBody(messages[0]));
+}
+
+namespace {
+
+int evaluations = 0;
+
+int Evaluate()
+{
+    return ++evaluations;
+}
+
+}  // namespace
+
+TEST(LogMessageTest, DisabledStatementsAreNotEvaluated)
+{
+    evaluations = 0;
+    // No destination at all.
+    LOG_INFO() << Evaluate();
+    EXPECT_EQ(0, evaluations);
+
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    THIS_MODULE->AddLogDestination(&dst, kLS_DEBUG);
+    EXPECT_TRUE(THIS_MODULE->IsOn(kLS_INFO));
+    // DEBUG has a destination but is below min_severity.
+    EXPECT_FALSE(THIS_MODULE->IsOn(kLS_DEBUG));
+    LOG_DEBUG() << Evaluate();
+    EXPECT_EQ(0, evaluations);
+    LOG_INFO() << Evaluate();
+    EXPECT_EQ(1, evaluations);
+
+    THIS_MODULE->SetMinSeverity(kLS_DEBUG);
+    LOG_DEBUG() << Evaluate();
+    EXPECT_EQ(2, evaluations);
+    THIS_MODULE->SetMinSeverity(kLS_INFO);
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_DEBUG);
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+    EXPECT_FALSE(THIS_MODULE->IsOn(kLS_INFO));
+    EXPECT_EQ(2u, dst.messages().size());
+}
+
+TEST(LogMessageTest, SampledStatements)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    for (int i = 0; i < 10; ++i) {
+        LOG_MODULE_EVERY_N(THIS_MODULE, kLS_INFO, 4) << "every " << COUNTER;
+        LOG_MODULE_FIRST_N(THIS_MODULE, kLS_INFO, 2) << "first " << COUNTER;
+        LOG_MODULE_IF_EVERY_N(THIS_MODULE, kLS_INFO, i % 2 == 1, 2)
+                << "odd " << i;
+        LOG_MODULE_EVERY_T(THIS_MODULE, kLS_INFO, 3600)
+                << "hourly " << COUNTER;
+    }
+    if (false)
+        LOG_MODULE_EVERY_N(THIS_MODULE, kLS_INFO, 1) << "never";
+    else
+        LOG_INFO() << "else";
+    // Disabled statements are neither counted nor evaluated.
+    evaluations = 0;
+    for (int i = 0; i < 10; ++i) {
+        LOG_MODULE_EVERY_N(THIS_MODULE, kLS_DEBUG, 1) << Evaluate();
+    }
+    EXPECT_EQ(0, evaluations);
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    const char *expected[] = {
+        "every 1", "first 1", "hourly 1", "first 2", "odd 1",
+        "every 5", "odd 5", "every 9", "odd 9", "else",
+    };
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(arraysize(expected), messages.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+        EXPECT_EQ(expected[i], MessageBody(messages[i]));
+    }
+}
+
+TEST(LogMessageTest, KeyValueRecords)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    const std::string user = "j. doe";
+    for (int i = 0; i < 2; ++i) {
+        SetLogKVFormat(i == 0 ? kLOG_KV_LOGFMT : kLOG_KV_JSON);
+        LOG_INFO_KV("login", kv("user", user), kv("id", 42u),
+                    kv("delta", -7), kv("ok", true), kv("ratio", 0.25),
+                    kv("note", "say \"hi\"\n"), kv("at", Point{1, 2}));
+        LOG_INFO_KV("empty", kv("s", ""), kv("p",
+                    static_cast<const char*>(NULL)));
+    }
+    SetLogKVFormat(kLOG_KV_LOGFMT);
+    evaluations = 0;
+    LOG_DEBUG_KV("disabled", kv("n", Evaluate()));
+    EXPECT_EQ(0, evaluations);
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(4u, messages.size());
+    EXPECT_EQ("event=login user=\"j. doe\" id=42 delta=-7 ok=true "
+              "ratio=0.25 note=\"say \\\"hi\\\"\\n\" at=(1,2)",
+              MessageBody(messages[0]));
+    EXPECT_EQ("event=empty s=\"\" p=\"\"", MessageBody(messages[1]));
+    EXPECT_EQ("{\"event\":\"login\",\"user\":\"j. doe\",\"id\":42,"
+              "\"delta\":-7,\"ok\":true,\"ratio\":0.25,"
+              "\"note\":\"say \\\"hi\\\"\\n\",\"at\":\"(1,2)\"}",
+              MessageBody(messages[2]));
+    EXPECT_EQ("{\"event\":\"empty\",\"s\":\"\",\"p\":null}",
+              MessageBody(messages[3]));
+}
+
+TEST(LogMessageTest, KeyValueKeysAndTruncation)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    const std::string big(LogMessage::kMaxLogMessageLen, 'x');
+    for (int i = 0; i < 2; ++i) {
+        SetLogKVFormat(i == 0 ? kLOG_KV_LOGFMT : kLOG_KV_JSON);
+        LOG_INFO_KV("keys", kv("a b", 1), kv("x=\"y\"", 2), kv("", 3));
+        LOG_INFO_KV("big", kv("n", 1), kv("s", big), kv("after", 2));
+        LOG_INFO_KV(big.c_str());
+    }
+    SetLogKVFormat(kLOG_KV_LOGFMT);
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(6u, messages.size());
+    EXPECT_EQ("event=keys a_b=1 x__y_=2 _=3", MessageBody(messages[0]));
+    EXPECT_EQ("event=big n=1 truncated=true", MessageBody(messages[1]));
+    EXPECT_EQ("truncated=true", MessageBody(messages[2]));
+    EXPECT_EQ("{\"event\":\"keys\",\"a b\":1,\"x=\\\"y\\\"\":2,\"\":3}",
+              MessageBody(messages[3]));
+    EXPECT_EQ("{\"event\":\"big\",\"n\":1,\"truncated\":true}",
+              MessageBody(messages[4]));
+    EXPECT_EQ("{\"truncated\":true}", MessageBody(messages[5]));
+}
+
+TEST(LogMessageTest, KeyValueDoublesRoundTrip)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    LOG_INFO_KV("doubles", kv("tenth", 0.1), kv("pi", 3.141592653589793),
+                kv("third", 1.0 / 3), kv("big", 1e300));
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(1u, messages.size());
+    EXPECT_EQ("event=doubles tenth=0.1 pi=3.141592653589793 "
+              "third=0.3333333333333333 big=1e+300",
+              MessageBody(messages[0]));
+}
+
+namespace {
+
+std::string ReadFile(const std::string &path)
+{
+    std::string contents;
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == NULL) {
+        return contents;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        contents.append(buf, n);
+    }
+    fclose(file);
+    return contents;
+}
+
+size_t CountOccurrences(const std::string &s, const std::string &what)
+{
+    size_t count = 0;
+    for (size_t pos = s.find(what); pos != std::string::npos;
+         pos = s.find(what, pos + what.size())) {
+        ++count;
+    }
+    return count;
+}
+
+}  // namespace
+
+TEST(LogDestinationToFileTest, BuffersUntilFlush)
+{
+    char path[] = "/tmp/logging_unittest.XXXXXX";
+    close(mkstemp(path));
+    {
+        LogDestinationToFile dst(path);
+        dst.Log(kLS_INFO, time(NULL), "one\n", 4);
+        dst.Log(kLS_INFO, time(NULL), "two\n", 4);
+        EXPECT_EQ("", ReadFile(path));
+        dst.Flush();
+        std::string contents = ReadFile(path);
+        EXPECT_EQ(1u, CountOccurrences(contents, "Log file created at:"));
+        EXPECT_NE(std::string::npos, contents.find("\n\none\ntwo\n"));
+
+        // Severe messages are written out right away.
+        dst.Log(kLS_ERR, time(NULL), "three\n", 6);
+        contents = ReadFile(path);
+        EXPECT_NE(std::string::npos, contents.find("two\nthree\n"));
+        EXPECT_EQ(1u, CountOccurrences(contents, "Log file created at:"));
+    }
+    unlink(path);
+}
+
+TEST(LogDestinationToFileTest, ZeroBufferWritesThrough)
+{
+    char path[] = "/tmp/logging_unittest.XXXXXX";
+    close(mkstemp(path));
+    const int saved_logbufkb = FLAGS_logbufkb;
+    FLAGS_logbufkb = 0;
+    {
+        LogDestinationToFile dst(path);
+        dst.Log(kLS_INFO, time(NULL), "one\n", 4);
+        std::string contents = ReadFile(path);
+        EXPECT_EQ(0u, contents.find("Log file created at:"));
+        EXPECT_EQ(contents.size() - 6, contents.find("\n\none\n"));
+        dst.Log(kLS_INFO, time(NULL), "two\n", 4);
+        EXPECT_NE(std::string::npos, ReadFile(path).find("\n\none\ntwo\n"));
+    }
+    FLAGS_logbufkb = saved_logbufkb;
+    unlink(path);
+}
+
+TEST(LogDestinationToFileTest, CountsLostMessages)
+{
+    {
+        // Writes to /dev/full fail with ENOSPC.
+        LogDestinationToFile dst("/dev/full");
+        dst.Log(kLS_INFO, time(NULL), "one\n", 4);
+        dst.Log(kLS_INFO, time(NULL), "two\n", 4);
+        dst.Flush();
+        EXPECT_EQ(2u, dst.stats.dropped.Value());
+        EXPECT_LT(8u, dst.stats.dropped_bytes.Value());
+    }
+    {
+        LogDestinationToFile dst("/nonexistent/logging_unittest.log");
+        dst.Log(kLS_INFO, time(NULL), "one\n", 4);
+        EXPECT_EQ(1u, dst.stats.dropped.Value());
+        EXPECT_EQ(4u, dst.stats.dropped_bytes.Value());
+    }
+}
+
+TEST(LogDestinationToFileTest, MessagesLargerThanBuffer)
+{
+    char path[] = "/tmp/logging_unittest.XXXXXX";
+    close(mkstemp(path));
+    const std::string big(LogMessage::kMaxLogMessageLen, 'b');
+    {
+        LogDestinationToFile dst(path);
+        for (int i = 0; i < 20; ++i) {
+            dst.Log(kLS_INFO, time(NULL), big.data(), big.size());
+        }
+    }
+    EXPECT_EQ(20u, CountOccurrences(ReadFile(path), big));
+    unlink(path);
+}
+
+TEST(LogDestinationToFileTest, RotatesAndCompresses)
+{
+    char dir[] = "/tmp/logging_unittest.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    const std::string link = std::string(dir) + "/rotating.log";
+    const std::string message(100, 'r');
+    {
+        LogDestinationToFile dst(link);
+        dst.SetRotation(1000, 0, 2, true);
+        for (int i = 0; i < 50; ++i) {
+            dst.Log(kLS_INFO, time(NULL), message.data(), message.size());
+        }
+        dst.Flush();
+        base_logging::StopLogRotation();
+
+        char target[256];
+        ssize_t n = readlink(link.c_str(), target, sizeof(target) - 1);
+        ASSERT_GT(n, 0);
+        target[n] = '\0';
+        const std::string current = std::string(dir) + "/" + target;
+        EXPECT_NE(std::string::npos, ReadFile(current).find(message));
+    }
+
+    int plain = 0;
+    int compressed = 0;
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0) {
+            ++compressed;
+        } else if (name != "rotating.log") {
+            ++plain;
+        }
+        unlink((std::string(dir) + "/" + name).c_str());
+    }
+    closedir(d);
+    rmdir(dir);
+    // The current file plus two compressed generations.
+    EXPECT_EQ(1, plain);
+    EXPECT_EQ(2, compressed);
+}
+
+namespace {
+
+struct MmapWriterArgs {
+    LogDestinationToMmap *dst;
+    int id;
+};
+
+void *LogToMmap(void *arg)
+{
+    MmapWriterArgs *args = static_cast<MmapWriterArgs*>(arg);
+    for (int i = 0; i < 1000; ++i) {
+        char message[64];
+        int len = snprintf(message, sizeof(message), "writer %d message %d\n",
+                           args->id, i);
+        args->dst->Log(kLS_INFO, time(NULL), message, len);
+    }
+    return NULL;
+}
+
+std::string PrintSegment(const std::string &path)
+{
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&buf, &size);
+    PrintLogSegment(path, out);
+    fclose(out);
+    std::string contents(buf, size);
+    free(buf);
+    return contents;
+}
+
+}  // namespace
+
+TEST(LogDestinationToMmapTest, ConcurrentWritersAcrossSegments)
+{
+    char dir[] = "/tmp/logging_unittest.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    const std::string base = std::string(dir) + "/mmap.log";
+    {
+        LogDestinationToMmap dst(base, 16 * 1024);
+        pthread_t threads[4];
+        MmapWriterArgs args[4];
+        for (int i = 0; i < 4; ++i) {
+            args[i].dst = &dst;
+            args[i].id = i;
+            pthread_create(&threads[i], NULL, LogToMmap, &args[i]);
+        }
+        for (int i = 0; i < 4; ++i) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    std::string contents;
+    int segments = 0;
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        const std::string path = std::string(dir) + "/" + name;
+        contents += PrintSegment(path);
+        ++segments;
+        unlink(path.c_str());
+    }
+    closedir(d);
+    rmdir(dir);
+    EXPECT_GT(segments, 4);
+    EXPECT_EQ(4000u, CountOccurrences(contents, "\n"));
+    EXPECT_EQ(1u, CountOccurrences(contents, "writer 3 message 999\n"));
+}
+
+TEST(LogDestinationToMmapTest, CrashWriteAppendsToCurrentSegment)
+{
+    char dir[] = "/tmp/logging_unittest.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    const std::string base = std::string(dir) + "/mmap.log";
+    const std::string segment = base + ".000000";
+    {
+        LogDestinationToMmap dst(base, 4096);
+        dst.Log(kLS_INFO, time(NULL), "before\n", 7);
+        dst.CrashWrite(kLS_FATAL, time(NULL), "crash\n", 6);
+        dst.CrashFlush();
+        // A full segment drops crash messages instead of switching.
+        const std::string big(1000, 'x');
+        for (int i = 0; i < 8; ++i) {
+            dst.CrashWrite(kLS_FATAL, time(NULL), big.data(), big.size());
+        }
+    }
+    const std::string contents = PrintSegment(segment);
+    unlink(segment.c_str());
+    unlink((base + ".000001").c_str());
+    rmdir(dir);
+    EXPECT_EQ(0u, contents.find("before\ncrash\n"));
+    EXPECT_EQ(4u, CountOccurrences(contents, std::string(1000, 'x')));
+}
+
+TEST(LogDestinationToMmapTest, RecoverTrimsPartialRecords)
+{
+    char dir[] = "/tmp/logging_unittest.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    const std::string base = std::string(dir) + "/mmap.log";
+    const std::string segment = base + ".000000";
+    {
+        // Fake a crash: three records, the middle one never committed,
+        // followed by unused preallocated space.
+        std::vector<char> image(4096, 0);
+        const char *messages[] = { "first\n", "torn\n", "third\n" };
+        size_t offset = 0;
+        for (int i = 0; i < 3; ++i) {
+            LogSegmentRecord *record =
+                    reinterpret_cast<LogSegmentRecord*>(&image[offset]);
+            record->len = strlen(messages[i]);
+            memcpy(&image[offset + sizeof(*record)], messages[i],
+                   record->len);
+            if (i != 1) {
+                record->commit = kLogRecordCommitted ^ record->len;
+            }
+            offset += (sizeof(*record) + record->len + 7) & ~7;
+        }
+        FILE *file = fopen(segment.c_str(), "w");
+        fwrite(&image[0], 1, image.size(), file);
+        fclose(file);
+    }
+    uint64 valid_bytes = 0;
+    ASSERT_TRUE(RecoverLogSegment(segment, &valid_bytes));
+    EXPECT_EQ(48u, valid_bytes);
+    EXPECT_EQ(48u, ReadFile(segment).size());
+    EXPECT_EQ("first\nthird\n", PrintSegment(segment));
+
+    // Logging again starts a new segment after the recovered one.
+    {
+        LogDestinationToMmap dst(base, 4096);
+        dst.Log(kLS_INFO, time(NULL), "after\n", 6);
+    }
+    EXPECT_EQ("after\n", PrintSegment(base + ".000001"));
+    EXPECT_EQ("first\nthird\n", PrintSegment(segment));
+    unlink(segment.c_str());
+    unlink((base + ".000001").c_str());
+    rmdir(dir);
+}
+
+TEST(LogDestinationToMmapTest, RecoverStepsOverHoles)
+{
+    char dir[] = "/tmp/logging_unittest.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    const std::string segment = std::string(dir) + "/mmap.log.000000";
+    {
+        // A thread died after reserving 24 bytes but before writing the
+        // header, while another went on to commit a record after them.
+        std::vector<char> image(4096, 0);
+        const char *messages[] = { "first\n", NULL, "third\n" };
+        size_t offset = 0;
+        for (int i = 0; i < 3; ++i) {
+            if (messages[i] == NULL) {
+                offset += 24;
+                continue;
+            }
+            LogSegmentRecord *record =
+                    reinterpret_cast<LogSegmentRecord*>(&image[offset]);
+            record->len = strlen(messages[i]);
+            memcpy(&image[offset + sizeof(*record)], messages[i],
+                   record->len);
+            record->commit = kLogRecordCommitted ^ record->len;
+            offset += (sizeof(*record) + record->len + 7) & ~7;
+        }
+        FILE *file = fopen(segment.c_str(), "w");
+        fwrite(&image[0], 1, image.size(), file);
+        fclose(file);
+    }
+    uint64 valid_bytes = 0;
+    ASSERT_TRUE(RecoverLogSegment(segment, &valid_bytes));
+    EXPECT_EQ(56u, valid_bytes);
+    EXPECT_EQ("first\nthird\n", PrintSegment(segment));
+    // Recovering again finds the hole already marked.
+    ASSERT_TRUE(RecoverLogSegment(segment, &valid_bytes));
+    EXPECT_EQ(56u, valid_bytes);
+    EXPECT_EQ("first\nthird\n", PrintSegment(segment));
+    unlink(segment.c_str());
+    rmdir(dir);
+}
+
+TEST(LogBinaryTest, TextDestinationsGetFormattedMessages)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    const char *null_string = NULL;
+    LOG_INFO_BIN("int %d uint %u long %ld hex %#llx char %c", -1, 2u, -3L,
+                 0xabcULL, 'z');
+    LOG_INFO_BIN("%s %5.1f %-4s| %.*s %s %%", "str", 2.25, "ab", 3, "abcdef",
+                 null_string);
+    LOG_INFO_BIN("no arguments");
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+
+    const std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(3u, messages.size());
+    EXPECT_EQ('I', messages[0][0]);
+    EXPECT_NE(std::string::npos, messages[0].find("logging_unittest.cc:"));
+    EXPECT_NE(std::string::npos, messages[0].find(
+            "] int -1 uint 2 long -3 hex 0xabc char z\n"));
+    EXPECT_NE(std::string::npos, messages[1].find(
+            "] str   2.2 ab  | abc (null) %\n"));
+    EXPECT_NE(std::string::npos, messages[2].find("] no arguments\n"));
+}
+
+TEST(LogBinaryTest, DecodesBinaryFile)
+{
+    char path[] = "/tmp/logging_unittest.XXXXXX";
+    close(mkstemp(path));
+    {
+        LogDestinationToBinaryFile dst(path);
+        THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+        for (int i = 0; i < 3; ++i) {
+            LOG_INFO_BIN("binary %d of %s", i, "three");
+        }
+        LOG_INFO() << "text";
+        THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+    }
+    // The format is stored once, not per message.
+    EXPECT_EQ(1u, CountOccurrences(ReadFile(path), "binary %d of %s"));
+
+    FILE *in = fopen(path, "rb");
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&buf, &size);
+    EXPECT_TRUE(base_logging::DecodeBinaryLog(in, out));
+    fclose(out);
+    fclose(in);
+    const std::string text(buf, size);
+    free(buf);
+    unlink(path);
+    EXPECT_EQ(4u, CountOccurrences(text, "\n"));
+    EXPECT_NE(std::string::npos, text.find("] binary 0 of three\n"));
+    EXPECT_NE(std::string::npos, text.find("] binary 2 of three\n"));
+    EXPECT_NE(std::string::npos, text.find("] text\n"));
+}
+
+TEST(LogBinaryTest, RewritesSitesLostInFailedFlush)
+{
+    // Writes to /dev/full fail with ENOSPC.
+    LogDestinationToBinaryFile dst("/dev/full");
+    THIS_MODULE->AddLogDestination(&dst, kLS_INFO);
+    LOG_INFO_BIN("lost site %d", 1);
+    dst.Flush();
+    const uint64 first_loss = dst.stats.dropped_bytes.Value();
+    // Same site again: its definition, which names this file, has to be
+    // written along with the message.
+    LOG_INFO_BIN("lost site %d", 1);
+    dst.Flush();
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_INFO);
+    EXPECT_EQ(2u, dst.stats.dropped.Value());
+    EXPECT_LT(first_loss + strlen(__FILE__), dst.stats.dropped_bytes.Value());
+}
+
+TEST(LogBinaryTest, RejectsOverlongConversions)
+{
+    // As a corrupt file could have it: more flags and '*' digits than
+    // any conversion we write.
+    const std::string format = "<%" + std::string(48, '-') + "*.*d>";
+    const int32 args[] = { -2147483647 - 1, -2147483647 - 1, 7 };
+    char buf[256];
+    const size_t n = base_logging::FormatLogBinaryArgs(
+            buf, sizeof(buf), format.c_str(), "iii",
+            reinterpret_cast<const char*>(args), sizeof(args));
+    EXPECT_EQ("<", std::string(buf, n));
+}
+
+TEST(LogRateLimitTest, SuppressesAndReports)
+{
+    LogDestinationToMemory dst;
+    THIS_MODULE->AddLogDestination(&dst, kLS_WARNING);
+    // One message every 10ms, bursts of two.
+    static LogRateLimit rl(6000, 2);
+    for (int i = 0; i < 10; ++i) {
+        LOG_WARN_RL(&rl) << "storm " << i;
+    }
+    usleep(25 * 1000);
+    LOG_WARN_RL(&rl) << "calm";
+    THIS_MODULE->RemoveLogDestination(&dst, kLS_WARNING);
+
+    const std::vector<std::string> messages = dst.messages();
+    ASSERT_EQ(3u, messages.size());
+    EXPECT_NE(std::string::npos, messages[0].find("] storm 0"));
+    EXPECT_NE(std::string::npos, messages[1].find("] storm 1"));
+    EXPECT_NE(std::string::npos, messages[2].find("] [8 suppressed] calm"));
+}
+
+namespace {
+
+// A unix datagram socket standing in for a syslog collector.
+class DatagramListener {
+public:
+    DatagramListener() {
+        char dir[] = "/tmp/logging_unittest.XXXXXX";
+        dir_ = mkdtemp(dir);
+        path_ = dir_ + "/collector";
+        fd_ = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path_.c_str());
+        bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    }
+    ~DatagramListener() {
+        close(fd_);
+        unlink(path_.c_str());
+        rmdir(dir_.c_str());
+    }
+    const std::string &path() const {
+        return path_;
+    }
+    // Everything received so far
+    std::vector<std::string> Receive() {
+        std::vector<std::string> datagrams;
+        char buf[4096];
+        ssize_t n;
+        while ((n = recv(fd_, buf, sizeof(buf), 0)) >= 0) {
+            datagrams.push_back(std::string(buf, n));
+        }
+        return datagrams;
+    }
+private:
+    std::string dir_;
+    std::string path_;
+    int fd_;
+};
+
+}  // namespace
+
+TEST(LogDestinationToSocketTest, SendsRfc5424Frames)
+{
+    DatagramListener listener;
+    LogDestinationToSyslog dst(listener.path());
+    dst.Log(kLS_INFO, 0, "hello\n", 6);
+    dst.Log(kLS_ERR, 0, "world\n", 6);
+    dst.Flush();
+
+    const std::vector<std::string> frames = listener.Receive();
+    ASSERT_EQ(2u, frames.size());
+    // daemon.info and daemon.err
+    EXPECT_EQ(0u, frames[0].find("<30>1 1970-01-01T00:00:00Z "));
+    EXPECT_EQ(0u, frames[1].find("<27>1 1970-01-01T00:00:00Z "));
+    EXPECT_NE(std::string::npos, frames[0].find(" - - hello"));
+    EXPECT_EQ('o', frames[0][frames[0].size() - 1]);
+    EXPECT_EQ(0u, dst.n_dropped());
+}
+
+TEST(LogDestinationToSocketTest, SanitizesAppName)
+{
+    DatagramListener listener;
+    char *const saved_name = program_invocation_short_name;
+    std::string name = "my app\t" + std::string(60, 'x');
+    program_invocation_short_name = &name[0];
+    LogDestinationToSyslog dst(listener.path());
+    program_invocation_short_name = saved_name;
+    dst.Log(kLS_INFO, 0, "hello\n", 6);
+    dst.Flush();
+
+    const std::vector<std::string> frames = listener.Receive();
+    ASSERT_EQ(1u, frames.size());
+    // Printable without spaces, and cut to 48 characters.
+    EXPECT_NE(std::string::npos,
+              frames[0].find(" myapp" + std::string(43, 'x') + " "))
+            << frames[0];
+}
+
+TEST(LogDestinationToSocketTest, DropsInsteadOfBlocking)
+{
+    DatagramListener listener;
+    LogDestinationToSocket dst(listener.path());
+    const std::string message(1000, 'm');
+    for (int i = 0; i < 5000; ++i) {
+        dst.Log(kLS_INFO, 0, message.data(), message.size());
+    }
+    dst.Flush();
+    const size_t received = listener.Receive().size();
+    EXPECT_GT(dst.n_dropped(), 0u);
+    EXPECT_EQ(5000u, received + dst.n_dropped());
+}
+
+TEST(LogDestinationToSocketTest, CountsMessagesWithoutCollector)
+{
+    LogDestinationToSocket dst("/tmp/logging_unittest.no-such-socket");
+    dst.Log(kLS_INFO, 0, "lost\n", 5);
+    EXPECT_EQ(1u, dst.n_dropped());
+}
+
+TEST(LogModuleTest, BudgetHoldsBackChattyModule)
+{
+    LOG_DEFINE_MODULE(chatty);
+    LogDestinationToMemory dst;
+    log_module_chatty.AddLogDestination(&dst, kLS_INFO);
+    log_module_chatty.AddLogDestination(&dst, kLS_FATAL);
+    log_module_chatty.SetBudget(0, 3, 3600);
+    int evaluations = 0;
+    for (int i = 0; i < 10; ++i) {
+        LOG_MODULE_IF(&log_module_chatty, kLS_INFO, true) << ++evaluations;
+    }
+    EXPECT_EQ(3, evaluations);
+    EXPECT_EQ(3u, dst.messages().size());
+    EXPECT_EQ(7u, log_module_chatty.n_over_budget.load());
+    EXPECT_TRUE(log_module_chatty.WithinBudget(kLS_FATAL));
+
+    // Bytes count too; the message going over is still written.
+    const std::string message(100, 'b');
+    log_module_chatty.SetBudget(2 * message.size(), 0, 3600);
+    for (int i = 0; i < 5; ++i) {
+        LOG_MODULE_IF(&log_module_chatty, kLS_INFO, true) << message;
+    }
+    EXPECT_EQ(5u, dst.messages().size());
+
+    // A window of 0 seconds is over right away.
+    log_module_chatty.SetBudget(0, 1, 0);
+    for (int i = 0; i < 5; ++i) {
+        LOG_MODULE_IF(&log_module_chatty, kLS_INFO, true) << "again";
+    }
+    EXPECT_EQ(10u, dst.messages().size());
+    log_module_chatty.RemoveLogDestination(&dst, kLS_INFO);
+    log_module_chatty.RemoveLogDestination(&dst, kLS_FATAL);
+}
+
+TEST(LogModuleTest, CountsMessagesAndDumpsStats)
+{
+    LOG_DEFINE_MODULE(stats_test);
+    char path[] = "/tmp/logging_unittest.XXXXXX";
+    close(mkstemp(path));
+    {
+        LogDestinationToFile dst(path);
+        log_module_stats_test.AddLogDestination(&dst, kLS_INFO);
+        for (int i = 0; i < 10; ++i) {
+            LOG_MODULE_IF(&log_module_stats_test, kLS_INFO, true)
+                    << "counted " << i;
+        }
+        LOG_MODULE_IF(&log_module_stats_test, kLS_DEBUG, true)
+                << "not counted";
+        log_module_stats_test.RemoveLogDestination(&dst, kLS_INFO);
+        dst.Flush();
+
+        const uint64 bytes = log_module_stats_test.stats.bytes.Value();
+        EXPECT_EQ(10u, log_module_stats_test.stats.messages.Value());
+        EXPECT_EQ(10u, dst.stats.messages.Value());
+        EXPECT_EQ(bytes, dst.stats.bytes.Value());
+        EXPECT_LE(bytes, dst.stats.buffer_high_water.load());
+        base_logging::LogLatencyHistogram::Snapshot flushes;
+        dst.stats.flush_latency.Read(&flushes);
+        EXPECT_EQ(1u, flushes.count);
+
+        char expected[128];
+        snprintf(expected, sizeof(expected),
+                 "module stats_test: messages=10 bytes=%llu dropped=0 "
+                 "over_budget=0\n", static_cast<unsigned long long>(bytes));
+        const std::string text = LogStatsText();
+        EXPECT_NE(std::string::npos, text.find(expected)) << text;
+        EXPECT_NE(std::string::npos,
+                  text.find(std::string("destination file:") + path +
+                            ": messages=10 ")) << text;
+        snprintf(expected, sizeof(expected),
+                 "{\"name\":\"stats_test\",\"messages\":10,\"bytes\":%llu,",
+                 static_cast<unsigned long long>(bytes));
+        const std::string json = LogStatsJson();
+        EXPECT_EQ(0u, json.find("{\"modules\":[")) << json;
+        EXPECT_NE(std::string::npos, json.find(expected)) << json;
+    }
+    unlink(path);
+}
+
+// Every counter gets more digits than a short format buffer holds.
+TEST(LogModuleTest, DumpsLargeCounters)
+{
+    char path[] = "/tmp/logging_unittest.XXXXXX";
+    close(mkstemp(path));
+    {
+        LogDestinationToFile dst(path);
+        dst.stats.messages.Add(1234567890123ULL);
+        dst.stats.bytes.Add(98765432109876ULL);
+        dst.stats.dropped.Add(5555555555ULL);
+        dst.stats.dropped_bytes.Add(9876543210ULL);
+        dst.stats.RecordBufferFill(123456789012ULL);
+        for (int i = 0; i < 12345; ++i) {
+            dst.stats.flush_latency.Record(0);
+        }
+        const std::string name = std::string("destination file:") + path;
+        const std::string text = LogStatsText();
+        EXPECT_NE(std::string::npos,
+                  text.find(name + ": messages=1234567890123"
+                            " bytes=98765432109876 dropped=5555555555"
+                            " dropped_bytes=9876543210"
+                            " buffer_high_water=123456789012"
+                            " flushes=12345 flush_us_sum=0"
+                            " flush_us_max=0 flush_us=<1:12345\n"))
+                << text;
+        const std::string json = LogStatsJson();
+        EXPECT_NE(std::string::npos,
+                  json.find("\"messages\":1234567890123,"
+                            "\"bytes\":98765432109876,"
+                            "\"dropped\":5555555555,"
+                            "\"dropped_bytes\":9876543210,"
+                            "\"buffer_high_water\":123456789012,"
+                            "\"flush_latency_us\":{\"count\":12345,"
+                            "\"sum\":0,\"max\":0,\"buckets\":[12345,0,"))
+                << json;
+    }
+    unlink(path);
+}
+
+TEST(LogModuleTest, LevelsChangeAtRuntime)
+{
+    LOG_DEFINE_MODULE(runtime_net_a);
+    LOG_DEFINE_MODULE(runtime_net_b);
+    LOG_DEFINE_MODULE(runtime_disk);
+    LogDestinationToMemory dst;
+    log_module_runtime_net_a.AddLogDestination(&dst, kLS_DEBUG);
+    log_module_runtime_net_a.AddLogDestination(&dst, kLS_INFO);
+    EXPECT_FALSE(log_module_runtime_net_a.IsOn(kLS_DEBUG));
+    EXPECT_FALSE(log_module_runtime_net_a.VlogIsOn(1));
+    EXPECT_TRUE(log_module_runtime_net_a.VlogIsOn(0));
+
+    EXPECT_EQ(2, LogSetModuleSeverity("runtime_net_*", kLS_DEBUG));
+    EXPECT_EQ(1, LogSetModuleVlog("runtime_net_a", 2));
+    EXPECT_TRUE(log_module_runtime_net_a.IsOn(kLS_DEBUG));
+    EXPECT_EQ(kLS_DEBUG, log_module_runtime_net_b.min_severity.load());
+    EXPECT_EQ(kLS_INFO, log_module_runtime_disk.min_severity.load());
+    LOG_MODULE_VLOG(&log_module_runtime_net_a, 2) << "vlog 2";
+    LOG_MODULE_VLOG(&log_module_runtime_net_a, 3) << "vlog 3";
+    ASSERT_EQ(1u, dst.messages().size());
+    EXPECT_NE(std::string::npos, dst.messages()[0].find("] vlog 2"));
+
+    // The same through a control file and a signal.
+    char path[] = "/tmp/logging_unittest.XXXXXX";
+    close(mkstemp(path));
+    FILE *file = fopen(path, "w");
+    fputs("# comment\nruntime_net_? severity=warning vlog=0\n"
+          "runtime_disk vlog=4\nbogus line=1\n", file);
+    fclose(file);
+    ASSERT_TRUE(StartLogControl(path, SIGUSR2));
+    EXPECT_EQ(kLS_WARNING, log_module_runtime_net_a.min_severity.load());
+    EXPECT_EQ(4, log_module_runtime_disk.vlog_level.load());
+
+    file = fopen(path, "w");
+    fputs("runtime_* severity=debug\n", file);
+    fclose(file);
+    raise(SIGUSR2);
+    for (int i = 0; i < 100 && log_module_runtime_disk.min_severity.load() !=
+                 kLS_DEBUG; ++i) {
+        usleep(10 * 1000);
+    }
+    StopLogControl();
+    unlink(path);
+    EXPECT_EQ(kLS_DEBUG, log_module_runtime_disk.min_severity.load());
+    EXPECT_EQ(kLS_DEBUG, log_module_runtime_net_b.min_severity.load());
+    log_module_runtime_net_a.RemoveLogDestination(&dst, kLS_DEBUG);
+    log_module_runtime_net_a.RemoveLogDestination(&dst, kLS_INFO);
+}
+
+namespace {
+
+LOG_DEFINE_MODULE(swapped);
+
+// Counts the threads inside Log(), which takes a while.
+class LogDestinationSlow : public LogDestination {
+public:
+    LogDestinationSlow() : in_log(0), n_logged(0) {
+        type = kLOG_DST_STDERR;
+    }
+    virtual ~LogDestinationSlow() {
+        Unregister();
+    }
+    virtual void Log(LogSeverity severity, time_t timestamp,
+                     const char* message, size_t len) {
+        in_log.fetch_add(1);
+        usleep(100);
+        n_logged.fetch_add(1);
+        in_log.fetch_sub(1);
+    }
+    std::atomic<int> in_log;
+    std::atomic<int> n_logged;
+};
+
+std::atomic<bool> stop_swapped_loggers(false);
+
+void *LogToSwapped(void *arg)
+{
+    while (!stop_swapped_loggers.load()) {
+        LOG_MODULE_IF(&log_module_swapped, kLS_INFO, true) << "message";
+    }
+    return NULL;
+}
+
+}  // namespace
+
+TEST(LogModuleTest, RemoveWaitsForDispatch)
+{
+    pthread_t threads[4];
+    for (size_t i = 0; i < arraysize(threads); ++i) {
+        pthread_create(&threads[i], NULL, LogToSwapped, NULL);
+    }
+    int n_logged = 0;
+    for (int i = 0; i < 50; ++i) {
+        LogDestinationSlow *dst = new LogDestinationSlow();
+        log_module_swapped.AddLogDestination(dst, kLS_INFO);
+        usleep(1000);
+        log_module_swapped.RemoveLogDestination(dst, kLS_INFO);
+        // No thread is still writing to it, so it can go.
+        EXPECT_EQ(0, dst->in_log.load());
+        n_logged += dst->n_logged.load();
+        delete dst;
+    }
+    stop_swapped_loggers.store(true);
+    for (size_t i = 0; i < arraysize(threads); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    EXPECT_LT(0, n_logged);
+}
+
+namespace {
+
+// Leaves a message in the async ring or the file buffer, then crashes.
+void CrashWithBufferedMessage(const char *path)
+{
+    LogDestinationToFile *dst = new LogDestinationToFile(path);
+    THIS_MODULE->AddLogDestination(dst, kLS_INFO);
+    InstallFailureSignalHandler();
+    StartAsyncLogging();
+    LOG_INFO() << "logged before the crash";
+    *static_cast<volatile int*>(NULL) = 0;
+}
+
+void ExitFromFailureFunction()
+{
+    _exit(42);
+}
+
+}  // namespace
+
+TEST(LogCrashTest, FlushesBufferedMessagesOnFatalSignal)
+{
+    char path[] = "/tmp/logging_unittest.XXXXXX";
+    close(mkstemp(path));
+    EXPECT_EXIT(CrashWithBufferedMessage(path),
+                ::testing::KilledBySignal(SIGSEGV),
+                "\\*\\*\\* SIGSEGV \\(@0x0\\) received by PID");
+    const std::string contents = ReadFile(path);
+    unlink(path);
+    const size_t message = contents.find("logged before the crash");
+    const size_t report = contents.find("*** SIGSEGV");
+    EXPECT_NE(std::string::npos, message);
+    EXPECT_NE(std::string::npos, report);
+    EXPECT_LT(message, report);
+    EXPECT_NE(std::string::npos, contents.find("    @ 0x", report));
+}
+
+TEST(LogCrashTest, SkipsDestinationsOnTheReportFile)
+{
+    char path[] = "/tmp/logging_unittest.XXXXXX";
+    const int fd = mkstemp(path);
+    {
+        LogDestinationToFile dst(path);
+        dst.Log(kLS_ERR, time(NULL), "opened\n", 7);
+        // As if |fd| were stderr, which has the report already.
+        LogDestination::CrashWriteAll(kLS_FATAL, time(NULL),
+                                      "skipped report\n", 15, fd);
+        LogDestination::CrashWriteAll(kLS_FATAL, time(NULL),
+                                      "written report\n", 15);
+    }
+    close(fd);
+    const std::string contents = ReadFile(path);
+    unlink(path);
+    EXPECT_EQ(std::string::npos, contents.find("skipped report"));
+    EXPECT_NE(std::string::npos, contents.find("written report"));
+}
+
+TEST(LogCrashTest, FatalCallsFailureFunction)
+{
+    EXPECT_EXIT({
+            InstallFailureFunction(ExitFromFailureFunction);
+            LOG_FATAL() << "goodbye";
+        }, ::testing::ExitedWithCode(42), "");
+    EXPECT_EXIT(CHECK_EQ(1 + 1, 3) << "math", ::testing::KilledBySignal(SIGABRT),
+                "");
+}
@@ -3,7 +3,7 @@
 
 #define SYSLOG_EMERGENCY 0
 #define SYSLOG_ALERT 1
-#define SYSLOG_CIRTICAL 2
+#define SYSLOG_CRITICAL 2
 #define SYSLOG_ERROR 3
 #define SYSLOG_WARNING 4
 #define SYSLOG_NOTICE 5
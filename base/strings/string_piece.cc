@@ -1,5 +1,7 @@
 #include "base/strings/string_piece.hh"
 
+#include <limits.h>
+
 #include <algorithm>
 #include <ostream>
 
@@ -20,12 +20,12 @@
 #include <iosfwd>
 #include <string>
 
-#include "base/basictypes.h"
+#include "base/basictypes.hh"
 
 namespace base {
 
 template<typename STRING_TYPE> class BasicStringPiece;
-typedef BaseStringPiece<std::string> StringPiece;
+typedef BasicStringPiece<std::string> StringPiece;
 
 // Many of the StringPiece functions use different implementations for the
 // 8-bit version, and we don't want lots of template expansions in
@@ -325,6 +325,8 @@ inline bool operator>=(const StringPiece& x, const StringPiece& y) {
     return !(x < y);
 }
 
+std::ostream& operator<<(std::ostream& o, const StringPiece& piece);
+
 }  // namespace base
 
 #endif
@@ -19,3 +19,49 @@
 // THE SOFTWARE.
 
 #include "base/strings/string_printf.hh"
+
+#include <stdio.h>
+
+std::string StringPrintf(const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    std::string result = StringPrintV(format, ap);
+    va_end(ap);
+    return result;
+}
+
+std::string StringPrintV(const char *format, va_list ap)
+{
+    std::string result;
+    StringAppendV(&result, format, ap);
+    return result;
+}
+
+void StringAppendF(std::string *dst, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    StringAppendV(dst, format, ap);
+    va_end(ap);
+}
+
+void StringAppendV(std::string *dst, const char *format, va_list ap)
+{
+    char buf[256];
+    va_list copy;
+    va_copy(copy, ap);
+    const int n = vsnprintf(buf, sizeof(buf), format, copy);
+    va_end(copy);
+    if (n < 0) {
+        return;
+    }
+    if (static_cast<size_t>(n) < sizeof(buf)) {
+        dst->append(buf, n);
+        return;
+    }
+    const size_t old_size = dst->size();
+    dst->resize(old_size + n + 1);
+    vsnprintf(&(*dst)[old_size], n + 1, format, ap);
+    dst->resize(old_size + n);
+}
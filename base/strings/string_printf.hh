@@ -25,9 +25,13 @@
 
 #include <string>
 
-std::string StringPrintf(const char *format, ...);
-std::string StringPrintV(const char *format, va_list ap);
-void StringAppendF(std::string *dst, const char *format, ...);
-void StringAppendV(std::string *dst, const char *format, va_list ap);
+std::string StringPrintf(const char *format, ...)
+        __attribute__((format(printf, 1, 2)));
+std::string StringPrintV(const char *format, va_list ap)
+        __attribute__((format(printf, 1, 0)));
+void StringAppendF(std::string *dst, const char *format, ...)
+        __attribute__((format(printf, 2, 3)));
+void StringAppendV(std::string *dst, const char *format, va_list ap)
+        __attribute__((format(printf, 2, 0)));
 
 #endif  // BASE_STRINGS_STRING_PRINTF_HH_
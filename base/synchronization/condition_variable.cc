@@ -0,0 +1,81 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/synchronization/condition_variable.hh"
+
+#include <limits>
+
+#include "base/synchronization/futex.hh"
+
+namespace base {
+
+ConditionVariable::ConditionVariable(Lock *user_lock)
+        : user_lock_(user_lock), sequence_(0), waiters_(0)
+{
+}
+
+ConditionVariable::~ConditionVariable()
+{
+}
+
+void ConditionVariable::Wait()
+{
+    TimedWait(TimeDelta::Max());
+}
+
+// The sequence is read and the waiter counted before the lock is let go,
+// so a Signal() from whoever takes it next either finds the sequence
+// changed under us or finds us counted and wakes us.
+void ConditionVariable::TimedWait(const TimeDelta &max_time)
+{
+    user_lock_->AssertAcquired();
+    const int sequence = sequence_.load();
+    waiters_.fetch_add(1);
+    user_lock_->Release();
+    if (max_time.is_max()) {
+        internal::FutexWait(&sequence_, sequence);
+    } else {
+        const struct timespec timeout =
+                internal::FutexTimeout(max_time.InMicroseconds());
+        internal::FutexWait(&sequence_, sequence, &timeout);
+    }
+    waiters_.fetch_sub(1);
+    user_lock_->Acquire();
+}
+
+// Broadcast() can not requeue the waiters onto the user lock, which need
+// not be a futex, so they all wake up and queue for it themselves.
+void ConditionVariable::Broadcast()
+{
+    sequence_.fetch_add(1);
+    if (waiters_.load() > 0) {
+        internal::FutexWake(&sequence_, std::numeric_limits<int>::max());
+    }
+}
+
+void ConditionVariable::Signal()
+{
+    sequence_.fetch_add(1);
+    if (waiters_.load() > 0) {
+        internal::FutexWake(&sequence_, 1);
+    }
+}
+
+}  // namespace base
@@ -0,0 +1,69 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_SYNCHRONIZATION_CONDITION_VARIABLE_HH_
+#define BASE_SYNCHRONIZATION_CONDITION_VARIABLE_HH_
+
+#include <atomic>
+
+#include "base/basictypes.hh"
+#include "base/synchronization/lock.hh"
+#include "base/time/time.hh"
+
+namespace base {
+
+// A condition variable bound to one base::Lock, which the caller holds
+// around Wait() and around the changes it waits for:
+//
+//   AutoLock l(lock_);
+//   while (queue_.empty()) {
+//       not_empty_.Wait();
+//   }
+//
+// Waiters sleep on a futex holding a counter that every Signal() and
+// Broadcast() bumps, so a signal given between the caller releasing the
+// lock and going to sleep is not lost. Signal() and Broadcast() make no
+// system call while nobody waits. Wake-ups may be spurious; callers must
+// recheck their condition.
+class ConditionVariable {
+public:
+    // |user_lock| must outlive the condition variable.
+    explicit ConditionVariable(Lock *user_lock);
+    ~ConditionVariable();
+
+    // Releases the lock, sleeps until signaled and takes the lock again.
+    void Wait();
+    // Same, but gives up once |max_time| has passed.
+    void TimedWait(const TimeDelta &max_time);
+    // Wakes every waiter; they then take turns at the lock.
+    void Broadcast();
+    // Wakes one waiter, if any.
+    void Signal();
+
+private:
+    Lock *user_lock_;
+    std::atomic<int> sequence_;
+    std::atomic<int> waiters_;
+    DISALLOW_COPY_AND_ASSIGN(ConditionVariable);
+};
+
+}  // namespace base
+
+#endif  // BASE_SYNCHRONIZATION_CONDITION_VARIABLE_HH_
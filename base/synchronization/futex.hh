@@ -0,0 +1,89 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_SYNCHRONIZATION_FUTEX_HH_
+#define BASE_SYNCHRONIZATION_FUTEX_HH_
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "base/basictypes.hh"
+
+namespace base {
+namespace internal {
+
+// Sleeps while |*word| holds |expected|; may also return spuriously.
+inline void FutexWait(std::atomic<int> *word, int expected)
+{
+    syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAIT_PRIVATE,
+            expected, NULL, NULL, 0);
+}
+
+// Like FutexWait(), but gives up once |timeout| (relative, measured on
+// CLOCK_MONOTONIC) has passed. Returns false if it timed out.
+inline bool FutexWait(std::atomic<int> *word, int expected,
+                      const struct timespec *timeout)
+{
+    return syscall(SYS_futex, reinterpret_cast<int*>(word),
+                   FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0) == 0 ||
+            errno != ETIMEDOUT;
+}
+
+// The FutexWait() timeout for |micros| from now; negative means now.
+inline struct timespec FutexTimeout(int64 micros)
+{
+    struct timespec timeout;
+    if (micros < 0) {
+        micros = 0;
+    }
+    timeout.tv_sec = static_cast<time_t>(micros / 1000000);
+    timeout.tv_nsec = static_cast<long>(micros % 1000000) * 1000;
+    return timeout;
+}
+
+// Wakes up to |count| threads sleeping on |word|.
+inline void FutexWake(std::atomic<int> *word, int count)
+{
+    syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAKE_PRIVATE,
+            count, NULL, NULL, 0);
+}
+
+// Tells the CPU we are spinning, so that it can give the other hardware
+// thread of the core a turn and not mis-speculate on the loop's exit.
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    asm volatile("" ::: "memory");
+#endif
+}
+
+}  // namespace internal
+}  // namespace base
+
+#endif  // BASE_SYNCHRONIZATION_FUTEX_HH_
@@ -23,6 +23,10 @@
 #include <errno.h>
 #include <string.h>
 
+#include <algorithm>
+
+#include "base/synchronization/futex.hh"
+
 namespace base {
 namespace internal {
 LockImpl::LockImpl()
@@ -45,9 +49,9 @@ bool LockImpl::Try()
 {
     int rv;
 #if defined(C11)
-    rv = native_handle_.try_lock();
+    rv = native_handle_.try_lock() ? 0 : EBUSY;
 #else
-    int rv = pthread_mutex_trylock(&native_handle_);
+    rv = pthread_mutex_trylock(&native_handle_);
     // DCHECK(rv == 0 || rv == EBUSY) << ". " << strerror(rv);
 #endif
     return rv == 0;
@@ -71,5 +75,91 @@ void LockImpl::Unlock()
 #endif
 }
 
+namespace {
+
+// Pauses per Lock() before parking, and the longest pause between tries
+std::atomic<int> spin_limit(-1);
+std::atomic<int> max_backoff(64);
+
+int SpinLimit()
+{
+    int limit = spin_limit.load(std::memory_order_relaxed);
+    if (PREDICT_FALSE(limit < 0)) {
+        limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 4096 : 0;
+        spin_limit.store(limit, std::memory_order_relaxed);
+    }
+    return limit;
+}
+
+}  // namespace
+
+// static function
+void AdaptiveLockImpl::SetSpinLimits(int max_spins, int backoff)
+{
+    spin_limit.store(max_spins < 0 ? 0 : max_spins,
+                     std::memory_order_relaxed);
+    max_backoff.store(backoff < 1 ? 1 : backoff, std::memory_order_relaxed);
+}
+
+void AdaptiveLockImpl::LockSlow()
+{
+    const int limit = SpinLimit();
+    const int backoff_limit = max_backoff.load(std::memory_order_relaxed);
+    int backoff = 1;
+    for (int spins = 0; spins < limit; spins += backoff) {
+        // Only try again once the lock looks free, so that waiters do not
+        // keep stealing the holder's cache line.
+        if (state_.load(std::memory_order_relaxed) == kUnlocked && Try()) {
+            return;
+        }
+        for (int i = 0; i < backoff; ++i) {
+            CpuRelax();
+        }
+        backoff = std::min(backoff * 2, backoff_limit);
+    }
+    // Mark the lock contended so that its holder wakes us. Whoever takes
+    // it from here on leaves it contended, which may cost one spurious
+    // wake-up but never loses one.
+    while (state_.exchange(kContended, std::memory_order_acquire) !=
+           kUnlocked) {
+        FutexWait(&state_, kContended);
+    }
+}
+
+void AdaptiveLockImpl::Wake()
+{
+    FutexWake(&state_, 1);
+}
+
 }  // namespace internal
+
+#if defined(BASE_LOCK_PROFILING) || defined(BASE_LOCK_DEBUG)
+Lock::Lock()
+        : lock_()
+{
+    Init(tracked_objects::Location(
+            "Unknown", "Unknown", -1,
+            __builtin_extract_return_addr(__builtin_return_address(0))));
+}
+
+Lock::Lock(const tracked_objects::Location &created_at)
+        : lock_()
+{
+    Init(created_at);
+}
+
+void Lock::Init(const tracked_objects::Location &created_at)
+{
+#if defined(BASE_LOCK_PROFILING)
+    site_ = internal::GetLockSiteProfile(created_at);
+    acquired_at_ = 0;
+#endif
+#if defined(BASE_LOCK_DEBUG)
+    created_at_ = created_at;
+    owner_.store(0, std::memory_order_relaxed);
+    ordered_ = false;
+#endif
+}
+#endif
+
 }  // namespace base
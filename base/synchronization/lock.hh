@@ -27,7 +27,14 @@
 #include <pthread.h>
 #endif
 #include <unistd.h>
+
+#include <atomic>
+
 #include "base/basictypes.hh"
+#include "base/compiler_specific.hh"
+#include "base/location.hh"
+#include "base/synchronization/lock_debug.hh"
+#include "base/synchronization/lock_profile.hh"
 
 namespace base {
 namespace internal {
@@ -50,21 +57,114 @@ private:
     NativeHandle native_handle_;
     DISALLOW_COPY_AND_ASSIGN(LockImpl);
 };
+
+// A lock for critical sections of a few tens of nanoseconds, where going
+// to sleep as soon as the lock is taken costs far more than waiting.
+// Lock() first spins, pausing for exponentially longer between attempts,
+// and only parks the thread on a futex once it has spun for the spin
+// limit. Unlocking an uncontended lock is a single atomic exchange.
+class AdaptiveLockImpl {
+public:
+    AdaptiveLockImpl() : state_(kUnlocked) {
+    }
+    bool Try() {
+        int expected = kUnlocked;
+        return state_.compare_exchange_strong(expected, kLocked,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed);
+    }
+    void Lock() {
+        if (PREDICT_FALSE(!Try())) {
+            LockSlow();
+        }
+    }
+    void Unlock() {
+        if (PREDICT_FALSE(state_.exchange(kUnlocked,
+                                          std::memory_order_release) ==
+                          kContended)) {
+            Wake();
+        }
+    }
+    // Sets how many pauses Lock() spins for in total before parking, and
+    // the most it pauses between two attempts. Applies to every
+    // AdaptiveLockImpl. The spin limit defaults to 0 on a single CPU,
+    // where the holder can not run while we spin.
+    static void SetSpinLimits(int max_spins, int max_backoff);
+
+private:
+    enum {
+        kUnlocked,
+        kLocked,
+        // Locked, and a thread may be parked on the futex
+        kContended,
+    };
+    void LockSlow();
+    void Wake();
+
+    std::atomic<int> state_;
+    DISALLOW_COPY_AND_ASSIGN(AdaptiveLockImpl);
+};
+
+// What base::Lock is built on; building with BASE_ADAPTIVE_LOCK defined
+// switches every Lock to AdaptiveLockImpl.
+#if defined(BASE_ADAPTIVE_LOCK)
+typedef AdaptiveLockImpl DefaultLockImpl;
+#else
+typedef LockImpl DefaultLockImpl;
+#endif
 }  // namespace internal
 
 class Lock {
 public:
+#if defined(BASE_LOCK_PROFILING) || defined(BASE_LOCK_DEBUG)
+    // Out of line, so that the caller's address can name the lock in the
+    // profile and in lock order reports.
+    Lock();
+    explicit Lock(const tracked_objects::Location &created_at);
+#else
     Lock() : lock_() {
     }
+    // |created_at| names the lock in the contention profile and in lock
+    // order reports; see lock_profile.hh and lock_debug.hh.
+    explicit Lock(const tracked_objects::Location &created_at) : lock_() {
+    }
+#endif
 
+#if defined(BASE_LOCK_DEBUG)
+    ~Lock();
+#else
     ~Lock() {
     }
+#endif
 
     void Acquire() {
+#if defined(BASE_LOCK_DEBUG)
+        WillAcquire(true);
+#endif
+#if defined(BASE_LOCK_PROFILING)
+        if (PREDICT_FALSE(internal::LockProfilingEnabled())) {
+            AcquireProfiled();
+        } else {
+            lock_.Lock();
+        }
+#else
         lock_.Lock();
+#endif
+#if defined(BASE_LOCK_DEBUG)
+        MarkAcquired();
+#endif
     }
 
     void Release() {
+#if defined(BASE_LOCK_DEBUG)
+        CheckHeldAndUnmark();
+#endif
+#if defined(BASE_LOCK_PROFILING)
+        if (PREDICT_FALSE(acquired_at_ != 0)) {
+            ReleaseProfiled();
+            return;
+        }
+#endif
         lock_.Unlock();
     }
 
@@ -73,15 +173,64 @@ public:
     // by a thread already holding the lock (what happens is undefined and an
     // assertion may fail).
     bool Try() {
-        return lock_.Try();
+#if defined(BASE_LOCK_DEBUG)
+        WillAcquire(false);
+#endif
+        bool acquired;
+#if defined(BASE_LOCK_PROFILING)
+        if (PREDICT_FALSE(internal::LockProfilingEnabled())) {
+            acquired = TryProfiled();
+        } else {
+            acquired = lock_.Try();
+        }
+#else
+        acquired = lock_.Try();
+#endif
+#if defined(BASE_LOCK_DEBUG)
+        if (acquired) {
+            MarkAcquired();
+        }
+#endif
+        return acquired;
     }
 
+    // Aborts in debug builds unless the calling thread holds the lock.
+#if defined(BASE_LOCK_DEBUG)
+    void AssertAcquired() const;
+#else
     void AssertAcquired() const {
-        // TODO(gene.ge)
     }
+#endif
 
 private:
-    internal::LockImpl lock_;
+#if defined(BASE_LOCK_PROFILING) || defined(BASE_LOCK_DEBUG)
+    void Init(const tracked_objects::Location &created_at);
+#endif
+#if defined(BASE_LOCK_PROFILING)
+    void AcquireProfiled();
+    void ReleaseProfiled();
+    bool TryProfiled();
+
+    internal::LockSiteProfile *site_;
+    // When the holder took the lock, if it was profiling then; else 0
+    int64 acquired_at_;
+#endif
+#if defined(BASE_LOCK_DEBUG)
+    // Aborts if this thread holds the lock already; if |may_block|, also
+    // records the order of this lock after those the thread holds.
+    void WillAcquire(bool may_block);
+    void MarkAcquired();
+    void CheckHeldAndUnmark();
+    std::string Describe() const;
+
+    tracked_objects::Location created_at_;
+    // Id of the holding thread, 0 if none
+    std::atomic<int> owner_;
+    // Whether the lock order graph has edges to or from this lock; only
+    // touched with the graph locked, and by the destructor.
+    bool ordered_;
+#endif
+    internal::DefaultLockImpl lock_;
 };
 
 class AutoLock {
@@ -0,0 +1,121 @@
+// Contention benchmark for the base::Lock implementations. Run with no
+// arguments; each line gives the cost of one short critical section with
+// that many threads hammering a single lock.
+//
+// Build with debug=no: debug builds add the base::Lock owner and lock
+// order checks, so their numbers say nothing about release code.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <atomic>
+#include <vector>
+
+#include "base/basictypes.hh"
+#include "base/synchronization/lock.hh"
+#include "base/time/time.hh"
+
+namespace {
+
+// Critical sections per benchmark, split between its threads
+const int kOperations = 2000000;
+
+int64 NowNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64>(ts.tv_sec) * base::kNanosecondsPerSecond +
+            ts.tv_nsec;
+}
+
+// Stands in for a small map or a ref-count: a few cache lines updated
+// under the lock.
+struct Shared {
+    uint64 slots[16];
+};
+
+template <typename LockType>
+struct LockThreadArgs {
+    int iterations;
+    std::atomic<int> *waiting;
+    LockType *lock;
+    Shared *shared;
+    // Where the thread leaves the result of its work outside the lock
+    uint64 sink;
+};
+
+template <typename LockType>
+void *LockThread(void *arg)
+{
+    LockThreadArgs<LockType> *args =
+            static_cast<LockThreadArgs<LockType>*>(arg);
+    // Start together, so the threads really contend. There may be more
+    // threads than CPUs, so let the late ones run.
+    args->waiting->fetch_sub(1);
+    while (args->waiting->load() > 0) {
+        sched_yield();
+    }
+    uint64 local = 0;
+    for (int i = 0; i < args->iterations; ++i) {
+        args->lock->Lock();
+        Shared *shared = args->shared;
+        for (size_t j = 0; j < arraysize(shared->slots); j += 4) {
+            shared->slots[j] += i;
+        }
+        args->lock->Unlock();
+        // Some work outside the lock, as a real caller would have.
+        for (int j = 0; j < 20; ++j) {
+            local = local * 31 + j;
+        }
+    }
+    args->sink = local;
+    return NULL;
+}
+
+template <typename LockType>
+void BenchmarkLock(const char *name, int num_threads)
+{
+    LockType lock;
+    Shared shared = { { 0 } };
+    std::atomic<int> waiting(num_threads);
+    std::vector<LockThreadArgs<LockType> > args(num_threads);
+    std::vector<pthread_t> threads(num_threads);
+    const int64 start = NowNanos();
+    for (int i = 0; i < num_threads; ++i) {
+        args[i].iterations = kOperations / num_threads;
+        args[i].waiting = &waiting;
+        args[i].lock = &lock;
+        args[i].shared = &shared;
+        pthread_create(&threads[i], NULL, LockThread<LockType>, &args[i]);
+    }
+    int64 total = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        pthread_join(threads[i], NULL);
+        total += args[i].iterations;
+    }
+    const int64 elapsed = NowNanos() - start;
+    printf("%-32s %8.1f ns/op %12.0f ops/s\n", name,
+           static_cast<double>(elapsed) / total,
+           total * static_cast<double>(base::kNanosecondsPerSecond) / elapsed);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+#if !defined(NDEBUG)
+    fprintf(stderr, "warning: debug build, rebuild with debug=no\n");
+#endif
+    const int kThreads[] = { 1, 2, 4, 8, 16, 32, 64 };
+    for (size_t i = 0; i < arraysize(kThreads); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "LockImpl/%d threads", kThreads[i]);
+        BenchmarkLock<base::internal::LockImpl>(name, kThreads[i]);
+        snprintf(name, sizeof(name), "AdaptiveLockImpl/%d threads",
+                 kThreads[i]);
+        BenchmarkLock<base::internal::AdaptiveLockImpl>(name, kThreads[i]);
+    }
+    return 0;
+}
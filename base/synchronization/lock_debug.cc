@@ -0,0 +1,274 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/synchronization/lock_debug.hh"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/synchronization/lock.hh"
+
+namespace base {
+namespace {
+
+void PrintAndAbort(const std::string &report)
+{
+    fprintf(stderr, "%s", report.c_str());
+    abort();
+}
+
+std::atomic<LockOrderViolationHandler> order_violation_handler(
+        PrintAndAbort);
+
+}  // namespace
+
+LockOrderViolationHandler SetLockOrderViolationHandler(
+        LockOrderViolationHandler handler)
+{
+    return order_violation_handler.exchange(
+            handler != NULL ? handler : PrintAndAbort);
+}
+
+#if defined(BASE_LOCK_DEBUG)
+namespace {
+
+// Locks a thread holds past this many are not tracked: the order checks
+// miss the edges from them, and a note says so once per process. The
+// owner checks still cover them.
+const int kMaxHeldLocks = 32;
+
+__thread Lock *held_locks[kMaxHeldLocks];
+__thread int n_held_locks;
+// Held locks that did not fit in held_locks
+__thread int n_untracked_locks;
+std::atomic<bool> untracked_noted(false);
+__thread int lock_owner_id;
+std::atomic<int> next_lock_owner_id(1);
+
+int CurrentOwnerId()
+{
+    if (PREDICT_FALSE(lock_owner_id == 0)) {
+        lock_owner_id = next_lock_owner_id.fetch_add(
+                1, std::memory_order_relaxed);
+    }
+    return lock_owner_id;
+}
+
+// Edges this thread has already put in the graph, so that taking the
+// same nested locks again costs no GraphLock. |epoch| goes stale when a
+// Lock is destroyed and its address may be reused.
+struct KnownEdge {
+    const Lock *from;
+    const Lock *to;
+    uint64 epoch;
+};
+
+const int kKnownEdges = 64;
+
+__thread KnownEdge known_edges[kKnownEdges];
+std::atomic<uint64> graph_epoch(1);
+
+KnownEdge &KnownEdgeSlot(const Lock *from, const Lock *to)
+{
+    const uintptr_t hash = reinterpret_cast<uintptr_t>(from) * 31 +
+            reinterpret_cast<uintptr_t>(to);
+    return known_edges[(hash >> 4) % kKnownEdges];
+}
+
+bool IsKnownEdge(const Lock *from, const Lock *to, uint64 epoch)
+{
+    const KnownEdge &edge = KnownEdgeSlot(from, to);
+    return edge.from == from && edge.to == to && edge.epoch == epoch;
+}
+
+// An edge a -> b means b was taken while holding a.
+typedef std::map<const Lock*, std::set<const Lock*> > OrderGraph;
+
+// Plain LockImpls: checking these would recurse.
+internal::LockImpl &GraphLock()
+{
+    static internal::LockImpl *lock = new internal::LockImpl;
+    return *lock;
+}
+// Leaked, so that Locks destroyed at exit can still remove themselves.
+OrderGraph &Graph()
+{
+    static OrderGraph *graph = new OrderGraph;
+    return *graph;
+}
+
+// Fills |path| with from -> ... -> to and returns true if the graph has
+// such a path.
+bool FindPath(const Lock *from, const Lock *to,
+              std::set<const Lock*> *visited,
+              std::vector<const Lock*> *path)
+{
+    path->push_back(from);
+    if (from == to) {
+        return true;
+    }
+    if (visited->insert(from).second) {
+        OrderGraph::const_iterator node = Graph().find(from);
+        if (node != Graph().end()) {
+            std::set<const Lock*>::const_iterator it;
+            for (it = node->second.begin(); it != node->second.end(); ++it) {
+                if (FindPath(*it, to, visited, path)) {
+                    return true;
+                }
+            }
+        }
+    }
+    path->pop_back();
+    return false;
+}
+
+}  // namespace
+
+Lock::~Lock()
+{
+    if (owner_.load(std::memory_order_relaxed) != 0) {
+        PrintAndAbort("destroying " + Describe() + ", which is held\n");
+    }
+    if (ordered_) {
+        GraphLock().Lock();
+        OrderGraph &graph = Graph();
+        graph.erase(this);
+        for (OrderGraph::iterator it = graph.begin(); it != graph.end(); ++it) {
+            it->second.erase(this);
+        }
+        graph_epoch.fetch_add(1, std::memory_order_release);
+        GraphLock().Unlock();
+    }
+}
+
+void Lock::AssertAcquired() const
+{
+    if (owner_.load(std::memory_order_relaxed) != CurrentOwnerId()) {
+        PrintAndAbort(Describe() + " is not held by this thread\n");
+    }
+}
+
+void Lock::WillAcquire(bool may_block)
+{
+    if (owner_.load(std::memory_order_relaxed) == CurrentOwnerId()) {
+        PrintAndAbort("acquiring " + Describe() +
+                      ", which this thread already holds\n");
+    }
+    if (!may_block || n_held_locks == 0) {
+        return;
+    }
+    uint64 epoch = graph_epoch.load(std::memory_order_acquire);
+    int i = 0;
+    while (i < n_held_locks && IsKnownEdge(held_locks[i], this, epoch)) {
+        ++i;
+    }
+    if (i == n_held_locks) {
+        return;
+    }
+    std::string report;
+    GraphLock().Lock();
+    epoch = graph_epoch.load(std::memory_order_relaxed);
+    for (i = 0; i < n_held_locks; ++i) {
+        Lock *held = held_locks[i];
+        KnownEdge &known = KnownEdgeSlot(held, this);
+        known.from = held;
+        known.to = this;
+        known.epoch = epoch;
+        if (!Graph()[held].insert(this).second) {
+            continue;
+        }
+        std::set<const Lock*> visited;
+        std::vector<const Lock*> path;
+        if (report.empty() && FindPath(this, held, &visited, &path)) {
+            report = "lock order inversion: acquiring " + Describe() +
+                    " while holding " + held->Describe() +
+                    ", but they were taken in the opposite order before:\n";
+            for (size_t j = 0; j < path.size(); ++j) {
+                report += j == 0 ? "    " : "    -> ";
+                report += path[j]->Describe();
+                report += '\n';
+            }
+        }
+        held->ordered_ = true;
+        ordered_ = true;
+    }
+    GraphLock().Unlock();
+    if (PREDICT_FALSE(!report.empty())) {
+        order_violation_handler.load()(report);
+    }
+}
+
+void Lock::MarkAcquired()
+{
+    owner_.store(CurrentOwnerId(), std::memory_order_relaxed);
+    if (PREDICT_TRUE(n_held_locks < kMaxHeldLocks)) {
+        held_locks[n_held_locks++] = this;
+        return;
+    }
+    ++n_untracked_locks;
+    if (!untracked_noted.exchange(true, std::memory_order_relaxed)) {
+        fprintf(stderr, "a thread holds more than %d locks; lock order "
+                "checks skip the ones past that\n", kMaxHeldLocks);
+    }
+}
+
+void Lock::CheckHeldAndUnmark()
+{
+    if (owner_.load(std::memory_order_relaxed) != CurrentOwnerId()) {
+        PrintAndAbort("releasing " + Describe() +
+                      ", which this thread does not hold\n");
+    }
+    owner_.store(0, std::memory_order_relaxed);
+    // Usually the last one taken, but locks may be released in any order.
+    for (int i = n_held_locks - 1; i >= 0; --i) {
+        if (held_locks[i] == this) {
+            std::copy(held_locks + i + 1, held_locks + n_held_locks,
+                      held_locks + i);
+            --n_held_locks;
+            return;
+        }
+    }
+    --n_untracked_locks;
+}
+
+std::string Lock::Describe() const
+{
+    char text[64];
+    if (created_at_.line_number() < 0) {
+        snprintf(text, sizeof(text), "lock %p (made at pc %p)",
+                 static_cast<const void*>(this),
+                 created_at_.program_counter());
+        return text;
+    }
+    snprintf(text, sizeof(text), "lock %p (", static_cast<const void*>(this));
+    std::string description(text);
+    description += created_at_.file_name();
+    snprintf(text, sizeof(text), ":%d)", created_at_.line_number());
+    return description + text;
+}
+#endif  // BASE_LOCK_DEBUG
+
+}  // namespace base
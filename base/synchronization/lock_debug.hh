@@ -0,0 +1,54 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_SYNCHRONIZATION_LOCK_DEBUG_HH_
+#define BASE_SYNCHRONIZATION_LOCK_DEBUG_HH_
+
+#include <string>
+
+// Debug builds (those without NDEBUG) check how every base::Lock is used:
+// Lock remembers which thread holds it, so that AssertAcquired() works,
+// and that taking a lock the thread already holds, or releasing one it
+// does not, aborts with a message on stderr. They also record which locks
+// were taken while holding which, and report an acquisition that closes
+// a cycle in that order, which is a deadlock waiting for the right
+// interleaving, even if this run never deadlocks. Locks are told apart
+// in reports by address and construction site. The order checks track
+// the first 32 locks a thread holds at once and skip the rest. Destroying
+// a lock that is held aborts too. Release builds compile all of it out
+// of Lock.
+#if !defined(NDEBUG)
+#define BASE_LOCK_DEBUG 1
+#endif
+
+namespace base {
+
+// Called with the report of a lock order cycle, without any lock held by
+// the order checker. The default handler prints the report to stderr and
+// aborts; one that returns lets the acquisition go ahead, and the same
+// pair of locks is not reported again.
+typedef void (*LockOrderViolationHandler)(const std::string &report);
+// Returns the handler that was set before.
+LockOrderViolationHandler SetLockOrderViolationHandler(
+        LockOrderViolationHandler handler);
+
+}  // namespace base
+
+#endif  // BASE_SYNCHRONIZATION_LOCK_DEBUG_HH_
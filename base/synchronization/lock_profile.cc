@@ -0,0 +1,220 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/synchronization/lock_profile.hh"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "base/strings/string_printf.hh"
+#include "base/synchronization/lock.hh"
+#include "base/time/time.hh"
+
+namespace base {
+namespace internal {
+
+std::atomic<bool> lock_profiling_enabled(false);
+
+namespace {
+
+// Sites made without a Location all have line -1; those are told apart
+// by the address of the code that made them.
+struct SiteLess {
+    bool operator()(const tracked_objects::Location &a,
+                    const tracked_objects::Location &b) const {
+        if (a.line_number() < 0 && b.line_number() < 0) {
+            return a.program_counter() < b.program_counter();
+        }
+        return a < b;
+    }
+};
+typedef std::map<tracked_objects::Location, LockSiteProfile*, SiteLess>
+        SiteMap;
+
+// A plain LockImpl: a profiled Lock here would record itself.
+LockImpl &SitesLock()
+{
+    static LockImpl lock;
+    return lock;
+}
+SiteMap &Sites()
+{
+    static SiteMap sites;
+    return sites;
+}
+
+// A record read at one point in time.
+struct SiteSnapshot {
+    const LockSiteProfile *site;
+    uint64 acquisitions;
+    MicrosecondHistogram::Snapshot wait;
+    MicrosecondHistogram::Snapshot hold;
+};
+
+bool MoreWait(const SiteSnapshot &a, const SiteSnapshot &b)
+{
+    return a.wait.sum_us > b.wait.sum_us;
+}
+
+}  // namespace
+
+LockSiteProfile::LockSiteProfile(const tracked_objects::Location &location)
+        : location(location), acquisitions(0)
+{
+}
+
+LockSiteProfile *GetLockSiteProfile(const tracked_objects::Location &location)
+{
+    SitesLock().Lock();
+    LockSiteProfile *&site = Sites()[location];
+    if (site == NULL) {
+        site = new LockSiteProfile(location);
+    }
+    LockSiteProfile *result = site;
+    SitesLock().Unlock();
+    return result;
+}
+
+}  // namespace internal
+
+bool StartLockProfiling()
+{
+#if defined(BASE_LOCK_PROFILING)
+    internal::lock_profiling_enabled.store(true, std::memory_order_relaxed);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void StopLockProfiling()
+{
+    internal::lock_profiling_enabled.store(false, std::memory_order_relaxed);
+}
+
+bool IsLockProfiling()
+{
+    return internal::LockProfilingEnabled();
+}
+
+void ResetLockProfile()
+{
+    internal::SitesLock().Lock();
+    internal::SiteMap::iterator it;
+    for (it = internal::Sites().begin(); it != internal::Sites().end(); ++it) {
+        internal::LockSiteProfile *site = it->second;
+        site->acquisitions.store(0, std::memory_order_relaxed);
+        site->wait.Reset();
+        site->hold.Reset();
+    }
+    internal::SitesLock().Unlock();
+}
+
+std::string LockProfileText()
+{
+    std::vector<internal::SiteSnapshot> sites;
+    internal::SitesLock().Lock();
+    internal::SiteMap::iterator it;
+    for (it = internal::Sites().begin(); it != internal::Sites().end(); ++it) {
+        internal::SiteSnapshot snapshot;
+        snapshot.site = it->second;
+        snapshot.acquisitions =
+                it->second->acquisitions.load(std::memory_order_relaxed);
+        if (snapshot.acquisitions != 0) {
+            it->second->wait.Read(&snapshot.wait);
+            it->second->hold.Read(&snapshot.hold);
+            sites.push_back(snapshot);
+        }
+    }
+    internal::SitesLock().Unlock();
+    std::stable_sort(sites.begin(), sites.end(), internal::MoreWait);
+
+    std::string out;
+    for (size_t i = 0; i < sites.size(); ++i) {
+        const MicrosecondHistogram::Snapshot &wait = sites[i].wait;
+        const MicrosecondHistogram::Snapshot &hold = sites[i].hold;
+        const tracked_objects::Location &location = sites[i].site->location;
+        if (location.line_number() < 0) {
+            char pc[32];
+            snprintf(pc, sizeof(pc), "pc %p", location.program_counter());
+            out += pc;
+        } else {
+            out += location.file_name();
+            StringAppendF(&out, ":%d", location.line_number());
+            out += " (";
+            out += location.function_name();
+            out += ")";
+        }
+        StringAppendF(&out,
+                      ": acquisitions=%llu contended=%llu wait_us=%llu"
+                      " wait_us_max=%llu hold_us_max=%llu",
+                      static_cast<unsigned long long>(sites[i].acquisitions),
+                      static_cast<unsigned long long>(wait.count),
+                      static_cast<unsigned long long>(wait.sum_us),
+                      static_cast<unsigned long long>(wait.max_us),
+                      static_cast<unsigned long long>(hold.max_us));
+        out += " wait=";
+        MicrosecondHistogram::AppendBucketsText(wait, &out);
+        out += " hold=";
+        MicrosecondHistogram::AppendBucketsText(hold, &out);
+        out += '\n';
+    }
+    return out;
+}
+
+#if defined(BASE_LOCK_PROFILING)
+// Everything is recorded while holding the lock, so locks made at the
+// same site are the only ones that touch a record at the same time.
+void Lock::AcquireProfiled()
+{
+    if (!lock_.Try()) {
+        const int64 start = TimeTicks::Now().ToInternalValue();
+        lock_.Lock();
+        const int64 waited = TimeTicks::Now().ToInternalValue() - start;
+        site_->wait.Record(waited);
+        acquired_at_ = start + waited;
+    } else {
+        acquired_at_ = TimeTicks::Now().ToInternalValue();
+    }
+    site_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Lock::ReleaseProfiled()
+{
+    site_->hold.Record(TimeTicks::Now().ToInternalValue() - acquired_at_);
+    acquired_at_ = 0;
+    lock_.Unlock();
+}
+
+bool Lock::TryProfiled()
+{
+    if (!lock_.Try()) {
+        return false;
+    }
+    acquired_at_ = TimeTicks::Now().ToInternalValue();
+    site_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+#endif  // BASE_LOCK_PROFILING
+
+}  // namespace base
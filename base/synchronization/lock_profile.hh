@@ -0,0 +1,89 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_SYNCHRONIZATION_LOCK_PROFILE_HH_
+#define BASE_SYNCHRONIZATION_LOCK_PROFILE_HH_
+
+#include <atomic>
+#include <string>
+
+#include "base/basictypes.hh"
+#include "base/location.hh"
+#include "base/time/time_histogram.hh"
+
+// Contention profiling for base::Lock. Builds with BASE_LOCK_PROFILING
+// defined (lock_profiling=yes) can switch it on and off at runtime; other
+// builds compile it out of Lock entirely. While on, every Lock counts its
+// acquisitions, those that had to wait, the time spent waiting and the
+// time the lock was held, in TimeTicks microseconds. Locks made at the
+// same construction site share one record: the Location given to
+// Lock(const tracked_objects::Location&), or the address of the code that
+// made the lock. Records are only updated while holding the lock they
+// describe, so profiling adds two clock reads and a few uncontended
+// atomic adds per acquisition, plus one more clock read for a contended
+// one.
+
+namespace base {
+
+// Start returns false if the build has no profiling in it.
+bool StartLockProfiling();
+void StopLockProfiling();
+bool IsLockProfiling();
+// Zeroes every record.
+void ResetLockProfile();
+// One line per construction site that has been acquired, most total wait
+// first, e.g.
+//   net/conn.cc:42 (Connect): acquisitions=1000 contended=12 wait_us=340
+//   wait_us_max=90 hold_us_max=3 wait=<1:2,<128:10 hold=<1:990,<4:10
+// (without the line break). The histograms list their non-empty
+// power-of-two buckets as "<limit:count", in microseconds. Locks without
+// a Location show as "pc 0x..." instead of file:line.
+std::string LockProfileText();
+
+namespace internal {
+
+extern std::atomic<bool> lock_profiling_enabled;
+
+inline bool LockProfilingEnabled()
+{
+    return lock_profiling_enabled.load(std::memory_order_relaxed);
+}
+
+// The record of one construction site.
+struct LockSiteProfile {
+    explicit LockSiteProfile(const tracked_objects::Location &location);
+
+    const tracked_objects::Location location;
+    std::atomic<uint64> acquisitions;
+    // Only contended acquisitions wait, so its count and sum are the
+    // contended and wait_us of LockProfileText().
+    MicrosecondHistogram wait;
+    MicrosecondHistogram hold;
+    DISALLOW_COPY_AND_ASSIGN(LockSiteProfile);
+};
+
+// The record shared by every lock made at |location|. Records live for
+// the rest of the process.
+LockSiteProfile *GetLockSiteProfile(const tracked_objects::Location &location);
+
+}  // namespace internal
+}  // namespace base
+
+#endif  // BASE_SYNCHRONIZATION_LOCK_PROFILE_HH_
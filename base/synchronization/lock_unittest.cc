@@ -0,0 +1,504 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "base/synchronization/condition_variable.hh"
+#include "base/synchronization/lock.hh"
+#include "base/synchronization/lock_profile.hh"
+#include "base/synchronization/rw_lock.hh"
+#include "base/synchronization/waitable_event.hh"
+#include "base/time/time.hh"
+#include "unit_testing/gtest-1.7.0/include/gtest/gtest.h"
+
+namespace {
+
+const int kThreads = 8;
+
+template <typename LockType>
+struct CounterArgs {
+    LockType *lock;
+    int iterations;
+    long *counter;
+};
+
+template <typename LockType>
+void *IncrementCounter(void *arg)
+{
+    CounterArgs<LockType> *args = static_cast<CounterArgs<LockType>*>(arg);
+    for (int i = 0; i < args->iterations; ++i) {
+        args->lock->Lock();
+        const long value = *args->counter;
+        *args->counter = value + 1;
+        args->lock->Unlock();
+    }
+    return NULL;
+}
+
+template <typename LockType>
+long CountUnderLock(int iterations)
+{
+    LockType lock;
+    long counter = 0;
+    CounterArgs<LockType> args = { &lock, iterations, &counter };
+    std::vector<pthread_t> threads(kThreads);
+    for (int i = 0; i < kThreads; ++i) {
+        pthread_create(&threads[i], NULL, IncrementCounter<LockType>, &args);
+    }
+    for (int i = 0; i < kThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    return counter;
+}
+
+// Parks on the futex until the test releases |lock|.
+void *LockOnce(void *arg)
+{
+    CounterArgs<base::internal::AdaptiveLockImpl> *args =
+            static_cast<CounterArgs<base::internal::AdaptiveLockImpl>*>(arg);
+    args->lock->Lock();
+    ++*args->counter;
+    args->lock->Unlock();
+    return NULL;
+}
+
+void *TryLock(void *arg)
+{
+    base::Lock *lock = static_cast<base::Lock*>(arg);
+    if (!lock->Try()) {
+        return NULL;
+    }
+    lock->Release();
+    return lock;
+}
+
+}  // namespace
+
+TEST(LockTest, AdaptiveLockExcludes)
+{
+    typedef base::internal::AdaptiveLockImpl AdaptiveLock;
+    EXPECT_EQ(kThreads * 100000L, CountUnderLock<AdaptiveLock>(100000));
+    // Straight to the futex, and spinning for longer than anyone holds it.
+    AdaptiveLock::SetSpinLimits(0, 1);
+    EXPECT_EQ(kThreads * 100000L, CountUnderLock<AdaptiveLock>(100000));
+    AdaptiveLock::SetSpinLimits(1 << 20, 64);
+    EXPECT_EQ(kThreads * 100000L, CountUnderLock<AdaptiveLock>(100000));
+    AdaptiveLock::SetSpinLimits(4096, 64);
+
+    AdaptiveLock lock;
+    EXPECT_TRUE(lock.Try());
+    EXPECT_FALSE(lock.Try());
+    lock.Unlock();
+    base::Lock base_lock;
+    EXPECT_TRUE(base_lock.Try());
+    // Trying a lock the thread holds is an error in debug builds.
+    pthread_t thread;
+    pthread_create(&thread, NULL, TryLock, &base_lock);
+    void *acquired;
+    pthread_join(thread, &acquired);
+    EXPECT_EQ(NULL, acquired);
+    base_lock.Release();
+}
+
+TEST(LockTest, AdaptiveLockWakesSleepers)
+{
+    typedef base::internal::AdaptiveLockImpl AdaptiveLock;
+    AdaptiveLock::SetSpinLimits(0, 1);
+    AdaptiveLock lock;
+    long counter = 0;
+    CounterArgs<AdaptiveLock> args = { &lock, 1, &counter };
+    lock.Lock();
+    std::vector<pthread_t> threads(kThreads);
+    for (int i = 0; i < kThreads; ++i) {
+        pthread_create(&threads[i], NULL, LockOnce, &args);
+    }
+    usleep(20000);
+    EXPECT_EQ(0, counter);
+    // Every unlock from here on must wake the next sleeper.
+    lock.Unlock();
+    for (int i = 0; i < kThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    EXPECT_EQ(kThreads, counter);
+    EXPECT_TRUE(lock.Try());
+    lock.Unlock();
+    AdaptiveLock::SetSpinLimits(4096, 64);
+}
+
+namespace {
+
+// Writers keep first == second; readers check they never see otherwise.
+struct SharedPair {
+    base::RWLock lock;
+    long first;
+    long second;
+    std::atomic<bool> stop;
+    std::atomic<long> reads;
+    std::atomic<long> torn_reads;
+};
+
+void *ReadPair(void *arg)
+{
+    SharedPair *shared = static_cast<SharedPair*>(arg);
+    while (!shared->stop.load()) {
+        {
+            base::AutoReadLock l(shared->lock);
+            if (shared->first != shared->second) {
+                shared->torn_reads.fetch_add(1);
+            }
+            shared->reads.fetch_add(1);
+        }
+        sched_yield();
+    }
+    return NULL;
+}
+
+void *HoldReadLock(void *arg)
+{
+    SharedPair *shared = static_cast<SharedPair*>(arg);
+    base::AutoReadLock l(shared->lock);
+    shared->reads.fetch_add(1);
+    while (!shared->stop.load()) {
+        sched_yield();
+    }
+    return NULL;
+}
+
+}  // namespace
+
+TEST(RWLockTest, ReadersShareWritersExclude)
+{
+    SharedPair shared;
+    shared.first = shared.second = 0;
+    shared.stop = false;
+    shared.reads = 0;
+    shared.torn_reads = 0;
+
+    // A second reader gets in while the first holds the lock.
+    pthread_t holder;
+    pthread_create(&holder, NULL, HoldReadLock, &shared);
+    while (shared.reads.load() == 0) {
+        sched_yield();
+    }
+    {
+        base::AutoReadLock l(shared.lock);
+        EXPECT_EQ(0, shared.first);
+    }
+    shared.stop = true;
+    pthread_join(holder, NULL);
+
+    shared.stop = false;
+    std::vector<pthread_t> readers(kThreads);
+    for (int i = 0; i < kThreads; ++i) {
+        pthread_create(&readers[i], NULL, ReadPair, &shared);
+    }
+    // The readers seldom let go all at once, so the writer mostly gets in
+    // because it is preferred.
+    for (int i = 0; i < 200; ++i) {
+        base::AutoWriteLock l(shared.lock);
+        ++shared.first;
+        sched_yield();
+        ++shared.second;
+    }
+    shared.stop = true;
+    for (int i = 0; i < kThreads; ++i) {
+        pthread_join(readers[i], NULL);
+    }
+    EXPECT_EQ(200, shared.second);
+    EXPECT_LT(0, shared.reads.load());
+    EXPECT_EQ(0, shared.torn_reads.load());
+}
+
+namespace {
+
+// A bounded queue of ints, handed from producers to consumers.
+struct IntQueue {
+    IntQueue() : not_empty(&lock), not_full(&lock), closed(false), sum(0) {
+    }
+    base::Lock lock;
+    base::ConditionVariable not_empty;
+    base::ConditionVariable not_full;
+    std::vector<int> items;
+    bool closed;
+    long sum;
+};
+
+void *ProduceInts(void *arg)
+{
+    IntQueue *queue = static_cast<IntQueue*>(arg);
+    for (int i = 1; i <= 1000; ++i) {
+        base::AutoLock l(queue->lock);
+        while (queue->items.size() >= 4) {
+            queue->not_full.Wait();
+        }
+        queue->items.push_back(i);
+        queue->not_empty.Signal();
+    }
+    return NULL;
+}
+
+void *ConsumeInts(void *arg)
+{
+    IntQueue *queue = static_cast<IntQueue*>(arg);
+    base::AutoLock l(queue->lock);
+    for (;;) {
+        while (queue->items.empty() && !queue->closed) {
+            queue->not_empty.Wait();
+        }
+        if (queue->items.empty()) {
+            return NULL;
+        }
+        queue->sum += queue->items.back();
+        queue->items.pop_back();
+        queue->not_full.Signal();
+    }
+}
+
+void *SignalEvent(void *arg)
+{
+    static_cast<base::WaitableEvent*>(arg)->Signal();
+    return NULL;
+}
+
+}  // namespace
+
+TEST(ConditionVariableTest, HandsOffEveryItem)
+{
+    IntQueue queue;
+    pthread_t producers[2];
+    pthread_t consumers[3];
+    for (int i = 0; i < 3; ++i) {
+        pthread_create(&consumers[i], NULL, ConsumeInts, &queue);
+    }
+    for (int i = 0; i < 2; ++i) {
+        pthread_create(&producers[i], NULL, ProduceInts, &queue);
+    }
+    for (int i = 0; i < 2; ++i) {
+        pthread_join(producers[i], NULL);
+    }
+    {
+        base::AutoLock l(queue.lock);
+        queue.closed = true;
+        queue.not_empty.Broadcast();
+    }
+    for (int i = 0; i < 3; ++i) {
+        pthread_join(consumers[i], NULL);
+    }
+    EXPECT_EQ(2 * 1000 * 1001 / 2, queue.sum);
+
+    base::AutoLock l(queue.lock);
+    const base::TimeTicks start = base::TimeTicks::Now();
+    queue.not_empty.TimedWait(base::TimeDelta::FromMilliseconds(20));
+    EXPECT_LE(15, (base::TimeTicks::Now() - start).InMilliseconds());
+}
+
+TEST(WaitableEventTest, ManualAndAutoReset)
+{
+    base::WaitableEvent manual(base::WaitableEvent::kManualReset,
+                               base::WaitableEvent::kSignaled);
+    EXPECT_TRUE(manual.IsSignaled());
+    EXPECT_TRUE(manual.TimedWait(base::TimeDelta()));
+    manual.Wait();
+    manual.Reset();
+    EXPECT_FALSE(manual.IsSignaled());
+    EXPECT_FALSE(manual.TimedWait(base::TimeDelta::FromMilliseconds(10)));
+
+    base::WaitableEvent automatic(base::WaitableEvent::kAutoReset,
+                                  base::WaitableEvent::kNotSignaled);
+    automatic.Signal();
+    automatic.Signal();
+    EXPECT_TRUE(automatic.IsSignaled());
+    EXPECT_FALSE(automatic.IsSignaled());
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, SignalEvent, &automatic);
+    EXPECT_TRUE(automatic.TimedWait(base::TimeDelta::FromSeconds(10)));
+    pthread_join(thread, NULL);
+    EXPECT_FALSE(automatic.IsSignaled());
+}
+
+TEST(WaitableEventTest, WaitManyReturnsTheSignaledEvent)
+{
+    base::WaitableEvent a(base::WaitableEvent::kAutoReset,
+                          base::WaitableEvent::kNotSignaled);
+    base::WaitableEvent b(base::WaitableEvent::kManualReset,
+                          base::WaitableEvent::kNotSignaled);
+    base::WaitableEvent *events[] = { &a, &b };
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, SignalEvent, &b);
+    EXPECT_EQ(1u, base::WaitableEvent::WaitMany(events, 2));
+    pthread_join(thread, NULL);
+    EXPECT_TRUE(b.IsSignaled());
+
+    // The first signaled one wins, and an auto-reset one is reset.
+    a.Signal();
+    EXPECT_EQ(0u, base::WaitableEvent::WaitMany(events, 2));
+    EXPECT_FALSE(a.IsSignaled());
+    EXPECT_EQ(1u, base::WaitableEvent::WaitMany(events, 2));
+}
+
+#if defined(BASE_LOCK_DEBUG)
+namespace {
+
+std::string last_order_report;
+
+void SaveOrderReport(const std::string &report)
+{
+    last_order_report = report;
+}
+
+}  // namespace
+
+TEST(LockDebugTest, AssertAcquiredChecksTheOwner)
+{
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    base::Lock lock;
+    EXPECT_DEATH(lock.AssertAcquired(), "is not held by this thread");
+    EXPECT_DEATH(lock.Release(), "which this thread does not hold");
+    base::AutoLock l(lock);
+    lock.AssertAcquired();
+    EXPECT_DEATH(lock.Acquire(), "which this thread already holds");
+}
+
+TEST(LockDebugTest, ReportsLockOrderCycles)
+{
+    base::LockOrderViolationHandler old_handler =
+            base::SetLockOrderViolationHandler(SaveOrderReport);
+    base::Lock a(FROM_HERE);
+    base::Lock b(FROM_HERE);
+    base::Lock c(FROM_HERE);
+    {
+        base::AutoLock la(a);
+        base::AutoLock lb(b);
+    }
+    {
+        base::AutoLock lb(b);
+        base::AutoLock lc(c);
+    }
+    EXPECT_EQ("", last_order_report);
+    {
+        // Releasing out of order is fine.
+        b.Acquire();
+        c.Acquire();
+        b.Release();
+        c.Release();
+    }
+    EXPECT_EQ("", last_order_report);
+    {
+        base::AutoLock lc(c);
+        base::AutoLock la(a);
+    }
+    EXPECT_NE(std::string::npos,
+              last_order_report.find("lock order inversion"));
+    EXPECT_NE(std::string::npos, last_order_report.find("lock_unittest.cc"));
+    // a -> b -> c was seen before c -> a.
+    EXPECT_EQ(3, std::count(last_order_report.begin(),
+                            last_order_report.end(), '\n') - 1);
+
+    // Reported once per pair.
+    last_order_report.clear();
+    {
+        base::AutoLock lc(c);
+        base::AutoLock la(a);
+    }
+    EXPECT_EQ("", last_order_report);
+    base::SetLockOrderViolationHandler(old_handler);
+}
+
+TEST(LockDebugTest, ManyHeldLocks)
+{
+    base::LockOrderViolationHandler old_handler =
+            base::SetLockOrderViolationHandler(SaveOrderReport);
+    last_order_report.clear();
+    // More than the 32 locks a thread's order checks track.
+    const int kLocks = 40;
+    std::vector<base::Lock*> locks;
+    for (int i = 0; i < kLocks; ++i) {
+        locks.push_back(new base::Lock(FROM_HERE));
+        locks.back()->Acquire();
+    }
+    // Releasing the first ones must not leave them behind as held.
+    for (int i = 0; i < kLocks - 1; ++i) {
+        locks[i]->Release();
+    }
+    base::Lock later(FROM_HERE);
+    later.Acquire();
+    later.Release();
+    locks[kLocks - 1]->Release();
+    for (int i = 0; i < kLocks; ++i) {
+        base::AutoLock l(later);
+        base::AutoLock li(*locks[i]);
+    }
+    EXPECT_EQ("", last_order_report);
+    for (int i = 0; i < kLocks; ++i) {
+        delete locks[i];
+    }
+    base::SetLockOrderViolationHandler(old_handler);
+}
+
+TEST(LockDebugTest, DestroyingHeldLockDies)
+{
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    EXPECT_DEATH({
+        base::Lock *lock = new base::Lock;
+        lock->Acquire();
+        delete lock;
+    }, "which is held");
+}
+#endif  // BASE_LOCK_DEBUG
+
+#if defined(BASE_LOCK_PROFILING)
+namespace {
+
+void *AcquireAndRelease(void *arg)
+{
+    CounterArgs<base::Lock> *args = static_cast<CounterArgs<base::Lock>*>(arg);
+    for (int i = 0; i < args->iterations; ++i) {
+        base::AutoLock l(*args->lock);
+        ++*args->counter;
+    }
+    return NULL;
+}
+
+}  // namespace
+
+TEST(LockProfileTest, RecordsContentionBySite)
+{
+    ASSERT_TRUE(base::StartLockProfiling());
+    base::ResetLockProfile();
+    base::Lock lock(FROM_HERE);
+    long counter = 0;
+    CounterArgs<base::Lock> args = { &lock, 1000, &counter };
+    std::vector<pthread_t> threads(kThreads);
+    for (int i = 0; i < kThreads; ++i) {
+        pthread_create(&threads[i], NULL, AcquireAndRelease, &args);
+    }
+    for (int i = 0; i < kThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    base::StopLockProfiling();
+    EXPECT_EQ(kThreads * 1000, counter);
+
+    const std::string text = base::LockProfileText();
+    const size_t site = text.find("lock_unittest.cc:");
+    ASSERT_NE(std::string::npos, site) << text;
+    EXPECT_NE(std::string::npos,
+              text.find("acquisitions=8000 ", site)) << text;
+
+    // Locks taken while profiling is off are not counted.
+    lock.Acquire();
+    lock.Release();
+    EXPECT_EQ(text, base::LockProfileText());
+}
+#else
+TEST(LockProfileTest, OffUnlessCompiledIn)
+{
+    EXPECT_FALSE(base::StartLockProfiling());
+    EXPECT_FALSE(base::IsLockProfiling());
+    EXPECT_EQ("", base::LockProfileText());
+}
+#endif  // BASE_LOCK_PROFILING
@@ -0,0 +1,135 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/synchronization/rw_lock.hh"
+
+#include <limits.h>
+#include <unistd.h>
+
+#include "base/synchronization/futex.hh"
+
+namespace base {
+
+namespace internal {
+
+__thread int rw_lock_slot = 0;
+
+namespace {
+std::atomic<unsigned int> next_rw_lock_slot(0);
+}  // namespace
+
+int AssignRWLockSlot()
+{
+    rw_lock_slot = static_cast<int>(
+            next_rw_lock_slot.fetch_add(1, std::memory_order_relaxed) %
+            RWLock::kReaderSlots) + 1;
+    return rw_lock_slot;
+}
+
+}  // namespace internal
+
+namespace {
+
+// Pauses to spin for before sleeping; spinning is pointless on one CPU.
+int SpinPauses()
+{
+    static const int pauses = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 1000 : 0;
+    return pauses;
+}
+
+}  // namespace
+
+const int RWLock::kReaderSlots;
+
+RWLock::RWLock() : writer_(kNoWriter)
+{
+    for (int i = 0; i < kReaderSlots; ++i) {
+        readers_[i].count.store(0, std::memory_order_relaxed);
+    }
+}
+
+RWLock::~RWLock()
+{
+}
+
+// A writer is in or on its way: step out of our slot, so that it does
+// not wait for us, and come back once it is gone.
+void RWLock::ReadAcquireSlow(std::atomic<int> *readers)
+{
+    do {
+        LeaveReaderSlot(readers);
+        const int pauses = SpinPauses();
+        for (int i = 0; i < pauses &&
+                     writer_.load(std::memory_order_acquire) != kNoWriter;
+             ++i) {
+            internal::CpuRelax();
+        }
+        int writer = writer_.load(std::memory_order_acquire);
+        while (writer != kNoWriter) {
+            if (writer == kWriter &&
+                !writer_.compare_exchange_weak(writer, kWriterWithSleepers,
+                                               std::memory_order_acquire)) {
+                continue;
+            }
+            internal::FutexWait(&writer_, kWriterWithSleepers);
+            writer = writer_.load(std::memory_order_acquire);
+        }
+        readers->fetch_add(1, std::memory_order_seq_cst);
+    } while (writer_.load(std::memory_order_seq_cst) != kNoWriter);
+}
+
+// The writer sleeps on a slot while it is not empty; see WriteAcquire().
+void RWLock::WakeWriter(std::atomic<int> *readers)
+{
+    internal::FutexWake(readers, 1);
+}
+
+void RWLock::WriteAcquire()
+{
+    writer_lock_.Acquire();
+    writer_.store(kWriter, std::memory_order_seq_cst);
+    // Readers that got in before the flag went up leave on their own;
+    // the last one out of a slot wakes us if we sleep on it.
+    const int pauses = SpinPauses();
+    for (int i = 0; i < kReaderSlots; ++i) {
+        std::atomic<int> *readers = &readers_[i].count;
+        int spins = 0;
+        int count;
+        while ((count = readers->load(std::memory_order_seq_cst)) != 0) {
+            if (spins < pauses) {
+                internal::CpuRelax();
+                ++spins;
+            } else {
+                internal::FutexWait(readers, count);
+            }
+        }
+    }
+}
+
+void RWLock::WriteRelease()
+{
+    if (writer_.exchange(kNoWriter, std::memory_order_release) ==
+        kWriterWithSleepers) {
+        internal::FutexWake(&writer_, INT_MAX);
+    }
+    writer_lock_.Release();
+}
+
+}  // namespace base
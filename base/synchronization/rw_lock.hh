@@ -0,0 +1,144 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_SYNCHRONIZATION_RW_LOCK_HH_
+#define BASE_SYNCHRONIZATION_RW_LOCK_HH_
+
+#include <atomic>
+
+#include "base/basictypes.hh"
+#include "base/compiler_specific.hh"
+#include "base/synchronization/lock.hh"
+
+namespace base {
+
+namespace internal {
+// The reader slot of the calling thread, 1-based; 0 until it is needed.
+extern __thread int rw_lock_slot;
+int AssignRWLockSlot();
+}  // namespace internal
+
+// A reader-writer lock for read-mostly data such as config snapshots and
+// registries. Readers do not share a cache line: each thread counts itself
+// in one of kReaderSlots counters, picked round robin the first time it
+// reads, so uncontended readers only touch their own slot and the writer
+// flag, which stays in every reader's cache while no writer comes along.
+//
+// Writers are preferred: a writer first raises the flag, which turns new
+// readers away, and then waits for every slot to drain, so a steady
+// stream of readers can not starve it. Writers are serialized among
+// themselves by a Lock. Both sides spin briefly before sleeping on a
+// futex. Neither is recursive; in particular a thread must not take the
+// read lock again while holding it, as a writer may be waiting between
+// the two.
+class RWLock {
+public:
+    static const int kReaderSlots = 16;
+
+    RWLock();
+    ~RWLock();
+
+    void ReadAcquire() {
+        std::atomic<int> *readers = CurrentReaderSlot();
+        readers->fetch_add(1, std::memory_order_seq_cst);
+        if (PREDICT_FALSE(writer_.load(std::memory_order_seq_cst) !=
+                          kNoWriter)) {
+            ReadAcquireSlow(readers);
+        }
+    }
+    void ReadRelease() {
+        LeaveReaderSlot(CurrentReaderSlot());
+    }
+    void WriteAcquire();
+    void WriteRelease();
+
+private:
+    enum {
+        kNoWriter,
+        kWriter,
+        // A writer is in, and readers may be sleeping until it leaves.
+        kWriterWithSleepers,
+    };
+    // Padded rather than aligned: an RWLock may be a member of anything
+    // made with plain new, which C++11 does not align past 16 bytes.
+    // Counts a cache line apart never share one either way.
+    struct ReaderSlot {
+        std::atomic<int> count;
+        char pad[64 - sizeof(std::atomic<int>)];
+    };
+
+    std::atomic<int> *CurrentReaderSlot() {
+        int slot = internal::rw_lock_slot;
+        if (PREDICT_FALSE(slot == 0)) {
+            slot = internal::AssignRWLockSlot();
+        }
+        return &readers_[slot - 1].count;
+    }
+    void LeaveReaderSlot(std::atomic<int> *readers) {
+        if (PREDICT_FALSE(readers->fetch_sub(1, std::memory_order_seq_cst) ==
+                          1 &&
+                          writer_.load(std::memory_order_seq_cst) !=
+                          kNoWriter)) {
+            WakeWriter(readers);
+        }
+    }
+    void ReadAcquireSlow(std::atomic<int> *readers);
+    void WakeWriter(std::atomic<int> *readers);
+
+    // The last slot's padding keeps writer_ off its cache line.
+    ReaderSlot readers_[kReaderSlots];
+    std::atomic<int> writer_;
+    Lock writer_lock_;
+    DISALLOW_COPY_AND_ASSIGN(RWLock);
+};
+
+class AutoReadLock {
+public:
+    explicit AutoReadLock(RWLock &lock) : lock_(lock) {
+        lock_.ReadAcquire();
+    }
+
+    ~AutoReadLock() {
+        lock_.ReadRelease();
+    }
+
+private:
+    RWLock &lock_;
+    DISALLOW_COPY_AND_ASSIGN(AutoReadLock);
+};
+
+class AutoWriteLock {
+public:
+    explicit AutoWriteLock(RWLock &lock) : lock_(lock) {
+        lock_.WriteAcquire();
+    }
+
+    ~AutoWriteLock() {
+        lock_.WriteRelease();
+    }
+
+private:
+    RWLock &lock_;
+    DISALLOW_COPY_AND_ASSIGN(AutoWriteLock);
+};
+
+}  // namespace base
+
+#endif  // BASE_SYNCHRONIZATION_RW_LOCK_HH_
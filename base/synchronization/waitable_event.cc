@@ -0,0 +1,140 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/synchronization/waitable_event.hh"
+
+#include <limits>
+
+#include "base/synchronization/futex.hh"
+
+namespace base {
+namespace {
+
+// Bumped by every Signal() while someone is in WaitMany(), which sleeps
+// on it.
+std::atomic<int> wait_many_sequence(0);
+std::atomic<int> wait_many_waiters(0);
+
+}  // namespace
+
+WaitableEvent::WaitableEvent(ResetPolicy reset_policy,
+                             InitialState initial_state)
+        : auto_reset_(reset_policy == kAutoReset),
+          state_(initial_state),
+          waiters_(0)
+{
+}
+
+WaitableEvent::~WaitableEvent()
+{
+}
+
+void WaitableEvent::Reset()
+{
+    state_.store(kNotSignaled);
+}
+
+// Waiters count themselves before their last look at the state, so
+// either they see it signaled or we see them and wake them.
+void WaitableEvent::Signal()
+{
+    if (state_.exchange(kSignaled) == kSignaled) {
+        return;
+    }
+    if (waiters_.load() > 0) {
+        internal::FutexWake(&state_, auto_reset_ ? 1 :
+                            std::numeric_limits<int>::max());
+    }
+    if (wait_many_waiters.load() > 0) {
+        wait_many_sequence.fetch_add(1);
+        internal::FutexWake(&wait_many_sequence,
+                            std::numeric_limits<int>::max());
+    }
+}
+
+bool WaitableEvent::IsSignaled()
+{
+    return TryConsume();
+}
+
+void WaitableEvent::Wait()
+{
+    TimedWait(TimeDelta::Max());
+}
+
+bool WaitableEvent::TimedWait(const TimeDelta &max_time)
+{
+    if (TryConsume()) {
+        return true;
+    }
+    const bool forever = max_time.is_max();
+    const TimeTicks deadline = forever ? TimeTicks() :
+            TimeTicks::Now() + max_time;
+    bool signaled = false;
+    waiters_.fetch_add(1);
+    for (;;) {
+        if (TryConsume()) {
+            signaled = true;
+            break;
+        }
+        if (forever) {
+            internal::FutexWait(&state_, kNotSignaled);
+            continue;
+        }
+        const TimeDelta left = deadline - TimeTicks::Now();
+        if (left <= TimeDelta()) {
+            break;
+        }
+        const struct timespec timeout =
+                internal::FutexTimeout(left.InMicroseconds());
+        internal::FutexWait(&state_, kNotSignaled, &timeout);
+    }
+    waiters_.fetch_sub(1);
+    return signaled;
+}
+
+// static function
+size_t WaitableEvent::WaitMany(WaitableEvent **events, size_t count)
+{
+    wait_many_waiters.fetch_add(1);
+    for (;;) {
+        // Read before looking at the events, so that a Signal() after the
+        // look changes it and FutexWait() returns at once.
+        const int sequence = wait_many_sequence.load();
+        for (size_t i = 0; i < count; ++i) {
+            if (events[i]->TryConsume()) {
+                wait_many_waiters.fetch_sub(1);
+                return i;
+            }
+        }
+        internal::FutexWait(&wait_many_sequence, sequence);
+    }
+}
+
+bool WaitableEvent::TryConsume()
+{
+    if (!auto_reset_) {
+        return state_.load() == kSignaled;
+    }
+    int expected = kSignaled;
+    return state_.compare_exchange_strong(expected, kNotSignaled);
+}
+
+}  // namespace base
@@ -0,0 +1,82 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_SYNCHRONIZATION_WAITABLE_EVENT_HH_
+#define BASE_SYNCHRONIZATION_WAITABLE_EVENT_HH_
+
+#include <stddef.h>
+
+#include <atomic>
+
+#include "base/basictypes.hh"
+#include "base/time/time.hh"
+
+namespace base {
+
+// An event threads can sleep on until another thread signals it. A
+// manual-reset event stays signaled, letting every waiter through, until
+// Reset(); an auto-reset event lets exactly one waiter through per
+// Signal() and is reset by it. Signaling an event that is signaled
+// already does nothing.
+//
+// The event is one futex word. Signal() makes no system call while
+// nobody waits on the event, and Wait() none while it is signaled.
+class WaitableEvent {
+public:
+    enum ResetPolicy {
+        kManualReset,
+        kAutoReset,
+    };
+    enum InitialState {
+        kNotSignaled,
+        kSignaled,
+    };
+
+    WaitableEvent(ResetPolicy reset_policy, InitialState initial_state);
+    ~WaitableEvent();
+
+    void Reset();
+    void Signal();
+    // Resets an auto-reset event if it returns true.
+    bool IsSignaled();
+    void Wait();
+    // Returns false if |max_time| passed without the event being signaled.
+    bool TimedWait(const TimeDelta &max_time);
+
+    // Waits for any of the |count| (at least one) events, and returns the
+    // index of the first that is signaled, having reset it if it is an
+    // auto-reset event. Callers of WaitMany() sleep on one futex that
+    // every Signal() wakes while any of them waits, so they are meant for
+    // a few threads watching several sources, not for hot paths.
+    static size_t WaitMany(WaitableEvent **events, size_t count);
+
+private:
+    bool TryConsume();
+
+    const bool auto_reset_;
+    std::atomic<int> state_;
+    // Threads in Wait() or TimedWait() on this event
+    std::atomic<int> waiters_;
+    DISALLOW_COPY_AND_ASSIGN(WaitableEvent);
+};
+
+}  // namespace base
+
+#endif  // BASE_SYNCHRONIZATION_WAITABLE_EVENT_HH_
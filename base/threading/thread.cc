@@ -0,0 +1,85 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/threading/thread.hh"
+
+namespace base {
+
+namespace {
+__thread Thread *current_thread = NULL;
+}  // namespace
+
+Thread::~Thread()
+{
+    Stop();
+}
+
+// static function
+void *Thread::ThreadMain(void *arg)
+{
+    Thread *thread = static_cast<Thread*>(arg);
+    current_thread = thread;
+    // Linux limits thread names to 15 characters plus the terminator.
+    pthread_setname_np(pthread_self(), thread->name_.substr(0, 15).c_str());
+    thread->Init();
+    thread->Run();
+    current_thread = NULL;
+    thread->running_.store(false, std::memory_order_release);
+    return NULL;
+}
+
+// static function
+Thread *Thread::Current()
+{
+    return current_thread;
+}
+
+bool Thread::Start()
+{
+    if (joinable_) {
+        return false;
+    }
+    stopping_.store(false, std::memory_order_release);
+    running_.store(true, std::memory_order_release);
+    if (pthread_create(&thread_, NULL, ThreadMain, this) != 0) {
+        running_.store(false, std::memory_order_release);
+        return false;
+    }
+    joinable_ = true;
+    return true;
+}
+
+void Thread::Stop()
+{
+    if (!joinable_) {
+        return;
+    }
+    stopping_.store(true, std::memory_order_release);
+    wake_.Signal();
+    pthread_join(thread_, NULL);
+    joinable_ = false;
+}
+
+bool Thread::IsRunning() const
+{
+    return running_.load(std::memory_order_acquire);
+}
+
+}  // namespace base
@@ -23,21 +23,41 @@
 
 #include <pthread.h>
 
+#include <atomic>
+#include <string>
+
 #include "base/basictypes.hh"
+#include "base/synchronization/waitable_event.hh"
+#include "base/time/time.hh"
 
 namespace base {
 class Thread {
 public:
     explicit Thread(const std::string &name) :
-            name_(name) {}
+            running_(false), stopping_(false), joinable_(false),
+            name_(name),
+            wake_(WaitableEvent::kAutoReset, WaitableEvent::kNotSignaled) {}
+    // The subclass destructor must call Stop() itself if Run() touches
+    // any subclass member, since those are gone by the time we get here.
     virtual ~Thread();
 
+    // Starts the thread, which calls Init() and then Run().
+    // Returns false if the thread could not be created.
     bool Start();
     // bool StartWithOptions(const Options &options);
+    // Asks Run() to return (see stopping()), wakes it and joins the
+    // thread.
     void Stop();
+    // Ends the current or next WaitForWork() of Run().
+    void Wake() {
+        wake_.Signal();
+    }
     const std::string &ThreadName() const {
         return name_;
     }
+    // Returns the Thread whose Run() the calling thread is executing, or
+    // NULL if the caller was not started by a base::Thread.
+    static Thread *Current();
     bool IsRunning() const;
     void SetPriority(int priority);
     void SetAffinity(int core_id) {
@@ -52,12 +72,27 @@ public:
 protected:
     virtual void Init() {}
     virtual void Run() {}
+    // Long-running Run() implementations poll this and return once it
+    // becomes true.
+    bool stopping() const {
+        return stopping_.load(std::memory_order_acquire);
+    }
+    // Sleeps until Wake() or Stop() is called, or |max_time| passes, for
+    // Run() implementations that are out of work. A Wake() since the last
+    // call makes it return at once.
+    void WaitForWork(const TimeDelta &max_time) {
+        wake_.TimedWait(max_time);
+    }
 
 private:
-    bool running_;
-    bool stopping_;
+    static void *ThreadMain(void *arg);
+
+    std::atomic<bool> running_;
+    std::atomic<bool> stopping_;
     bool joinable_;
+    pthread_t thread_;
     std::string name_;
+    WaitableEvent wake_;
     DISALLOW_COPY_AND_ASSIGN(Thread);
 };
 }      // namespace base
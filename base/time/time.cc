@@ -49,6 +49,20 @@ TimeDelta TimeDelta::FromMinutes(int minutes) {
     return TimeDelta(minutes * kMicrosecondsPerMinute);
 }
 
+TimeDelta TimeDelta::FromSeconds(int64 secs) {
+    if (secs == std::numeric_limits<int64>::max()) {
+        return Max();
+    }
+    return TimeDelta(secs * kMicrosecondsPerSecond);
+}
+
+TimeDelta TimeDelta::FromMilliseconds(int64 ms) {
+    if (ms == std::numeric_limits<int64>::max()) {
+        return Max();
+    }
+    return TimeDelta(ms * kMicrosecondsPerMillisecond);
+}
+
 int TimeDelta::InDays() const {
     if (is_max()) {
         return std::numeric_limits<int>::max();
@@ -70,6 +84,20 @@ int TimeDelta::InMinutes() const {
     return static_cast<int>(delta_ / kMicrosecondsPerMinute);
 }
 
+int64 TimeDelta::InSeconds() const {
+    if (is_max()) {
+        return std::numeric_limits<int64>::max();
+    }
+    return delta_ / kMicrosecondsPerSecond;
+}
+
+int64 TimeDelta::InMilliseconds() const {
+    if (is_max()) {
+        return std::numeric_limits<int64>::max();
+    }
+    return delta_ / kMicrosecondsPerMillisecond;
+}
+
 
 // Time
 // static function
@@ -55,6 +55,11 @@ public:
     static TimeDelta FromDays(int days);
     static TimeDelta FromHours(int hours);
     static TimeDelta FromMinutes(int minutes);
+    static TimeDelta FromSeconds(int64 secs);
+    static TimeDelta FromMilliseconds(int64 ms);
+    static TimeDelta FromMicroseconds(int64 us) {
+        return TimeDelta(us);
+    }
 
     static TimeDelta Max() {
         return TimeDelta(std::numeric_limits<int64>::max());
@@ -67,6 +72,11 @@ public:
     int InDays() const;
     int InHours() const;
     int InMinutes() const;
+    int64 InSeconds() const;
+    int64 InMilliseconds() const;
+    int64 InMicroseconds() const {
+        return delta_;
+    }
 
     TimeDelta &operator=(TimeDelta other) {
         delta_ = other.delta_;
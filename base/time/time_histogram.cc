@@ -0,0 +1,95 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "base/time/time_histogram.hh"
+
+#include "base/strings/string_printf.hh"
+
+namespace base {
+
+const int MicrosecondHistogram::kBuckets;
+
+MicrosecondHistogram::MicrosecondHistogram()
+{
+    Reset();
+}
+
+void MicrosecondHistogram::Record(int64 micros)
+{
+    const uint64 us = micros < 0 ? 0 : static_cast<uint64>(micros);
+    int bucket = 0;
+    while (bucket < kBuckets - 1 && (us >> bucket) != 0) {
+        ++bucket;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+    uint64 max = max_us_.load(std::memory_order_relaxed);
+    while (us > max &&
+           !max_us_.compare_exchange_weak(max, us,
+                                          std::memory_order_relaxed)) {
+    }
+}
+
+void MicrosecondHistogram::Reset()
+{
+    for (int i = 0; i < kBuckets; ++i) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+    sum_us_.store(0, std::memory_order_relaxed);
+    max_us_.store(0, std::memory_order_relaxed);
+}
+
+void MicrosecondHistogram::Read(Snapshot *snapshot) const
+{
+    snapshot->count = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        snapshot->buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        snapshot->count += snapshot->buckets[i];
+    }
+    snapshot->sum_us = sum_us_.load(std::memory_order_relaxed);
+    snapshot->max_us = max_us_.load(std::memory_order_relaxed);
+}
+
+void MicrosecondHistogram::AppendBucketsText(const Snapshot &snapshot,
+                                             std::string *out)
+{
+    bool first = true;
+    for (int i = 0; i < kBuckets; ++i) {
+        if (snapshot.buckets[i] == 0) {
+            continue;
+        }
+        if (!first) {
+            out->push_back(',');
+        }
+        first = false;
+        if (i == kBuckets - 1) {
+            StringAppendF(out, ">=%llu", 1ULL << (i - 1));
+        } else {
+            StringAppendF(out, "<%llu", 1ULL << i);
+        }
+        StringAppendF(out, ":%llu",
+                      static_cast<unsigned long long>(snapshot.buckets[i]));
+    }
+    if (first) {
+        out->push_back('-');
+    }
+}
+
+}  // namespace base
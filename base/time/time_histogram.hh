@@ -0,0 +1,68 @@
+// Copyright (c) 2014 Shuning Ge
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef BASE_TIME_TIME_HISTOGRAM_HH_
+#define BASE_TIME_TIME_HISTOGRAM_HH_
+
+#include <atomic>
+#include <string>
+
+#include "base/basictypes.hh"
+
+namespace base {
+
+// Times in power-of-two buckets of microseconds: bucket 0 counts the ones
+// under 1us, bucket i those under 2^i us, and the last one the rest.
+// Record() is a few relaxed atomic adds, so any number of threads can
+// share one histogram.
+class MicrosecondHistogram {
+public:
+    static const int kBuckets = 24;
+
+    struct Snapshot {
+        uint64 count;
+        uint64 sum_us;
+        uint64 max_us;
+        uint64 buckets[kBuckets];
+    };
+
+    MicrosecondHistogram();
+    void Record(int64 micros);
+    void Reset();
+    // Records that race with this may or may not be included.
+    void Read(Snapshot *snapshot) const;
+    uint64 max_us() const {
+        return max_us_.load(std::memory_order_relaxed);
+    }
+
+    // Appends the non-empty buckets of |snapshot| as "<limit:count,...",
+    // the last one as ">=limit:count", or "-" if all are empty.
+    static void AppendBucketsText(const Snapshot &snapshot, std::string *out);
+
+private:
+    std::atomic<uint64> sum_us_;
+    std::atomic<uint64> max_us_;
+    std::atomic<uint64> buckets_[kBuckets];
+    DISALLOW_COPY_AND_ASSIGN(MicrosecondHistogram);
+};
+
+}  // namespace base
+
+#endif  // BASE_TIME_TIME_HISTOGRAM_HH_